@@ -54,6 +54,16 @@ LOCAL_SRC_FILES    := b2g.sh
 LOCAL_MODULE_PATH  := $(TARGET_OUT_EXECUTABLES)
 include $(BUILD_PREBUILT)
 
+# Starts b2g without a shell and records startup timestamps; falls back
+# to b2g.sh for recovery.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := b2g-launcher
+LOCAL_MODULE_TAGS  := optional
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_SRC_FILES    := b2g-launcher.cpp
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
 include $(CLEAR_VARS)
 LOCAL_MODULE       := httpd.conf
 LOCAL_MODULE_TAGS  := optional
@@ -66,21 +76,53 @@ include $(CLEAR_VARS)
 LOCAL_MODULE       := fakeperm
 LOCAL_MODULE_TAGS  := optional
 LOCAL_MODULE_CLASS := EXECUTABLES
-LOCAL_SRC_FILES    := fakeperm.cpp
-LOCAL_SHARED_LIBRARIES := libbinder libutils liblog
+LOCAL_SRC_FILES    := fakeperm.cpp fakeservicestats.cpp
+LOCAL_SHARED_LIBRARIES := libbinder libutils libcutils liblog
+LOCAL_STATIC_LIBRARIES := libgonkunicode
 include $(BUILD_EXECUTABLE)
 
+# Times fakeperm's checkPermission in-process against fake /proc files.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := fakeperm-bench
+LOCAL_MODULE_TAGS  := tests
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_SRC_FILES    := fakeperm-bench.cpp fakeperm.cpp fakeservicestats.cpp
+LOCAL_SHARED_LIBRARIES := libbinder libutils libcutils liblog
+LOCAL_STATIC_LIBRARIES := libgonkunicode
+LOCAL_CFLAGS       := -DFAKESERVICES
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE       := fakeperm.conf
+LOCAL_MODULE_TAGS  := optional
+LOCAL_MODULE_CLASS := ETC
+LOCAL_SRC_FILES    := fakeperm.conf
+LOCAL_MODULE_PATH  := $(TARGET_OUT_ETC)
+include $(BUILD_PREBUILT)
+
 ifneq ($(wildcard frameworks/av/services/audioflinger),)
 include $(CLEAR_VARS)
 LOCAL_MODULE       := fakesched
 LOCAL_MODULE_TAGS  := optional
 LOCAL_MODULE_CLASS := EXECUTABLES
-LOCAL_SRC_FILES    := fakesched.cpp
-LOCAL_SHARED_LIBRARIES := libbinder libutils
+LOCAL_SRC_FILES    := fakesched.cpp fakeservicestats.cpp
+LOCAL_SHARED_LIBRARIES := libbinder libutils libcutils liblog
 LOCAL_STATIC_LIBRARIES := libscheduling_policy
 
 LOCAL_C_INCLUDES := frameworks/av/services/audioflinger
 include $(BUILD_EXECUTABLE)
+
+# Checks that fakesched applies, clamps and rejects priorities; run as root.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := fakesched-test
+LOCAL_MODULE_TAGS  := tests
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_SRC_FILES    := fakesched-test.cpp fakesched.cpp fakeservicestats.cpp
+LOCAL_SHARED_LIBRARIES := libbinder libutils libcutils liblog
+LOCAL_STATIC_LIBRARIES := libscheduling_policy
+LOCAL_C_INCLUDES   := frameworks/av/services/audioflinger
+LOCAL_CFLAGS       := -DFAKESERVICES
+include $(BUILD_EXECUTABLE)
 endif
 
 ifneq ($(wildcard frameworks/native/libs/binder),)
@@ -88,11 +130,32 @@ include $(CLEAR_VARS)
 LOCAL_MODULE       := fakeappops
 LOCAL_MODULE_TAGS  := optional
 LOCAL_MODULE_CLASS := EXECUTABLES
-LOCAL_SRC_FILES    := fakeappops.cpp
-LOCAL_SHARED_LIBRARIES := libbinder libutils
+LOCAL_SRC_FILES    := fakeappops.cpp fakeservicestats.cpp
+LOCAL_SHARED_LIBRARIES := libbinder libutils libcutils
 include $(BUILD_EXECUTABLE)
 endif
 
+# fakeperm, fakesched and fakeappops in a single process.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := fakeservices
+LOCAL_MODULE_TAGS  := optional
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_SRC_FILES    := fakeservices.cpp fakeperm.cpp fakeservicestats.cpp
+LOCAL_SHARED_LIBRARIES := libbinder libutils libcutils liblog
+LOCAL_STATIC_LIBRARIES := libgonkunicode
+LOCAL_CFLAGS       := -DFAKESERVICES -DANDROID_VERSION=$(PLATFORM_SDK_VERSION)
+ifneq ($(wildcard frameworks/av/services/audioflinger),)
+LOCAL_SRC_FILES    += fakesched.cpp
+LOCAL_STATIC_LIBRARIES += libscheduling_policy
+LOCAL_C_INCLUDES   := frameworks/av/services/audioflinger
+LOCAL_CFLAGS       += -DHAVE_FAKESCHED
+endif
+ifneq ($(wildcard frameworks/native/libs/binder),)
+LOCAL_SRC_FILES    += fakeappops.cpp
+LOCAL_CFLAGS       += -DHAVE_FAKEAPPOPS
+endif
+include $(BUILD_EXECUTABLE)
+
 include $(CLEAR_VARS)
 LOCAL_MODULE       := b2g-ps
 LOCAL_MODULE_TAGS  := optional
@@ -122,7 +185,51 @@ LOCAL_MODULE_TAGS  := optional
 LOCAL_MODULE_CLASS := DATA
 LOCAL_SRC_FILES    := oom-msg-logger.sh
 LOCAL_MODULE_PATH  := $(TARGET_OUT_EXECUTABLES)
-include $(BUILD_PREBUILT) 
+include $(BUILD_PREBUILT)
+
+# Vectorized implementation of the functions declared in Unicode.h, the
+# single-pass conversions declared in GonkUnicode.h, and the UTF-8 code
+# point index in Utf8Index.h.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := libgonkunicode
+LOCAL_MODULE_TAGS  := optional
+LOCAL_SRC_FILES    := Unicode.cpp Utf8Index.cpp
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_ARM_NEON     := true
+endif
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE       := libgonkunicode
+LOCAL_MODULE_TAGS  := optional
+LOCAL_SRC_FILES    := Unicode.cpp Utf8Index.cpp
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# Checks libgonkunicode against libutils on random strings.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := gonkunicode-test
+LOCAL_MODULE_TAGS  := tests
+LOCAL_SRC_FILES    := gonkunicode-test.cpp
+LOCAL_STATIC_LIBRARIES := libgonkunicode libutils libcutils liblog
+include $(BUILD_HOST_EXECUTABLE)
+
+# Times libgonkunicode's char16_t string functions and UTF-8 <-> UTF-16
+# conversions against libutils'.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := gonkunicode-bench
+LOCAL_MODULE_TAGS  := tests
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_SRC_FILES    := gonkunicode-bench.cpp
+LOCAL_SHARED_LIBRARIES := libutils
+LOCAL_STATIC_LIBRARIES := libgonkunicode
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE       := gonkunicode-bench
+LOCAL_MODULE_TAGS  := tests
+LOCAL_SRC_FILES    := gonkunicode-bench.cpp
+LOCAL_STATIC_LIBRARIES := libgonkunicode libutils libcutils liblog
+include $(BUILD_HOST_EXECUTABLE)
 
 $(OUT_DOCS)/api-stubs-timestamp:
 	mkdir -p `dirname $@`
@@ -194,7 +301,20 @@ endif
 
 ifeq ($(ENABLE_GLOBAL_PRELINK),1)
 APRIORI := $(HOST_OUT_EXECUTABLES)/apriori$(HOST_EXECUTABLE_SUFFIX)
+GEN_PRELINK_MAP := $(abspath $(LOCAL_PATH)/gen-prelink-map.py)
+PRELINK_LIB_DIRS := -L$(TARGET_OUT_SHARED_LIBRARIES) -L$(TARGET_OUT)/b2g
+# With GENERATE_PRELINK_MAP=1 the map is computed from the libraries we
+# just built instead of using the checked in one.
+# Otherwise the checked in map is checked against them: a library that
+# outgrew its slot, or a Gecko library that isn't in the map, fails the
+# build.  A missing system library that one of them needs is only a
+# warning, since apriori doesn't prelink those itself.
+ifeq ($(GENERATE_PRELINK_MAP),1)
+PRELINK_MAP := $(abspath $(TARGET_OUT_INTERMEDIATES)/prelink.map)
+else
 PRELINK_MAP := $(abspath $(LOCAL_PATH)/prelink.map)
+PRELINK_MAP_DEP := $(PRELINK_MAP)
+endif
 ifeq ($(MOZ_DMD),1)
 PRELOAD_LIBS := -Dlibmozglue.so -Dlibdmd.so
 else
@@ -214,7 +334,7 @@ PRESERVE_DIRS := distribution
 ifeq ($(PRESERVE_B2G_WEBAPPS), 1)
 PRESERVE_DIRS += webapps
 endif
-$(LOCAL_INSTALLED_MODULE): $(LOCAL_BUILT_MODULE) gaia/profile.tar.gz $(APRIORI) $(PRELINK_MAP)
+$(LOCAL_INSTALLED_MODULE): $(LOCAL_BUILT_MODULE) gaia/profile.tar.gz $(APRIORI) $(PRELINK_MAP_DEP)
 	@echo Install dir: $(TARGET_OUT)/b2g
 
 	rm -rf $(filter-out $(addprefix $(TARGET_OUT)/b2g/,$(PRESERVE_DIRS)),$(wildcard $(TARGET_OUT)/b2g/*))
@@ -225,6 +345,14 @@ $(LOCAL_INSTALLED_MODULE): $(LOCAL_BUILT_MODULE) gaia/profile.tar.gz $(APRIORI)
 	cd $(TARGET_OUT) && tar xvfz $(abspath $<)
 
 ifeq ($(ENABLE_GLOBAL_PRELINK),1)
+ifeq ($(GENERATE_PRELINK_MAP),1)
+	mkdir -p $(dir $(PRELINK_MAP))
+	python $(GEN_PRELINK_MAP) $(PRELINK_LIB_DIRS) --output $(PRELINK_MAP) \
+		`find $(TARGET_OUT)/b2g -name "lib*.so"`
+else
+	python $(GEN_PRELINK_MAP) $(PRELINK_LIB_DIRS) --check $(PRELINK_MAP) \
+		`find $(TARGET_OUT)/b2g -name "lib*.so"`
+endif
 	$(APRIORI)  \
 		$(PRELOAD_LIBS) \
 		-L$(TARGET_OUT_SHARED_LIBRARIES) \
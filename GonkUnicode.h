@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GONK_UNICODE_H
+#define GONK_UNICODE_H
+
+#include "Unicode.h"
+
+/*
+ * libgonkunicode: a faster implementation of the functions in Unicode.h,
+ * plus single-pass conversions libutils doesn't have.
+ *
+ * Everything is in namespace gonk, so a program can link libgonkunicode
+ * and libutils together and choose which one it calls.  The functions
+ * below which share a name with one in Unicode.h return exactly what
+ * libutils' version does; see Unicode.h for what they do.
+ */
+
+namespace gonk {
+
+int strcmp16(const char16_t *, const char16_t *);
+int strncmp16(const char16_t *s1, const char16_t *s2, size_t n);
+size_t strlen16(const char16_t *);
+size_t strnlen16(const char16_t *, size_t);
+char16_t *strcpy16(char16_t *, const char16_t *);
+char16_t *strncpy16(char16_t *, const char16_t *, size_t);
+int strzcmp16(const char16_t *s1, size_t n1, const char16_t *s2, size_t n2);
+int strzcmp16_h_n(const char16_t *s1H, size_t n1, const char16_t *s2N, size_t n2);
+size_t strlen32(const char32_t *);
+size_t strnlen32(const char32_t *, size_t);
+
+ssize_t utf32_to_utf8_length(const char32_t *src, size_t src_len);
+void utf32_to_utf8(const char32_t* src, size_t src_len, char* dst);
+int32_t utf32_from_utf8_at(const char *src, size_t src_len, size_t index, size_t *next_index);
+ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len);
+void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst);
+ssize_t utf8_length(const char *src);
+size_t utf8_to_utf32_length(const char *src, size_t src_len);
+void utf8_to_utf32(const char* src, size_t src_len, char32_t* dst);
+ssize_t utf8_to_utf16_length(const uint8_t* src, size_t srcLen);
+char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* src, size_t srcLen, char16_t* dst);
+void utf8_to_utf16(const uint8_t* src, size_t srcLen, char16_t* dst);
+
+/*
+ * The rest have no counterpart in libutils.  Unlike the functions above,
+ * they reject ill-formed input.
+ */
+
+/**
+ * What the single-pass functions below return instead of a length.
+ */
+enum UnicodeError {
+    kUnicodeInvalidInput = -1,
+    kUnicodeBufferTooSmall = -2
+};
+
+/**
+ * Checks that "src" is well-formed UTF-8: no overlong forms, surrogates,
+ * code points above 0x10FFFF or truncated sequences.
+ * Returns the UTF-16 length of "src", or kUnicodeInvalidInput, in which
+ * case the byte offset of the first bad sequence is stored in "error_pos"
+ * if it is not NULL.
+ */
+ssize_t utf8_validate(const uint8_t* src, size_t src_len, size_t* error_pos);
+
+/**
+ * Validates and converts UTF-8 to UTF-16 in a single pass, writing at most
+ * "dst_len" units to "dst". "dst" is not null-terminated.
+ * Returns the number of units written, or
+ *  - kUnicodeInvalidInput if "src" is not well-formed (see utf8_validate),
+ *  - kUnicodeBufferTooSmall if "dst" filled up first.
+ * On error "error_pos", if not NULL, receives the byte offset in "src" at
+ * which conversion stopped; everything before it has been written to "dst".
+ * A buffer of "src_len" units is always large enough.
+ */
+ssize_t utf8_to_utf16_bounded(const uint8_t* src, size_t src_len,
+                              char16_t* dst, size_t dst_len, size_t* error_pos);
+
+/**
+ * Validates and converts UTF-16 to UTF-8 in a single pass, writing at most
+ * "dst_len" bytes to "dst". "dst" is not null-terminated.
+ * Returns the number of bytes written, or
+ *  - kUnicodeInvalidInput if "src" contains an unpaired surrogate,
+ *  - kUnicodeBufferTooSmall if "dst" filled up first.
+ * On error "error_pos", if not NULL, receives the unit offset in "src" at
+ * which conversion stopped; everything before it has been written to "dst".
+ * A buffer of 3 * "src_len" bytes is always large enough.
+ */
+ssize_t utf16_to_utf8_bounded(const char16_t* src, size_t src_len,
+                              char* dst, size_t dst_len, size_t* error_pos);
+
+} // namespace gonk
+
+#endif
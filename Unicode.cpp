@@ -0,0 +1,1120 @@
+/*
+ * Copyright (C) 2005 The Android Open Source Project
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * An implementation of the functions declared in Unicode.h, in namespace
+ * gonk so that it can be linked next to libutils' (see GonkUnicode.h).
+ *
+ * The scalar code behaves exactly like libutils' Unicode.cpp.  On top of
+ * that, the UTF-8 <-> UTF-16 conversions and their length functions handle
+ * runs of ASCII 16 (SSE2, NEON) or 32 (AVX2) units at a time, falling back
+ * to the scalar code for each non-ASCII code point.  Strings crossing
+ * binder are overwhelmingly ASCII, so that's where the time goes.
+ *
+ * The char16_t string functions compare or scan 8 units at a time (SSE2,
+ * NEON).  Loads past a terminator never cross into the next page, so they
+ * can't fault where the scalar code wouldn't.
+ */
+
+#include "GonkUnicode.h"
+
+#include <arpa/inet.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UNICODE_SSE2 1
+#define UNICODE_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UNICODE_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UNICODE_NEON 1
+#endif
+
+namespace gonk {
+
+static const char32_t kByteMask = 0x000000BF;
+static const char32_t kByteMark = 0x00000080;
+
+// Surrogates aren't valid for UTF-32 characters, so define some
+// constants that will let us screen them out.
+static const char32_t kUnicodeSurrogateHighStart  = 0x0000D800;
+static const char32_t kUnicodeSurrogateLowEnd     = 0x0000DFFF;
+static const char32_t kUnicodeSurrogateStart      = kUnicodeSurrogateHighStart;
+static const char32_t kUnicodeSurrogateEnd        = kUnicodeSurrogateLowEnd;
+static const char32_t kUnicodeMaxCodepoint        = 0x0010FFFF;
+
+// Mask used to set appropriate bits in first byte of UTF-8 sequence,
+// indexed by number of bytes in the sequence.
+// 0xxxxxxx
+// -> (00-7f) 7bit. Bit mask for the first byte is 0x00000000
+// 110yyyyx 10xxxxxx
+// -> (c0-df)(80-bf) 11bit. Bit mask is 0x000000C0
+// 1110yyyy 10yxxxxx 10xxxxxx
+// -> (e0-ef)(80-bf)(80-bf) 16bit. Bit mask is 0x000000E0
+// 11110yyy 10yyxxxx 10xxxxxx 10xxxxxx
+// -> (f0-f7)(80-bf)(80-bf)(80-bf) 21bit. Bit mask is 0x000000F0
+static const char32_t kFirstByteMark[] = {
+    0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
+};
+
+// --------------------------------------------------------------------------
+// ASCII fast paths
+// --------------------------------------------------------------------------
+
+/**
+ * Returns the number of leading bytes of "src" (at most "len") that are
+ * ASCII.
+ */
+static inline size_t ascii_prefix_length(const uint8_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(UNICODE_AVX2)
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(v);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(UNICODE_SSE2)
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(v);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(UNICODE_NEON)
+    const uint8x16_t nonascii = vdupq_n_u8(0x80);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vandq_u8(vld1q_u8(src + i), nonascii);
+        uint64x2_t v64 = vreinterpretq_u64_u8(v);
+        if (vgetq_lane_u64(v64, 0) | vgetq_lane_u64(v64, 1)) {
+            break;  // let the scalar loop find the exact byte
+        }
+    }
+#endif
+    while (i < len && !(src[i] & 0x80)) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Copies "len" ASCII bytes from "src" to "dst", zero-extending each.
+ */
+static inline void widen_ascii(const uint8_t* src, size_t len, char16_t* dst)
+{
+    size_t i = 0;
+#if defined(UNICODE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#elif defined(UNICODE_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        vst1q_u16((uint16_t*)(dst + i), vmovl_u8(vget_low_u8(v)));
+        vst1q_u16((uint16_t*)(dst + i + 8), vmovl_u8(vget_high_u8(v)));
+    }
+#endif
+    for (; i < len; i++) {
+        dst[i] = src[i];
+    }
+}
+
+/**
+ * Returns the number of leading units of "src" (at most "len") below 0x80.
+ */
+static inline size_t utf16_ascii_prefix_length(const char16_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(UNICODE_AVX2)
+    const __m256i nonascii256 = _mm256_set1_epi16((short) 0xFF80);
+    for (; i + 16 <= len; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (!_mm256_testz_si256(v, nonascii256)) {
+            break;
+        }
+    }
+#endif
+#if defined(UNICODE_SSE2)
+    const __m128i nonascii = _mm_set1_epi16((short) 0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= len; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i bad = _mm_cmpeq_epi16(_mm_and_si128(v, nonascii), zero);
+        uint32_t mask = ~(uint32_t) _mm_movemask_epi8(bad) & 0xFFFF;
+        if (mask) {
+            return i + __builtin_ctz(mask) / 2;
+        }
+    }
+#elif defined(UNICODE_NEON)
+    const uint16x8_t nonascii = vdupq_n_u16(0xFF80);
+    for (; i + 8 <= len; i += 8) {
+        uint16x8_t v = vandq_u16(vld1q_u16((const uint16_t*)(src + i)), nonascii);
+        uint64x2_t v64 = vreinterpretq_u64_u16(v);
+        if (vgetq_lane_u64(v64, 0) | vgetq_lane_u64(v64, 1)) {
+            break;
+        }
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Copies "len" UTF-16 units, all below 0x80, from "src" to "dst" as bytes.
+ */
+static inline void narrow_ascii(const char16_t* src, size_t len, char* dst)
+{
+    size_t i = 0;
+#if defined(UNICODE_SSE2)
+    for (; i + 16 <= len; i += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(src + i + 8));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(UNICODE_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint16x8_t lo = vld1q_u16((const uint16_t*)(src + i));
+        uint16x8_t hi = vld1q_u16((const uint16_t*)(src + i + 8));
+        vst1q_u8((uint8_t*)(dst + i), vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+    }
+#endif
+    for (; i < len; i++) {
+        dst[i] = (char) src[i];
+    }
+}
+
+// --------------------------------------------------------------------------
+// char16_t vector helpers
+// --------------------------------------------------------------------------
+
+#if defined(UNICODE_SSE2) || defined(UNICODE_NEON)
+#define UNICODE_VEC16 1
+
+// The smallest page size we run with; loads of 8 units starting at most
+// this far into a page stay inside it.
+static const uintptr_t kPageSize = 4096;
+
+// A mask with kLaneBits bits set for each of 8 char16_t lanes that matched.
+typedef uint64_t lane_mask_t;
+
+#if defined(UNICODE_SSE2)
+static const unsigned kLaneBits = 1;
+
+static inline __m128i load16(const char16_t* p)
+{
+    return _mm_loadu_si128((const __m128i*) p);
+}
+
+static inline lane_mask_t lanes_to_mask(__m128i cmp)
+{
+    return (unsigned) _mm_movemask_epi8(_mm_packs_epi16(cmp, _mm_setzero_si128()));
+}
+
+static inline lane_mask_t zero_lanes16(const char16_t* p)
+{
+    return lanes_to_mask(_mm_cmpeq_epi16(load16(p), _mm_setzero_si128()));
+}
+
+static inline lane_mask_t mismatch_lanes16(const char16_t* a, const char16_t* b)
+{
+    __m128i eq = _mm_cmpeq_epi16(load16(a), load16(b));
+    return lanes_to_mask(eq) ^ 0xFF;
+}
+
+static inline lane_mask_t mismatch_or_zero_lanes16(const char16_t* a, const char16_t* b)
+{
+    __m128i va = load16(a);
+    __m128i eq = _mm_cmpeq_epi16(va, load16(b));
+    __m128i zero = _mm_cmpeq_epi16(va, _mm_setzero_si128());
+    return lanes_to_mask(_mm_andnot_si128(_mm_andnot_si128(zero, eq), _mm_set1_epi16(-1)));
+}
+
+// Like mismatch_lanes16(), but "bN" is in network byte order.
+static inline lane_mask_t mismatch_lanes16_h_n(const char16_t* aH, const char16_t* bN)
+{
+    __m128i vb = load16(bN);
+    vb = _mm_or_si128(_mm_slli_epi16(vb, 8), _mm_srli_epi16(vb, 8));
+    return lanes_to_mask(_mm_cmpeq_epi16(load16(aH), vb)) ^ 0xFF;
+}
+#else
+static const unsigned kLaneBits = 8;
+
+static inline uint16x8_t load16(const char16_t* p)
+{
+    return vld1q_u16((const uint16_t*) p);
+}
+
+static inline lane_mask_t lanes_to_mask(uint16x8_t cmp)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(cmp)), 0);
+}
+
+static inline lane_mask_t zero_lanes16(const char16_t* p)
+{
+    return lanes_to_mask(vceqq_u16(load16(p), vdupq_n_u16(0)));
+}
+
+static inline lane_mask_t mismatch_lanes16(const char16_t* a, const char16_t* b)
+{
+    return lanes_to_mask(vmvnq_u16(vceqq_u16(load16(a), load16(b))));
+}
+
+static inline lane_mask_t mismatch_or_zero_lanes16(const char16_t* a, const char16_t* b)
+{
+    uint16x8_t va = load16(a);
+    uint16x8_t ne = vmvnq_u16(vceqq_u16(va, load16(b)));
+    return lanes_to_mask(vorrq_u16(ne, vceqq_u16(va, vdupq_n_u16(0))));
+}
+
+// Like mismatch_lanes16(), but "bN" is in network byte order.
+static inline lane_mask_t mismatch_lanes16_h_n(const char16_t* aH, const char16_t* bN)
+{
+    uint16x8_t vb = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(load16(bN))));
+    return lanes_to_mask(vmvnq_u16(vceqq_u16(load16(aH), vb)));
+}
+#endif
+
+static inline size_t first_lane(lane_mask_t mask)
+{
+    return __builtin_ctzll(mask) / kLaneBits;
+}
+
+/**
+ * Returns true if 8 units can be loaded from "p" without touching the
+ * next page.
+ */
+static inline bool vec16_safe(const char16_t* p)
+{
+    return ((uintptr_t) p & (kPageSize - 1)) <= kPageSize - 16;
+}
+#endif
+
+// --------------------------------------------------------------------------
+// Scalar helpers
+// --------------------------------------------------------------------------
+
+static inline size_t
+utf32_codepoint_utf8_length(char32_t srcChar)
+{
+    // Figure out how many bytes the result will require.
+    if (srcChar < 0x00000080) {
+        return 1;
+    } else if (srcChar < 0x00000800) {
+        return 2;
+    } else if (srcChar < 0x00010000) {
+        if ((srcChar < kUnicodeSurrogateStart) || (srcChar > kUnicodeSurrogateEnd)) {
+            return 3;
+        } else {
+            // Surrogates are invalid UTF-32 characters.
+            return 0;
+        }
+    }
+    // Max code point for Unicode is 0x0010FFFF.
+    else if (srcChar <= kUnicodeMaxCodepoint) {
+        return 4;
+    } else {
+        // Invalid UTF-32 character.
+        return 0;
+    }
+}
+
+// Write out the source character to <dstP>.
+
+static inline void
+utf32_codepoint_to_utf8(uint8_t* dstP, char32_t srcChar, size_t bytes)
+{
+    dstP += bytes;
+    switch (bytes)
+    {   /* note: everything falls through. */
+        case 4: *--dstP = (uint8_t)((srcChar | kByteMark) & kByteMask); srcChar >>= 6;
+        case 3: *--dstP = (uint8_t)((srcChar | kByteMark) & kByteMask); srcChar >>= 6;
+        case 2: *--dstP = (uint8_t)((srcChar | kByteMark) & kByteMask); srcChar >>= 6;
+        case 1: *--dstP = (uint8_t)(srcChar | kFirstByteMark[bytes]);
+    }
+}
+
+static inline int32_t
+utf32_at_internal(const char* cur, size_t *num_read)
+{
+    const char first_char = *cur;
+    if ((first_char & 0x80) == 0) { // ASCII
+        *num_read = 1;
+        return *cur;
+    }
+    cur++;
+    char32_t mask, to_ignore_mask;
+    size_t num_to_read = 0;
+    char32_t utf32 = first_char;
+    for (num_to_read = 1, mask = 0x40, to_ignore_mask = 0xFFFFFF80;
+         (first_char & mask);
+         num_to_read++, to_ignore_mask |= mask, mask >>= 1) {
+        // 0x3F == 00111111
+        utf32 = (utf32 << 6) + (*cur++ & 0x3F);
+    }
+    to_ignore_mask |= mask;
+    utf32 &= ~(to_ignore_mask << (6 * (num_to_read - 1)));
+
+    *num_read = num_to_read;
+    return static_cast<int32_t>(utf32);
+}
+
+/**
+ * Returns 1-4 based on the number of leading bits.
+ *
+ * 1111 -> 4
+ * 1110 -> 3
+ * 110x -> 2
+ * 10xx -> 1
+ * 0xxx -> 1
+ */
+static inline size_t
+utf8_codepoint_len(uint8_t ch)
+{
+    return ((0xe5000000 >> ((ch >> 3) & 0x1e)) & 3) + 1;
+}
+
+static inline void
+utf8_shift_and_mask(uint32_t* codePoint, const uint8_t byte)
+{
+    *codePoint <<= 6;
+    *codePoint |= 0x3F & byte;
+}
+
+static inline uint32_t
+utf8_to_utf32_codepoint(const uint8_t *src, size_t length)
+{
+    uint32_t unicode;
+
+    switch (length)
+    {
+        case 1:
+            return src[0];
+        case 2:
+            unicode = src[0] & 0x1f;
+            utf8_shift_and_mask(&unicode, src[1]);
+            return unicode;
+        case 3:
+            unicode = src[0] & 0x0f;
+            utf8_shift_and_mask(&unicode, src[1]);
+            utf8_shift_and_mask(&unicode, src[2]);
+            return unicode;
+        case 4:
+            unicode = src[0] & 0x07;
+            utf8_shift_and_mask(&unicode, src[1]);
+            utf8_shift_and_mask(&unicode, src[2]);
+            utf8_shift_and_mask(&unicode, src[3]);
+            return unicode;
+        default:
+            return 0xffff;
+    }
+}
+
+// --------------------------------------------------------------------------
+// char16_t and char32_t string functions
+// --------------------------------------------------------------------------
+
+int strcmp16(const char16_t *s1, const char16_t *s2)
+{
+  char16_t ch;
+  int d = 0;
+
+  while ( 1 ) {
+#if defined(UNICODE_VEC16)
+    if ( vec16_safe(s1) && vec16_safe(s2) ) {
+      lane_mask_t m = mismatch_or_zero_lanes16(s1, s2);
+      if ( m ) {
+        size_t i = first_lane(m);
+        return (int)s1[i] - (int)s2[i];
+      }
+      s1 += 8;
+      s2 += 8;
+      continue;
+    }
+#endif
+    d = (int)(ch = *s1++) - (int)*s2++;
+    if ( d || !ch )
+      break;
+  }
+
+  return d;
+}
+
+int strncmp16(const char16_t *s1, const char16_t *s2, size_t n)
+{
+  char16_t ch;
+  int d = 0;
+
+  while ( n-- ) {
+#if defined(UNICODE_VEC16)
+    if ( n >= 7 && vec16_safe(s1) && vec16_safe(s2) ) {
+      lane_mask_t m = mismatch_or_zero_lanes16(s1, s2);
+      if ( m ) {
+        size_t i = first_lane(m);
+        return (int)s1[i] - (int)s2[i];
+      }
+      s1 += 8;
+      s2 += 8;
+      n -= 7;
+      continue;
+    }
+#endif
+    d = (int)(ch = *s1++) - (int)*s2++;
+    if ( d || !ch )
+      break;
+  }
+
+  return d;
+}
+
+char16_t *strcpy16(char16_t *dst, const char16_t *src)
+{
+  char16_t *q = dst;
+  const char16_t *p = src;
+  char16_t ch;
+
+  do {
+    *q++ = ch = *p++;
+  } while ( ch );
+
+  return dst;
+}
+
+size_t strlen16(const char16_t *s)
+{
+#if defined(UNICODE_VEC16)
+  // Aligned loads never cross a page, even when they start before "s".
+  if ( !((uintptr_t)s & 1) ) {
+    const char16_t *p = (const char16_t *)((uintptr_t)s & ~(uintptr_t)15);
+    lane_mask_t m = zero_lanes16(p) >> ((s - p) * kLaneBits);
+    size_t len = 0;
+    for ( p += 8; !m; p += 8 ) {
+      len = p - s;
+      m = zero_lanes16(p);
+    }
+    return len + first_lane(m);
+  }
+#endif
+  const char16_t *ss = s;
+  while ( *ss )
+    ss++;
+  return ss-s;
+}
+
+
+char16_t *strncpy16(char16_t *dst, const char16_t *src, size_t n)
+{
+  char16_t *q = dst;
+  const char16_t *p = src;
+  char ch;
+
+  while (n) {
+    n--;
+    *q++ = ch = *p++;
+    if ( !ch )
+      break;
+  }
+
+  *q = 0;
+
+  return dst;
+}
+
+size_t strnlen16(const char16_t *s, size_t maxlen)
+{
+#if defined(UNICODE_VEC16)
+  if ( maxlen > 0 && !((uintptr_t)s & 1) ) {
+    const char16_t *p = (const char16_t *)((uintptr_t)s & ~(uintptr_t)15);
+    lane_mask_t m = zero_lanes16(p) >> ((s - p) * kLaneBits);
+    size_t len = 0;
+    for ( p += 8; !m; p += 8 ) {
+      len = p - s;
+      if ( len >= maxlen )
+        return maxlen;
+      m = zero_lanes16(p);
+    }
+    len += first_lane(m);
+    return len < maxlen ? len : maxlen;
+  }
+#endif
+  const char16_t *ss = s;
+
+  /* Important: the maxlen test must precede the reference through ss;
+     since the byte beyond the maximum may segfault */
+  while ((maxlen > 0) && *ss) {
+    ss++;
+    maxlen--;
+  }
+  return ss-s;
+}
+
+int strzcmp16(const char16_t *s1, size_t n1, const char16_t *s2, size_t n2)
+{
+    const char16_t* e1 = s1+n1;
+    const char16_t* e2 = s2+n2;
+
+#if defined(UNICODE_VEC16)
+    const size_t n = n1 < n2 ? n1 : n2;
+    for (const char16_t* e = s1 + (n & ~(size_t)7); s1 < e; s1 += 8, s2 += 8) {
+        lane_mask_t m = mismatch_lanes16(s1, s2);
+        if (m) {
+            size_t i = first_lane(m);
+            return (int)s1[i] - (int)s2[i];
+        }
+    }
+#endif
+    while (s1 < e1 && s2 < e2) {
+        const int d = (int)*s1++ - (int)*s2++;
+        if (d) {
+            return d;
+        }
+    }
+
+    return n1 < n2
+        ? (0 - (int)*s2)
+        : (n1 > n2
+           ? ((int)*s1 - 0)
+           : 0);
+}
+
+int strzcmp16_h_n(const char16_t *s1H, size_t n1, const char16_t *s2N, size_t n2)
+{
+    const char16_t* e1 = s1H+n1;
+    const char16_t* e2 = s2N+n2;
+
+#if defined(UNICODE_VEC16)
+    const size_t n = n1 < n2 ? n1 : n2;
+    for (const char16_t* e = s1H + (n & ~(size_t)7); s1H < e; s1H += 8, s2N += 8) {
+        lane_mask_t m = mismatch_lanes16_h_n(s1H, s2N);
+        if (m) {
+            size_t i = first_lane(m);
+            return (int)s1H[i] - (int)ntohs(s2N[i]);
+        }
+    }
+#endif
+    while (s1H < e1 && s2N < e2) {
+        const char16_t c2 = ntohs(*s2N);
+        const int d = (int)*s1H++ - (int)c2;
+        s2N++;
+        if (d) {
+            return d;
+        }
+    }
+
+    return n1 < n2
+        ? (0 - (int)ntohs(*s2N))
+        : (n1 > n2
+           ? ((int)*s1H - 0)
+           : 0);
+}
+
+size_t strlen32(const char32_t *s)
+{
+  const char32_t *ss = s;
+  while ( *ss )
+    ss++;
+  return ss-s;
+}
+
+size_t strnlen32(const char32_t *s, size_t maxlen)
+{
+  const char32_t *ss = s;
+  while ((maxlen > 0) && *ss) {
+    ss++;
+    maxlen--;
+  }
+  return ss-s;
+}
+
+// --------------------------------------------------------------------------
+// UTF-32
+// --------------------------------------------------------------------------
+
+int32_t utf32_from_utf8_at(const char *src, size_t src_len, size_t index, size_t *next_index)
+{
+    if (index >= src_len) {
+        return -1;
+    }
+    size_t dummy_index;
+    if (next_index == NULL) {
+        next_index = &dummy_index;
+    }
+    size_t num_read;
+    int32_t ret = utf32_at_internal(src + index, &num_read);
+    if (ret >= 0) {
+        *next_index = index + num_read;
+    }
+
+    return ret;
+}
+
+ssize_t utf32_to_utf8_length(const char32_t *src, size_t src_len)
+{
+    if (src == NULL || src_len == 0) {
+        return -1;
+    }
+
+    size_t ret = 0;
+    const char32_t *end = src + src_len;
+    while (src < end) {
+        ret += utf32_codepoint_utf8_length(*src++);
+    }
+    return ret;
+}
+
+void utf32_to_utf8(const char32_t* src, size_t src_len, char* dst)
+{
+    if (src == NULL || src_len == 0 || dst == NULL) {
+        return;
+    }
+
+    const char32_t *cur_utf32 = src;
+    const char32_t *end_utf32 = src + src_len;
+    char *cur = dst;
+    while (cur_utf32 < end_utf32) {
+        size_t len = utf32_codepoint_utf8_length(*cur_utf32);
+        utf32_codepoint_to_utf8((uint8_t *)cur, *cur_utf32++, len);
+        cur += len;
+    }
+    *cur = '\0';
+}
+
+// --------------------------------------------------------------------------
+// UTF-16 -> UTF-8
+// --------------------------------------------------------------------------
+
+ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
+{
+    if (src == NULL || src_len == 0) {
+        return -1;
+    }
+
+    size_t ret = 0;
+    const char16_t* const end = src + src_len;
+    while (src < end) {
+        if (*src < 0x80) {
+            size_t ascii = utf16_ascii_prefix_length(src, end - src);
+            ret += ascii;
+            src += ascii;
+            continue;
+        }
+
+        if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
+                && (*++src & 0xFC00) == 0xDC00) {
+            // surrogate pairs are always 4 bytes.
+            ret += 4;
+            src++;
+        } else {
+            ret += utf32_codepoint_utf8_length((char32_t) *src++);
+        }
+    }
+    return ret;
+}
+
+void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst)
+{
+    if (src == NULL || src_len == 0 || dst == NULL) {
+        return;
+    }
+
+    const char16_t* cur_utf16 = src;
+    const char16_t* const end_utf16 = src + src_len;
+    char *cur = dst;
+    while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80) {
+            size_t ascii = utf16_ascii_prefix_length(cur_utf16, end_utf16 - cur_utf16);
+            narrow_ascii(cur_utf16, ascii, cur);
+            cur_utf16 += ascii;
+            cur += ascii;
+            continue;
+        }
+
+        char32_t utf32;
+        // surrogate pairs
+        if ((*cur_utf16 & 0xFC00) == 0xD800) {
+            utf32 = (*cur_utf16++ - 0xD800) << 10;
+            utf32 |= *cur_utf16++ - 0xDC00;
+            utf32 += 0x10000;
+        } else {
+            utf32 = (char32_t) *cur_utf16++;
+        }
+        const size_t len = utf32_codepoint_utf8_length(utf32);
+        utf32_codepoint_to_utf8((uint8_t*)cur, utf32, len);
+        cur += len;
+    }
+    *cur = '\0';
+}
+
+// --------------------------------------------------------------------------
+// UTF-8 -> UTF-32
+// --------------------------------------------------------------------------
+
+ssize_t utf8_length(const char *src)
+{
+    const char *cur = src;
+    size_t ret = 0;
+    while (*cur != '\0') {
+        const char first_char = *cur++;
+        if ((first_char & 0x80) == 0) { // ASCII
+            ret += 1;
+            continue;
+        }
+        // (UTF-8's character must not be like 10xxxxxx,
+        //  but 110xxxxx, 1110xxxx, ... or 1111110x)
+        if ((first_char & 0x40) == 0) {
+            return -1;
+        }
+
+        int32_t mask, to_ignore_mask;
+        size_t num_to_read = 0;
+        char32_t utf32 = 0;
+        for (num_to_read = 1, mask = 0x40, to_ignore_mask = 0x80;
+             num_to_read < 5 && (first_char & mask);
+             num_to_read++, to_ignore_mask |= mask, mask >>= 1) {
+            if ((*cur & 0xC0) != 0x80) { // must be 10xxxxxx
+                return -1;
+            }
+            // 0x3F == 00111111
+            utf32 = (utf32 << 6) + (*cur++ & 0x3F);
+        }
+        // "first_char" must be (110xxxxx - 11110xxx)
+        if (num_to_read == 5) {
+            return -1;
+        }
+        to_ignore_mask |= mask;
+        utf32 |= ((~to_ignore_mask) & first_char) << (6 * (num_to_read - 1));
+        if (utf32 > kUnicodeMaxCodepoint) {
+            return -1;
+        }
+
+        ret += num_to_read;
+    }
+    return ret;
+}
+
+size_t utf8_to_utf32_length(const char *src, size_t src_len)
+{
+    if (src == NULL || src_len == 0) {
+        return 0;
+    }
+    size_t ret = 0;
+    const char* cur;
+    const char* end;
+    size_t num_to_skip;
+    for (cur = src, end = src + src_len, num_to_skip = 1;
+         cur < end;
+         cur += num_to_skip, ret++) {
+        const char first_char = *cur;
+        num_to_skip = 1;
+        if ((first_char & 0x80) == 0) {  // ASCII
+            continue;
+        }
+        int32_t mask;
+
+        for (mask = 0x40; (first_char & mask); num_to_skip++, mask >>= 1) {
+        }
+    }
+    return ret;
+}
+
+void utf8_to_utf32(const char* src, size_t src_len, char32_t* dst)
+{
+    if (src == NULL || src_len == 0 || dst == NULL) {
+        return;
+    }
+
+    const char* cur = src;
+    const char* const end = src + src_len;
+    char32_t* cur_utf32 = dst;
+    while (cur < end) {
+        size_t num_read;
+        *cur_utf32++ = static_cast<char32_t>(utf32_at_internal(cur, &num_read));
+        cur += num_read;
+    }
+    *cur_utf32 = 0;
+}
+
+// --------------------------------------------------------------------------
+// UTF-8 -> UTF-16
+// --------------------------------------------------------------------------
+
+ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len)
+{
+    const uint8_t* const u8end = u8str + u8len;
+    const uint8_t* u8cur = u8str;
+
+    /* Validate that the UTF-8 is the correct len */
+    size_t u16measuredLen = 0;
+    while (u8cur < u8end) {
+        if (!(*u8cur & 0x80)) {
+            size_t ascii = ascii_prefix_length(u8cur, u8end - u8cur);
+            u16measuredLen += ascii;
+            u8cur += ascii;
+            continue;
+        }
+
+        u16measuredLen++;
+        size_t u8charLen = utf8_codepoint_len(*u8cur);
+        if (u8charLen > (size_t)(u8end - u8cur)) {
+            // The last code point runs off the end of the string.
+            return -1;
+        }
+        uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8charLen);
+        if (codepoint > 0xFFFF) u16measuredLen++; // this will be a surrogate pair in utf16
+        u8cur += u8charLen;
+    }
+
+    return u16measuredLen;
+}
+
+char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* u8str, size_t u8len, char16_t* u16str)
+{
+    const uint8_t* const u8end = u8str + u8len;
+    const uint8_t* u8cur = u8str;
+    char16_t* u16cur = u16str;
+
+    while (u8cur < u8end) {
+        if (!(*u8cur & 0x80)) {
+            size_t ascii = ascii_prefix_length(u8cur, u8end - u8cur);
+            widen_ascii(u8cur, ascii, u16cur);
+            u8cur += ascii;
+            u16cur += ascii;
+            continue;
+        }
+
+        size_t u8len = utf8_codepoint_len(*u8cur);
+        if (u8len > (size_t)(u8end - u8cur)) {
+            // Truncated input; utf8_to_utf16_length() rejects this.
+            break;
+        }
+        uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
+
+        // Convert the UTF32 codepoint to one or more UTF16 codepoints
+        if (codepoint <= 0xFFFF) {
+            // Single UTF16 character
+            *u16cur++ = (char16_t) codepoint;
+        } else {
+            // Multiple UTF16 characters with surrogates
+            codepoint = codepoint - 0x10000;
+            *u16cur++ = (char16_t) ((codepoint >> 10) + 0xD800);
+            *u16cur++ = (char16_t) ((codepoint & 0x3FF) + 0xDC00);
+        }
+
+        u8cur += u8len;
+    }
+    return u16cur;
+}
+
+void utf8_to_utf16(const uint8_t* u8str, size_t u8len, char16_t* u16str)
+{
+    char16_t* end = utf8_to_utf16_no_null_terminator(u8str, u8len, u16str);
+    *end = 0;
+}
+
+// --------------------------------------------------------------------------
+// Single-pass validating conversions
+// --------------------------------------------------------------------------
+
+/**
+ * Decodes one well-formed UTF-8 sequence at "cur" into "codepoint".
+ * Returns the length of the sequence, or 0 if it is malformed or runs
+ * past "end".
+ */
+static inline size_t
+utf8_decode_strict(const uint8_t* cur, const uint8_t* end, uint32_t* codepoint)
+{
+    const uint8_t c0 = cur[0];
+    const size_t avail = end - cur;
+    if (c0 < 0x80) {
+        *codepoint = c0;
+        return 1;
+    }
+    if (c0 < 0xC2) {
+        // Continuation byte or overlong two byte form.
+        return 0;
+    }
+    if (c0 < 0xE0) {
+        if (avail < 2 || (cur[1] & 0xC0) != 0x80) {
+            return 0;
+        }
+        *codepoint = ((c0 & 0x1F) << 6) | (cur[1] & 0x3F);
+        return 2;
+    }
+    if (c0 < 0xF0) {
+        if (avail < 3 || (cur[1] & 0xC0) != 0x80 || (cur[2] & 0xC0) != 0x80) {
+            return 0;
+        }
+        if ((c0 == 0xE0 && cur[1] < 0xA0) ||    // overlong
+            (c0 == 0xED && cur[1] > 0x9F)) {    // surrogate
+            return 0;
+        }
+        *codepoint = ((c0 & 0x0F) << 12) | ((cur[1] & 0x3F) << 6) | (cur[2] & 0x3F);
+        return 3;
+    }
+    if (c0 < 0xF5) {
+        if (avail < 4 || (cur[1] & 0xC0) != 0x80 || (cur[2] & 0xC0) != 0x80
+                || (cur[3] & 0xC0) != 0x80) {
+            return 0;
+        }
+        if ((c0 == 0xF0 && cur[1] < 0x90) ||    // overlong
+            (c0 == 0xF4 && cur[1] > 0x8F)) {    // above 0x10FFFF
+            return 0;
+        }
+        *codepoint = ((c0 & 0x07) << 18) | ((cur[1] & 0x3F) << 12)
+                | ((cur[2] & 0x3F) << 6) | (cur[3] & 0x3F);
+        return 4;
+    }
+    return 0;
+}
+
+static inline ssize_t
+unicode_error(ssize_t err, size_t pos, size_t* error_pos)
+{
+    if (error_pos) {
+        *error_pos = pos;
+    }
+    return err;
+}
+
+ssize_t utf8_validate(const uint8_t* src, size_t src_len, size_t* error_pos)
+{
+    const uint8_t* const end = src + src_len;
+    const uint8_t* cur = src;
+    size_t u16len = 0;
+
+    while (cur < end) {
+        if (!(*cur & 0x80)) {
+            size_t ascii = ascii_prefix_length(cur, end - cur);
+            u16len += ascii;
+            cur += ascii;
+            continue;
+        }
+
+        uint32_t codepoint;
+        size_t len = utf8_decode_strict(cur, end, &codepoint);
+        if (!len) {
+            return unicode_error(kUnicodeInvalidInput, cur - src, error_pos);
+        }
+        u16len += codepoint > 0xFFFF ? 2 : 1;
+        cur += len;
+    }
+    return u16len;
+}
+
+ssize_t utf8_to_utf16_bounded(const uint8_t* src, size_t src_len,
+                              char16_t* dst, size_t dst_len, size_t* error_pos)
+{
+    const uint8_t* const end = src + src_len;
+    const uint8_t* cur = src;
+    char16_t* out = dst;
+    char16_t* const out_end = dst + dst_len;
+
+    while (cur < end) {
+        if (!(*cur & 0x80)) {
+            size_t ascii = ascii_prefix_length(cur, end - cur);
+            size_t room = out_end - out;
+            if (ascii > room) {
+                widen_ascii(cur, room, out);
+                return unicode_error(kUnicodeBufferTooSmall,
+                                     cur + room - src, error_pos);
+            }
+            widen_ascii(cur, ascii, out);
+            cur += ascii;
+            out += ascii;
+            continue;
+        }
+
+        uint32_t codepoint;
+        size_t len = utf8_decode_strict(cur, end, &codepoint);
+        if (!len) {
+            return unicode_error(kUnicodeInvalidInput, cur - src, error_pos);
+        }
+        if (codepoint <= 0xFFFF) {
+            if (out == out_end) {
+                return unicode_error(kUnicodeBufferTooSmall, cur - src, error_pos);
+            }
+            *out++ = (char16_t) codepoint;
+        } else {
+            if (out_end - out < 2) {
+                return unicode_error(kUnicodeBufferTooSmall, cur - src, error_pos);
+            }
+            codepoint -= 0x10000;
+            *out++ = (char16_t) ((codepoint >> 10) + 0xD800);
+            *out++ = (char16_t) ((codepoint & 0x3FF) + 0xDC00);
+        }
+        cur += len;
+    }
+    return out - dst;
+}
+
+ssize_t utf16_to_utf8_bounded(const char16_t* src, size_t src_len,
+                              char* dst, size_t dst_len, size_t* error_pos)
+{
+    const char16_t* const end = src + src_len;
+    const char16_t* cur = src;
+    char* out = dst;
+    char* const out_end = dst + dst_len;
+
+    while (cur < end) {
+        if (*cur < 0x80) {
+            size_t ascii = utf16_ascii_prefix_length(cur, end - cur);
+            size_t room = out_end - out;
+            if (ascii > room) {
+                narrow_ascii(cur, room, out);
+                return unicode_error(kUnicodeBufferTooSmall,
+                                     cur + room - src, error_pos);
+            }
+            narrow_ascii(cur, ascii, out);
+            cur += ascii;
+            out += ascii;
+            continue;
+        }
+
+        char32_t utf32 = *cur;
+        size_t units = 1;
+        if ((utf32 & 0xF800) == 0xD800) {
+            if ((utf32 & 0xFC00) != 0xD800 || cur + 1 == end
+                    || (cur[1] & 0xFC00) != 0xDC00) {
+                return unicode_error(kUnicodeInvalidInput, cur - src, error_pos);
+            }
+            utf32 = ((utf32 - 0xD800) << 10) + (cur[1] - 0xDC00) + 0x10000;
+            units = 2;
+        }
+        const size_t len = utf32_codepoint_utf8_length(utf32);
+        if ((size_t)(out_end - out) < len) {
+            return unicode_error(kUnicodeBufferTooSmall, cur - src, error_pos);
+        }
+        utf32_codepoint_to_utf8((uint8_t*)out, utf32, len);
+        out += len;
+        cur += units;
+    }
+    return out - dst;
+}
+
+} // namespace gonk
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Utf8Index.h"
+#include "GonkUnicode.h"
+
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UTF8_INDEX_NEON 1
+#endif
+
+static inline bool
+is_lead_byte(uint8_t ch)
+{
+    return (ch & 0xC0) != 0x80;
+}
+
+/**
+ * Returns the number of code points starting in the 16 bytes at "src".
+ */
+static inline size_t
+count_lead_bytes16(const uint8_t* src)
+{
+#if defined(__SSE2__)
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*) src), _mm_set1_epi8((char) 0xC0));
+    __m128i cont = _mm_cmpeq_epi8(v, _mm_set1_epi8((char) 0x80));
+    return 16 - __builtin_popcount(_mm_movemask_epi8(cont));
+#elif defined(UTF8_INDEX_NEON)
+    uint8x16_t v = vandq_u8(vld1q_u8(src), vdupq_n_u8(0xC0));
+    uint8x16_t cont = vshrq_n_u8(vceqq_u8(v, vdupq_n_u8(0x80)), 7);
+    uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(cont)));
+    return 16 - (size_t) (vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#else
+    size_t n = 0;
+    for (size_t i = 0; i < 16; i++) {
+        n += is_lead_byte(src[i]);
+    }
+    return n;
+#endif
+}
+
+/**
+ * Returns the byte offset "n" code points after "offset", or "len" if the
+ * string ends first.
+ */
+static size_t
+skip_codepoints(const uint8_t* src, size_t len, size_t offset, size_t n)
+{
+    while (n && offset < len) {
+        offset++;
+        while (offset < len && !is_lead_byte(src[offset])) {
+            offset++;
+        }
+        n--;
+    }
+    return offset;
+}
+
+static int
+utf8_index_build(utf8_index* index)
+{
+    if (index->offsets) {
+        return 0;
+    }
+
+    const uint8_t* src = (const uint8_t*) index->src;
+    const size_t len = index->src_len;
+    const size_t stride = index->stride;
+
+    // There can't be more code points than bytes.
+    size_t* offsets = (size_t*) malloc((len / stride + 1) * sizeof(size_t));
+    if (!offsets) {
+        return -1;
+    }
+
+    size_t cp = 0;
+    size_t next_sample = 0;
+    size_t k = 0;
+    size_t i = 0;
+    while (i < len) {
+        // Skip whole blocks that don't contain the next sample.
+        if (i + 16 <= len) {
+            size_t n = count_lead_bytes16(src + i);
+            if (cp + n <= next_sample) {
+                cp += n;
+                i += 16;
+                continue;
+            }
+        }
+        size_t end = i + 16 < len ? i + 16 : len;
+        for (; i < end; i++) {
+            if (!is_lead_byte(src[i])) {
+                continue;
+            }
+            if (cp == next_sample) {
+                offsets[k++] = i;
+                next_sample += stride;
+            }
+            cp++;
+        }
+    }
+    if (cp == next_sample) {
+        // Lets utf8_index_offset() return the end of the string.
+        offsets[k++] = len;
+    }
+
+    size_t* shrunk = (size_t*) realloc(offsets, k * sizeof(size_t));
+    index->offsets = shrunk ? shrunk : offsets;
+    index->length = cp;
+    return 0;
+}
+
+void utf8_index_init(utf8_index* index, const char* src, size_t src_len, size_t stride)
+{
+    index->src = src;
+    index->src_len = src_len;
+    index->stride = stride ? stride : UTF8_INDEX_DEFAULT_STRIDE;
+    index->length = 0;
+    index->offsets = NULL;
+}
+
+void utf8_index_release(utf8_index* index)
+{
+    free(index->offsets);
+    index->offsets = NULL;
+    index->length = 0;
+}
+
+ssize_t utf8_index_length(utf8_index* index)
+{
+    if (utf8_index_build(index) < 0) {
+        return -1;
+    }
+    return index->length;
+}
+
+ssize_t utf8_index_offset(utf8_index* index, size_t cp_index)
+{
+    if (utf8_index_build(index) < 0 || cp_index > index->length) {
+        return -1;
+    }
+    size_t offset = index->offsets[cp_index / index->stride];
+    return skip_codepoints((const uint8_t*) index->src, index->src_len,
+                           offset, cp_index % index->stride);
+}
+
+void utf8_cursor_init(utf8_cursor* cursor, utf8_index* index)
+{
+    cursor->index = index;
+    cursor->offset = 0;
+    cursor->cp_index = 0;
+}
+
+int utf8_cursor_seek(utf8_cursor* cursor, size_t cp_index)
+{
+    utf8_index* index = cursor->index;
+    ssize_t offset;
+    if (cp_index >= cursor->cp_index && cp_index - cursor->cp_index < index->stride) {
+        size_t n = cp_index - cursor->cp_index;
+        if (!index->offsets) {
+            // Not worth building the table for; just make sure we don't
+            // run off the end.
+            const uint8_t* src = (const uint8_t*) index->src;
+            size_t off = cursor->offset;
+            while (n && off < index->src_len) {
+                off = skip_codepoints(src, index->src_len, off, 1);
+                n--;
+            }
+            if (n) {
+                return -1;
+            }
+            offset = off;
+        } else if (cp_index > index->length) {
+            return -1;
+        } else {
+            offset = skip_codepoints((const uint8_t*) index->src, index->src_len,
+                                     cursor->offset, n);
+        }
+    } else {
+        offset = utf8_index_offset(index, cp_index);
+        if (offset < 0) {
+            return -1;
+        }
+    }
+    cursor->offset = offset;
+    cursor->cp_index = cp_index;
+    return 0;
+}
+
+int32_t utf8_cursor_next(utf8_cursor* cursor)
+{
+    const utf8_index* index = cursor->index;
+    size_t next;
+    int32_t ch = gonk::utf32_from_utf8_at(index->src, index->src_len, cursor->offset, &next);
+    if (ch < 0) {
+        return -1;
+    }
+    cursor->offset = next;
+    cursor->cp_index++;
+    return ch;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GONK_UTF8_INDEX_H
+#define GONK_UTF8_INDEX_H
+
+#include "Unicode.h"
+
+extern "C" {
+
+/**
+ * Random access by code point into a UTF-8 string.
+ *
+ * utf32_from_utf8_at() takes a byte index, so finding the n-th code point
+ * means scanning from the start of the string every time.  A utf8_index
+ * remembers the byte offset of every "stride"-th code point, which is
+ * enough to seek anywhere by scanning at most "stride" - 1 code points.
+ * The table is built on first use, in a single pass over the string.
+ *
+ * The string must be valid UTF-8 (see utf8_length) and must outlive the
+ * index; it isn't copied.
+ */
+
+#define UTF8_INDEX_DEFAULT_STRIDE 64
+
+typedef struct utf8_index {
+    const char* src;
+    size_t src_len;
+    size_t stride;
+    size_t length;          // in code points, once built
+    size_t* offsets;        // offsets[k] is the byte offset of code point k * stride
+} utf8_index;
+
+/**
+ * Sets up "index" over "src". A "stride" of 0 means
+ * UTF8_INDEX_DEFAULT_STRIDE. Doesn't allocate.
+ */
+void utf8_index_init(utf8_index* index, const char* src, size_t src_len, size_t stride);
+
+/**
+ * Frees the table built for "index".
+ */
+void utf8_index_release(utf8_index* index);
+
+/**
+ * Returns the number of code points in the string, or -1 if the table
+ * couldn't be allocated.
+ */
+ssize_t utf8_index_length(utf8_index* index);
+
+/**
+ * Returns the byte offset of code point "cp_index". Passing the length of
+ * the string returns "src_len". Returns -1 if "cp_index" is out of range or
+ * the table couldn't be allocated.
+ */
+ssize_t utf8_index_offset(utf8_index* index, size_t cp_index);
+
+/**
+ * A position in an indexed string, for walking it forwards and seeking.
+ */
+typedef struct utf8_cursor {
+    utf8_index* index;
+    size_t offset;          // in bytes
+    size_t cp_index;        // in code points
+} utf8_cursor;
+
+/**
+ * Places "cursor" at the start of the string indexed by "index".
+ */
+void utf8_cursor_init(utf8_cursor* cursor, utf8_index* index);
+
+/**
+ * Moves "cursor" to code point "cp_index". Short forward moves scan from
+ * the current position; anything else goes through the table.
+ * Returns 0, or -1 (leaving the cursor alone) if "cp_index" is out of
+ * range.
+ */
+int utf8_cursor_seek(utf8_cursor* cursor, size_t cp_index);
+
+/**
+ * Returns the code point at "cursor" and advances past it, or -1 at the
+ * end of the string.
+ */
+int32_t utf8_cursor_next(utf8_cursor* cursor);
+
+}
+
+#endif
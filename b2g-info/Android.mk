@@ -14,12 +14,29 @@
 
 LOCAL_PATH:= $(call my-dir)
 
+b2g_info_src_files := b2g-info.cpp process.cpp processlist.cpp table.cpp utils.cpp \
+                      benchmark.cpp capture.cpp fssource.cpp sharedbuffers.cpp \
+                      workingset.cpp daemon.cpp sample.cpp samplering.cpp \
+                      timeseries.cpp
+
 include $(CLEAR_VARS)
 include external/stlport/libstlport.mk
 LOCAL_MODULE       := b2g-info
 LOCAL_MODULE_TAGS  := optional
 LOCAL_MODULE_CLASS := EXECUTABLES
-LOCAL_SRC_FILES    := b2g-info.cpp process.cpp processlist.cpp table.cpp utils.cpp
+LOCAL_SRC_FILES    := $(b2g_info_src_files)
 LOCAL_FORCE_STATIC_EXECUTABLE := false
 LOCAL_SHARED_LIBRARIES := libstlport
+LOCAL_STATIC_LIBRARIES := libgonkunicode
+LOCAL_C_INCLUDES   += $(LOCAL_PATH)/..
 include $(BUILD_EXECUTABLE)
+
+# A host build, for running against captures (b2g-info --capture) and
+# synthetic /proc trees (benchmark.py) on a workstation.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := b2g-info
+LOCAL_MODULE_TAGS  := optional
+LOCAL_SRC_FILES    := $(b2g_info_src_files)
+LOCAL_STATIC_LIBRARIES := libgonkunicode
+LOCAL_C_INCLUDES   := $(LOCAL_PATH)/..
+include $(BUILD_HOST_EXECUTABLE)
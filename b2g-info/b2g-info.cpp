@@ -31,13 +31,30 @@
 #endif
 
 #include "table.h"
+#include "benchmark.h"
+#include "capture.h"
+#include "daemon.h"
+#include "fssource.h"
 #include "process.h"
 #include "processlist.h"
+#include "sample.h"
+#include "timeseries.h"
 #include "utils.h"
+#include "workingset.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <map>
+#include <set>
 #include <string>
 #include <sstream>
 
@@ -48,6 +65,11 @@ using namespace std;
  */
 static const char* cmd_name;
 
+/**
+ * When we started, for --self-stats.
+ */
+static struct timespec start_time;
+
 /**
  * Prints the pids of B2G processes.
  */
@@ -74,72 +96,131 @@ print_b2g_pids(bool main_process_only, bool child_processes_only)
 string
 read_whole_file(const char* filename)
 {
-  char buf[1024];
-  int fd = TEMP_FAILURE_RETRY(open(filename, O_RDONLY));
-  if (fd == -1) {
-    return "";
+  string contents;
+  FsSource::current().read_file(filename, contents);
+  return contents;
+}
+
+/**
+ * Totals over all of /sys/block/zram*, in bytes.
+ */
+struct ZramStats
+{
+  ZramStats()
+    : num_devices(0)
+    , disksize(0)
+    , orig_data_size(0)
+    , compr_data_size(0)
+    , mem_used_total(0)
+  {}
+
+  int num_devices;
+  long long disksize;
+  long long orig_data_size;
+  long long compr_data_size;
+  long long mem_used_total;
+};
+
+long long
+read_ll_file(const string& filename)
+{
+  return strtoll(read_whole_file(filename.c_str()).c_str(), NULL, 10);
+}
+
+/**
+ * Sum the stats of every zram device into |stats|.  Returns false if there
+ * are no zram devices.
+ *
+ * Kernels since 4.1 have all the stats in one mm_stat file; older ones have
+ * a file per stat.
+ */
+bool
+read_zram_stats(ZramStats& stats)
+{
+  vector<string> names;
+  if (!FsSource::current().list_dir("/sys/block", names)) {
+    return false;
   }
 
-  ssize_t total_read = 0;
-  ssize_t num_remaining = sizeof(buf) - 1;
-  while (true) {
-    // No more room in the buffer; we're done.
-    if (num_remaining <= 0) {
-      break;
+  for (vector<string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+    if (it->compare(0, 4, "zram")) {
+      continue;
     }
 
-    ssize_t nread = TEMP_FAILURE_RETRY(read(fd, buf + total_read, num_remaining));
-    if (nread == 0 || nread == -1) {
-      break;
+    string dev_dir = "/sys/block/" + *it + "/";
+    long long disksize = read_ll_file(dev_dir + "disksize");
+    if (disksize <= 0) {
+      // Not set up as a swap device.
+      continue;
     }
-
-    num_remaining -= nread;
-    total_read += nread;
+    stats.num_devices++;
+    stats.disksize += disksize;
+
+    long long orig = 0, compr = 0, used = 0;
+    string mm_stat = read_whole_file((dev_dir + "mm_stat").c_str());
+    if (sscanf(mm_stat.c_str(), "%lld %lld %lld", &orig, &compr, &used) != 3) {
+      orig = read_ll_file(dev_dir + "orig_data_size");
+      compr = read_ll_file(dev_dir + "compr_data_size");
+      used = read_ll_file(dev_dir + "mem_used_total");
+    }
+    stats.orig_data_size += orig;
+    stats.compr_data_size += compr;
+    stats.mem_used_total += used;
   }
 
-  buf[total_read] = '\0';
-  return buf;
+  return stats.num_devices > 0;
 }
 
-void print_system_meminfo()
+void print_zram_stats(const ZramStats& zram)
 {
-  // We can't use sysinfo() here because iit doesn't tell us how much cached
-  // memory we're using.  (On B2G, this is often upwards of 30mb.)
-  //
-  // Instead, we have to parse /proc/meminfo.
-
-  FILE* meminfo = fopen("/proc/meminfo", "r");
-  if (!meminfo) {
-    perror("Couldn't open /proc/meminfo");
-    return;
-  }
+  printf("zram (%d device%s):\n\n", zram.num_devices, zram.num_devices == 1 ? "" : "s");
 
-  // These are all in kb.
-  int total = -1;
-  int free = -1;
-  int buffers = -1;
-  int cached = -1;
+  Table t;
 
-  char line[256];
-  while(fgets(line, sizeof(line), meminfo)) {
-    if (sscanf(line, "MemTotal: %d kB", &total) == 0 &&
-        sscanf(line, "MemFree: %d kB", &free) == 0 &&
-        sscanf(line, "Buffers: %d kB", &buffers) == 0 &&
-        sscanf(line, "Cached: %d kB", &cached)) {
-      // These four values should appear first in meminfo, so if this line
-      // doesn't match any of them, we're done parsing.
-      break;
-    }
+  t.start_row();
+  t.add("Disk size");
+  t.add_fmt("%0.1f MB", zram.disksize / (1024.0 * 1024.0));
+
+  t.start_row();
+  t.add("Original data");
+  t.add_fmt("%0.1f MB", zram.orig_data_size / (1024.0 * 1024.0));
+
+  t.start_row();
+  t.add("Compressed data");
+  t.add_fmt("%0.1f MB", zram.compr_data_size / (1024.0 * 1024.0));
+
+  t.start_row();
+  t.add("Memory used");
+  t.add_fmt("%0.1f MB", zram.mem_used_total / (1024.0 * 1024.0));
+
+  t.start_row();
+  t.add("Compression ratio");
+  if (zram.compr_data_size) {
+    t.add_fmt("%0.2f", (double) zram.orig_data_size / zram.compr_data_size);
+  } else {
+    t.add("-");
   }
 
-  fclose(meminfo);
+  t.print_with_indent(2);
+}
 
-  if (total == -1 || free == -1 || buffers == -1 || cached == -1) {
-    fprintf(stderr, "Unable to parse /proc/meminfo.\n");
+void print_system_meminfo()
+{
+  SystemMeminfo meminfo;
+  if (!read_system_meminfo(meminfo)) {
     return;
   }
 
-  int actually_used = total - free - buffers - cached;
+  // These are all in kb.
+  int total = meminfo.total_kb;
+  int free = meminfo.free_kb;
+  int buffers = meminfo.buffers_kb;
+  int cached = meminfo.cached_kb;
+  int swap_total = meminfo.swap_total_kb;
+  int swap_free = meminfo.swap_free_kb;
+
+  ZramStats zram;
+  bool have_zram = read_zram_stats(zram);
 
   puts("System memory info:\n");
 
@@ -157,15 +238,26 @@ void print_system_meminfo()
   t.add("B2G procs (PSS)");
 
   int b2g_mem_kb = 0;
+  int b2g_swap_pss_kb = 0;
   for (vector<Process*>::const_iterator it = ProcessList::singleton().b2g_processes().begin();
        it != ProcessList::singleton().b2g_processes().end(); ++it) {
     b2g_mem_kb += (*it)->pss_kb();
+    b2g_swap_pss_kb += max((*it)->swap_pss_kb(), 0);
   }
   t.add_fmt("%0.1f MB", b2g_mem_kb / 1024.0);
 
+  // zram's compressed pages count as used memory, but they don't belong to
+  // any process's PSS.
+  int zram_used_kb = have_zram ? (int)(zram.mem_used_total / 1024) : 0;
+  if (have_zram) {
+    t.start_row();
+    t.add("zram");
+    t.add_fmt("%0.1f MB", kb_to_mb(zram_used_kb));
+  }
+
   t.start_row();
   t.add("Non-B2G procs");
-  t.add_fmt("%0.1f MB", kb_to_mb(total - free - buffers - cached - b2g_mem_kb));
+  t.add_fmt("%0.1f MB", kb_to_mb(total - free - buffers - cached - b2g_mem_kb - zram_used_kb));
 
   t.start_row();
   t.add("Free + cache");
@@ -179,7 +271,26 @@ void print_system_meminfo()
   t.add("Cache");
   t.add_fmt("%0.1f MB", kb_to_mb(buffers + cached));
 
+  if (swap_total > 0) {
+    t.start_row();
+    t.add("Swap total");
+    t.add_fmt("%0.1f MB", kb_to_mb(swap_total));
+
+    t.start_row();
+    t.add("Swap used");
+    t.add_fmt("%0.1f MB", kb_to_mb(swap_total - max(swap_free, 0)));
+
+    t.start_row();
+    t.add("B2G procs (SwapPss)");
+    t.add_fmt("%0.1f MB", kb_to_mb(b2g_swap_pss_kb));
+  }
+
   t.print_with_indent(2);
+
+  if (have_zram) {
+    putchar('\n');
+    print_zram_stats(zram);
+  }
 }
 
 void print_lmk_params()
@@ -235,34 +346,215 @@ void print_lmk_params()
 #undef LMK_DIR
 }
 
+static long long
+monotonic_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Works out rates for --watch from tasks' counters on this pass and the last
+ * one: page faults and storage I/O (--rates), and scheduling (--sched).
+ */
+class RateTracker
+{
+public:
+  RateTracker(bool io, bool sched)
+    : m_io(io)
+    , m_sched(sched)
+    , m_prev_ns(0)
+    , m_cur_ns(monotonic_ns())
+  {}
+
+  /**
+   * Start a new pass; what we recorded on this one becomes what we compare
+   * against.
+   */
+  void next_pass()
+  {
+    m_prev.swap(m_cur);
+    m_cur.clear();
+    m_prev_ns = m_cur_ns;
+    m_cur_ns = monotonic_ns();
+  }
+
+  void add_headers(Table& t)
+  {
+    if (m_io) {
+      t.add("MINFLT/S");
+      t.add("MAJFLT/S");
+      t.add("RD_KB/S");
+      t.add("WR_KB/S");
+    }
+    if (m_sched) {
+      t.add("CPU%");
+      t.add("RUNQ_MS");
+      t.add("VCSW/S");
+      t.add("NVCSW/S");
+    }
+  }
+
+  /**
+   * Record |task|'s counters, and add its rates since the last pass to |t|.
+   * Tasks which are new since the last pass get "-", and counters we
+   * couldn't read get "?".
+   */
+  void add_rates(Table& t, Task* task)
+  {
+    Counters& c = m_cur[task->task_id()];
+    c.start_time = task->start_time();
+    if (m_io) {
+      c.values[MINFLT] = task->minflt();
+      c.values[MAJFLT] = task->majflt();
+      c.values[READ_BYTES] = task->read_bytes();
+      c.values[WRITE_BYTES] = task->write_bytes();
+    }
+    if (m_sched) {
+      c.values[RUN_NS] = task->run_ns();
+      c.values[RUNQUEUE_NS] = task->runqueue_ns();
+      c.values[TIMESLICES] = task->timeslices();
+      c.values[VOLUNTARY_SWITCHES] = task->voluntary_switches();
+      c.values[INVOLUNTARY_SWITCHES] = task->involuntary_switches();
+    }
+
+    map<pid_t, Counters>::const_iterator it = m_prev.find(task->task_id());
+    const Counters* prev = NULL;
+    if (it != m_prev.end() && it->second.start_time == c.start_time) {
+      prev = &it->second;
+    }
+
+    double secs = (m_cur_ns - m_prev_ns) / 1e9;
+    if (m_io) {
+      add_rate(t, c, prev, MINFLT, 1 / secs);
+      add_rate(t, c, prev, MAJFLT, 1 / secs);
+      add_rate(t, c, prev, READ_BYTES, 1 / secs / 1024);
+      add_rate(t, c, prev, WRITE_BYTES, 1 / secs / 1024);
+    }
+    if (m_sched) {
+      add_rate(t, c, prev, RUN_NS, 100 / (secs * 1e9));
+
+      // The average wait between becoming runnable and running.
+      long long slices = prev ? delta(c, *prev, TIMESLICES) : -1;
+      if (!prev) {
+        t.add("-");
+      } else if (slices < 0 || delta(c, *prev, RUNQUEUE_NS) < 0) {
+        t.add("?");
+      } else if (slices == 0) {
+        t.add("0.00");
+      } else {
+        t.add_fmt("%0.2f", delta(c, *prev, RUNQUEUE_NS) / 1e6 / slices);
+      }
+
+      add_rate(t, c, prev, VOLUNTARY_SWITCHES, 1 / secs);
+      add_rate(t, c, prev, INVOLUNTARY_SWITCHES, 1 / secs);
+    }
+  }
+
+private:
+  enum {
+    MINFLT,
+    MAJFLT,
+    READ_BYTES,
+    WRITE_BYTES,
+    RUN_NS,
+    RUNQUEUE_NS,
+    TIMESLICES,
+    VOLUNTARY_SWITCHES,
+    INVOLUNTARY_SWITCHES,
+    NUM_COUNTERS
+  };
+
+  struct Counters
+  {
+    unsigned long long start_time;
+    long long values[NUM_COUNTERS];
+  };
+
+  /**
+   * How much counter |i| went up since |prev|, or -1 if we couldn't read it
+   * either time.
+   */
+  static long long delta(const Counters& cur, const Counters& prev, int i)
+  {
+    if (cur.values[i] < 0 || prev.values[i] < 0) {
+      return -1;
+    }
+    return cur.values[i] - prev.values[i];
+  }
+
+  static void add_rate(Table& t, const Counters& cur, const Counters* prev,
+                       int i, double scale)
+  {
+    if (!prev) {
+      t.add("-");
+    } else if (delta(cur, *prev, i) < 0) {
+      t.add("?");
+    } else {
+      t.add_fmt("%0.1f", delta(cur, *prev, i) * scale);
+    }
+  }
+
+  bool m_io;
+  bool m_sched;
+  map<pid_t, Counters> m_prev;
+  map<pid_t, Counters> m_cur;
+  long long m_prev_ns;
+  long long m_cur_ns;
+};
+
+/**
+ * The columns after NAME, PID/TID and NICE which only processes' rows fill
+ * in; threads' rows leave them empty.
+ */
+static const struct {
+  const char* name;
+  Table::Alignment align;
+} process_only_columns[] = {
+  {"USS", Table::ALIGN_RIGHT},
+  {"PSS", Table::ALIGN_RIGHT},
+  {"RSS", Table::ALIGN_RIGHT},
+  {"VSIZE", Table::ALIGN_RIGHT},
+  {"SWAP", Table::ALIGN_RIGHT},
+  {"SWAP_PSS", Table::ALIGN_RIGHT},
+  {"OOM_ADJ", Table::ALIGN_RIGHT},
+  {"USER", Table::ALIGN_LEFT}
+};
+
+static const size_t num_process_only_columns =
+  sizeof(process_only_columns) / sizeof(process_only_columns[0]);
+
 void
-b2g_ps_add_table_headers(Table& t, bool show_threads)
+b2g_ps_add_table_headers(Table& t, bool show_threads, RateTracker* rates)
 {
   t.start_row();
   t.add("NAME");
   t.add(show_threads ? "TID" : "PID");
   t.add("NICE");
-  t.add("USS");
-  t.add("PSS");
-  t.add("RSS");
-  t.add("VSIZE");
-  t.add("OOM_ADJ");
-  t.add("USER", Table::ALIGN_LEFT);
+  for (size_t i = 0; i < num_process_only_columns; i++) {
+    t.add(process_only_columns[i].name, process_only_columns[i].align);
+  }
+  if (rates) {
+    rates->add_headers(t);
+  }
 }
 
-int
-print_b2g_info(bool show_threads)
+/**
+ * Fills |t| with the B2G processes (and their threads, if |show_threads|).
+ * If |rates| isn't NULL, each task gets its columns too.
+ */
+void
+build_b2g_table(Table& t, bool show_threads, RateTracker* rates = NULL)
 {
   // TODO: switch between kb and mb for RSS etc.
   // TODO: Sort processes?
 
-  Table t;
-
-  // This sits atop USS/PSS/RSS/VSIZE.
-  t.multi_col_header("megabytes", 3, 7);
+  // This sits atop USS/PSS/RSS/VSIZE/SWAP/SWAP_PSS.
+  t.multi_col_header("megabytes", 3, 9);
 
   if (!show_threads) {
-    b2g_ps_add_table_headers(t, /* show_threads */ false);
+    b2g_ps_add_table_headers(t, /* show_threads */ false, rates);
   }
 
   for (vector<Process*>::const_iterator it =
@@ -270,7 +562,7 @@ print_b2g_info(bool show_threads)
        it != ProcessList::singleton().b2g_processes().end(); ++it) {
 
     if (show_threads) {
-      b2g_ps_add_table_headers(t, /* show_threads */ true);
+      b2g_ps_add_table_headers(t, /* show_threads */ true, rates);
     }
 
     Process* p = *it;
@@ -282,8 +574,17 @@ print_b2g_info(bool show_threads)
     t.add_fmt("%0.1f", p->pss_mb());
     t.add_fmt("%0.1f", p->rss_mb());
     t.add_fmt("%0.1f", p->vsize_mb());
+    t.add_fmt("%0.1f", p->swap_mb());
+    if (p->swap_pss_kb() >= 0) {
+      t.add_fmt("%0.1f", p->swap_pss_mb());
+    } else {
+      t.add("?");
+    }
     t.add(p->oom_adj());
     t.add(p->user(), Table::ALIGN_LEFT);
+    if (rates) {
+      rates->add_rates(t, p);
+    }
 
     if (show_threads) {
       for (vector<Thread*>::const_iterator thread_it =
@@ -295,6 +596,12 @@ print_b2g_info(bool show_threads)
         t.add(thread->name());
         t.add(thread->tid());
         t.add(thread->nice());
+        if (rates) {
+          for (size_t i = 0; i < num_process_only_columns; i++) {
+            t.add("");
+          }
+          rates->add_rates(t, thread);
+        }
       }
 
       if (it + 1 != ProcessList::singleton().b2g_processes().end()) {
@@ -302,7 +609,13 @@ print_b2g_info(bool show_threads)
       }
     }
   }
+}
 
+int
+print_b2g_info(bool show_threads)
+{
+  Table t;
+  build_b2g_table(t, show_threads);
   t.print();
   putchar('\n');
 
@@ -314,6 +627,623 @@ print_b2g_info(bool show_threads)
   return 0;
 }
 
+/**
+ * Prints the B2G process table every |seconds| until we're interrupted.  If
+ * |show_rates|, each task also gets its page fault and storage I/O rates
+ * over the last interval, and if |show_sched|, its CPU use, runqueue delay,
+ * and context switch rates.
+ */
+int
+print_watch(int seconds, bool show_threads, bool show_rates, bool show_sched)
+{
+  if (!FsSource::current().is_live()) {
+    fputs("--watch can't be used with --root.\n", stderr);
+    return 1;
+  }
+
+  ProcessList& list = ProcessList::singleton();
+  RateTracker rates(show_rates, show_sched);
+  bool any_rates = show_rates || show_sched;
+
+  // Take the counters to compare the first table against.
+  if (any_rates && list.main_process_if_running()) {
+    Table t;
+    build_b2g_table(t, show_threads, &rates);
+  }
+
+  while (true) {
+    sleep(seconds);
+    list.refresh();
+    rates.next_pass();
+
+    time_t now = time(NULL);
+    char time_str[32];
+    strftime(time_str, sizeof(time_str), "%H:%M:%S", localtime(&now));
+    printf("%s\n\n", time_str);
+
+    if (list.main_process_if_running()) {
+      Table t;
+      build_b2g_table(t, show_threads, any_rates ? &rates : NULL);
+      t.print();
+    } else {
+      puts("B2G isn't running.");
+    }
+    putchar('\n');
+    fflush(stdout);
+  }
+}
+
+/**
+ * Prints memory usage of every process whose executable is one of |exes|,
+ * followed by their total.  This is handy for checking what system daemons
+ * (e.g. /system/bin/fakeservices) cost.
+ */
+int
+print_exe_info(const vector<string>& exes)
+{
+  Table t;
+  t.multi_col_header("megabytes", 3, 6);
+
+  t.start_row();
+  t.add("NAME");
+  t.add("PID");
+  t.add("EXE", Table::ALIGN_LEFT);
+  t.add("USS");
+  t.add("PSS");
+  t.add("RSS");
+
+  int num_found = 0;
+  int total_uss_kb = 0;
+  int total_pss_kb = 0;
+  int total_rss_kb = 0;
+
+  for (vector<Process*>::const_iterator it =
+         ProcessList::singleton().all_processes().begin();
+       it != ProcessList::singleton().all_processes().end(); ++it) {
+    Process* p = *it;
+    if (find(exes.begin(), exes.end(), p->exe()) == exes.end()) {
+      continue;
+    }
+
+    t.start_row();
+    t.add(p->name());
+    t.add(p->pid());
+    t.add(p->exe(), Table::ALIGN_LEFT);
+    t.add_fmt("%0.1f", p->uss_mb());
+    t.add_fmt("%0.1f", p->pss_mb());
+    t.add_fmt("%0.1f", p->rss_mb());
+
+    num_found++;
+    total_uss_kb += p->uss_kb();
+    total_pss_kb += p->pss_kb();
+    total_rss_kb += p->rss_kb();
+  }
+
+  if (!num_found) {
+    fputs("No matching processes.\n", stderr);
+    return 1;
+  }
+
+  t.add_delimiter();
+  t.start_row();
+  t.add("total");
+  t.add(num_found);
+  t.add("");
+  t.add_fmt("%0.1f", kb_to_mb(total_uss_kb));
+  t.add_fmt("%0.1f", kb_to_mb(total_pss_kb));
+  t.add_fmt("%0.1f", kb_to_mb(total_rss_kb));
+
+  t.print();
+  return 0;
+}
+
+/**
+ * Collects what print_b2g_info() shows, one kind of file at a time, and
+ * prints what each step cost instead of the results.  Run against a
+ * synthetic /proc (see benchmark.py) with --root to compare changes to the
+ * parsers.
+ */
+int
+print_benchmark()
+{
+  BenchmarkTable bench;
+  ProcessList& list = ProcessList::singleton();
+
+  // Finding the B2G processes reads every process's exe.
+  const vector<Process*>& processes = list.b2g_processes();
+  bench.end_phase("discovery");
+
+  for (size_t i = 0; i < processes.size(); i++) {
+    processes[i]->name();
+    const vector<Thread*>& threads = processes[i]->threads();
+    for (size_t j = 0; j < threads.size(); j++) {
+      threads[j]->name();
+    }
+  }
+  bench.end_phase("stat");
+
+  for (size_t i = 0; i < processes.size(); i++) {
+    processes[i]->pss_kb();
+  }
+  bench.end_phase("smaps");
+
+  for (size_t i = 0; i < processes.size(); i++) {
+    processes[i]->oom_adj();
+    processes[i]->user();
+  }
+  bench.end_phase("oom/user");
+
+  // Everything but oom_adj is cached by now, so this is mostly building and
+  // formatting the table.  Send it to /dev/null rather than the terminal.
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  int dev_null = open("/dev/null", O_WRONLY);
+  dup2(dev_null, STDOUT_FILENO);
+  close(dev_null);
+  {
+    Table t;
+    build_b2g_table(t, /* show_threads */ true);
+    t.print();
+    fflush(stdout);
+  }
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+  bench.end_phase("render");
+
+  printf("%d processes, %d B2G processes\n\n",
+         (int) list.all_processes().size(), (int) processes.size());
+  bench.print();
+  return 0;
+}
+
+static double
+timeval_ms(const struct timeval& tv)
+{
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/**
+ * Prints the system calls we made while reading files, by the kind of file,
+ * and the CPU time we used.  Registered with atexit() for --self-stats, so
+ * that it follows whatever the mode printed.
+ */
+void
+print_self_stats()
+{
+  Table t;
+  t.start_row();
+  t.add("FILES", Table::ALIGN_LEFT);
+  t.add("OPENS");
+  t.add("READS");
+  t.add("KB_READ");
+  t.add("READLINKS");
+  t.add("DIRS");
+  t.add("STATS");
+  t.add("MS");
+
+  FsSource::Counters total = FsSource::total_counters();
+  for (int i = 0; i <= FsSource::NUM_CATEGORIES; i++) {
+    const FsSource::Counters* c = &total;
+    const char* name = "total";
+    if (i < FsSource::NUM_CATEGORIES) {
+      c = &FsSource::counters((FsSource::Category) i);
+      name = FsSource::category_name((FsSource::Category) i);
+    } else {
+      t.add_delimiter();
+    }
+
+    t.start_row();
+    t.add(name, Table::ALIGN_LEFT);
+    t.add_fmt("%lld", c->opens);
+    t.add_fmt("%lld", c->reads);
+    t.add_fmt("%lld", c->bytes_read / 1024);
+    t.add_fmt("%lld", c->readlinks);
+    t.add_fmt("%lld", c->dirs_listed);
+    t.add_fmt("%lld", c->stats);
+    t.add_fmt("%0.2f", c->ns / 1000000.0);
+  }
+
+  fflush(stdout);
+  putchar('\n');
+  t.print();
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double wall_ms = (now.tv_sec - start_time.tv_sec) * 1000.0 +
+                   (now.tv_nsec - start_time.tv_nsec) / 1000000.0;
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    printf("\n%0.2f ms elapsed, %0.2f ms user CPU, %0.2f ms system CPU.\n",
+           wall_ms, timeval_ms(usage.ru_utime), timeval_ms(usage.ru_stime));
+  } else {
+    printf("\n%0.2f ms elapsed.\n", wall_ms);
+  }
+}
+
+/**
+ * Sums up shared buffers by kind, counting each buffer we can identify only
+ * once however many processes hold it.
+ */
+class SharedBufferTotals
+{
+public:
+  SharedBufferTotals()
+  {
+    for (int i = 0; i < SharedBuffer::NUM_KINDS; i++) {
+      m_count[i] = 0;
+      m_bytes[i] = 0;
+    }
+  }
+
+  void add(const vector<SharedBuffer>& buffers)
+  {
+    for (size_t i = 0; i < buffers.size(); i++) {
+      const SharedBuffer& b = buffers[i];
+      if (b.inode && !m_seen.insert(make_pair((int) b.kind, b.inode)).second) {
+        continue;
+      }
+      m_count[b.kind]++;
+      m_bytes[b.kind] += b.size;
+    }
+  }
+
+  int count(SharedBuffer::Kind kind) const { return m_count[kind]; }
+  double mb(SharedBuffer::Kind kind) const { return m_bytes[kind] / (1024.0 * 1024.0); }
+
+private:
+  int m_count[SharedBuffer::NUM_KINDS];
+  long long m_bytes[SharedBuffer::NUM_KINDS];
+  set<pair<int, ino_t> > m_seen;
+};
+
+void
+add_shared_buffer_row(Table& t, const SharedBufferTotals& totals)
+{
+  t.add(totals.count(SharedBuffer::DMA_BUF));
+  t.add_fmt("%0.1f", totals.mb(SharedBuffer::DMA_BUF));
+  t.add_fmt("%0.1f", totals.mb(SharedBuffer::ASHMEM));
+  t.add_fmt("%0.1f", totals.mb(SharedBuffer::GRALLOC));
+}
+
+/**
+ * Prints the dma-buf, ashmem, and gralloc buffers each B2G process holds,
+ * followed by totals in which buffers shared between processes are counted
+ * once.  Where we can't tell buffers apart (gralloc device mappings, and
+ * dma-bufs on kernels before 4.11), they're counted once per process.
+ */
+int
+print_shared_buffers()
+{
+  Table t;
+  t.multi_col_header("megabytes", 3, 6);
+
+  t.start_row();
+  t.add("NAME");
+  t.add("PID");
+  t.add("DMABUFS");
+  t.add("DMABUF");
+  t.add("ASHMEM");
+  t.add("GRALLOC");
+
+  const vector<Process*>& b2g_processes = ProcessList::singleton().b2g_processes();
+  SharedBufferTotals b2g_totals;
+  for (vector<Process*>::const_iterator it = b2g_processes.begin();
+       it != b2g_processes.end(); ++it) {
+    Process* p = *it;
+    SharedBufferTotals totals;
+    totals.add(p->shared_buffers());
+    b2g_totals.add(p->shared_buffers());
+
+    t.start_row();
+    t.add(p->name());
+    t.add(p->pid());
+    add_shared_buffer_row(t, totals);
+  }
+
+  SharedBufferTotals system_totals;
+  const vector<Process*>& all_processes = ProcessList::singleton().all_processes();
+  for (vector<Process*>::const_iterator it = all_processes.begin();
+       it != all_processes.end(); ++it) {
+    system_totals.add((*it)->shared_buffers());
+  }
+
+  t.add_delimiter();
+  t.start_row();
+  t.add("B2G total");
+  t.add("");
+  add_shared_buffer_row(t, b2g_totals);
+
+  t.start_row();
+  t.add("system total");
+  t.add("");
+  add_shared_buffer_row(t, system_totals);
+
+  t.print();
+  return 0;
+}
+
+/**
+ * Prints how much of each B2G process's resident memory was touched over
+ * |seconds|, overall and by kind of mapping.  Cold memory is what reclaim
+ * or zram could take without the process noticing right away.
+ */
+int
+print_working_set(int seconds)
+{
+  if (!FsSource::current().is_live()) {
+    fputs("--working-set can't be used with --root.\n", stderr);
+    return 1;
+  }
+
+  const vector<Process*>& processes = ProcessList::singleton().b2g_processes();
+  WorkingSet ws(processes);
+  if (!ws.start()) {
+    fputs("Couldn't use page_idle or clear_refs; are you root?\n", stderr);
+    return 1;
+  }
+
+  printf("Measuring the working set over %d seconds using %s...\n\n", seconds,
+         ws.method() == WorkingSet::PAGE_IDLE ? "page_idle" : "clear_refs");
+  fflush(stdout);
+  sleep(seconds);
+  ws.finish();
+
+  Table t;
+  t.multi_col_header("megabytes", 2, 5);
+
+  t.start_row();
+  t.add("NAME");
+  t.add("PID");
+  t.add("RSS");
+  t.add("HOT");
+  t.add("COLD");
+  t.add("HOT%");
+
+  WorkingSet::Usage total;
+  for (size_t i = 0; i < processes.size(); i++) {
+    WorkingSet::Usage u = ws.total(i);
+    long long rss_kb = u.hot_kb + u.cold_kb;
+    total.hot_kb += u.hot_kb;
+    total.cold_kb += u.cold_kb;
+
+    t.start_row();
+    t.add(processes[i]->name());
+    t.add(processes[i]->pid());
+    t.add_fmt("%0.1f", rss_kb / 1024.0);
+    t.add_fmt("%0.1f", u.hot_kb / 1024.0);
+    t.add_fmt("%0.1f", u.cold_kb / 1024.0);
+    t.add_fmt("%d", rss_kb ? (int)(100 * u.hot_kb / rss_kb) : 0);
+  }
+
+  long long total_rss_kb = total.hot_kb + total.cold_kb;
+  t.add_delimiter();
+  t.start_row();
+  t.add("total");
+  t.add("");
+  t.add_fmt("%0.1f", total_rss_kb / 1024.0);
+  t.add_fmt("%0.1f", total.hot_kb / 1024.0);
+  t.add_fmt("%0.1f", total.cold_kb / 1024.0);
+  t.add_fmt("%d", total_rss_kb ? (int)(100 * total.hot_kb / total_rss_kb) : 0);
+
+  t.print();
+  putchar('\n');
+
+  puts("By kind of mapping, all B2G processes (megabytes):\n");
+
+  Table c;
+  c.start_row();
+  c.add("KIND", Table::ALIGN_LEFT);
+  c.add("HOT");
+  c.add("COLD");
+
+  for (int cat = 0; cat < WorkingSet::NUM_CATEGORIES; cat++) {
+    WorkingSet::Usage sum;
+    for (size_t i = 0; i < processes.size(); i++) {
+      const WorkingSet::Usage& u = ws.usage(i, (WorkingSet::Category) cat);
+      sum.hot_kb += u.hot_kb;
+      sum.cold_kb += u.cold_kb;
+    }
+    c.start_row();
+    c.add(WorkingSet::category_name((WorkingSet::Category) cat), Table::ALIGN_LEFT);
+    c.add_fmt("%0.1f", sum.hot_kb / 1024.0);
+    c.add_fmt("%0.1f", sum.cold_kb / 1024.0);
+  }
+
+  c.print_with_indent(2);
+  return 0;
+}
+
+static volatile sig_atomic_t stop_recording = 0;
+
+static void
+handle_stop_signal(int)
+{
+  stop_recording = 1;
+}
+
+/**
+ * Samples B2G processes every |seconds| into a TimeSeriesStore in |dir|
+ * until we get SIGINT or SIGTERM.
+ */
+int
+record_history(const char* dir, int seconds)
+{
+  if (!FsSource::current().is_live()) {
+    fputs("--record can't be used with --root.\n", stderr);
+    return 1;
+  }
+
+  TimeSeriesStore store(dir, seconds * 1000LL);
+  if (!store.init()) {
+    return 1;
+  }
+
+  signal(SIGINT, handle_stop_signal);
+  signal(SIGTERM, handle_stop_signal);
+
+  time_t last_expire = 0;
+  while (!stop_recording) {
+    Sample sample;
+    sample.collect();
+    store.add(sample);
+
+    if (time(NULL) - last_expire >= 60 * 60) {
+      store.expire();
+      last_expire = time(NULL);
+    }
+
+    // A signal cuts this short.
+    sleep(seconds);
+  }
+
+  store.flush();
+  return 0;
+}
+
+/**
+ * Prints one series from a TimeSeriesStore in |dir|.  |spec| is
+ * NAME:FIELD[:HOURS], e.g. "Homescreen:uss:6" for the Homescreen's USS over
+ * the last six hours (one hour if HOURS is left out).
+ */
+int
+print_history(const char* dir, const char* spec)
+{
+  string name = spec;
+  double hours = 1;
+  size_t colon = name.rfind(':');
+  if (colon != string::npos && colon + 1 < name.size() &&
+      name.find_first_not_of("0123456789.", colon + 1) == string::npos &&
+      name.find(':') != colon) {
+    hours = atof(name.c_str() + colon + 1);
+    name.erase(colon);
+    colon = name.rfind(':');
+  }
+  if (colon == string::npos || colon == 0 || colon + 1 == name.size()) {
+    fprintf(stderr, "Expected NAME:FIELD[:HOURS], not %s.\n", spec);
+    return 1;
+  }
+  string field = name.substr(colon + 1);
+  name.erase(colon);
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  long long since_ms = now.tv_sec * 1000LL - (long long) (hours * 60 * 60 * 1000);
+
+  vector<TimeSeriesStore::Point> points;
+  if (!TimeSeriesStore::query(dir, name, field, since_ms, points)) {
+    fprintf(stderr, "%s has no %s for %s.\n", dir, field.c_str(), name.c_str());
+    return 1;
+  }
+
+  Table t;
+  t.multi_col_header("megabytes", 2, 5);
+
+  t.start_row();
+  t.add("TIME", Table::ALIGN_LEFT);
+  t.add("BUCKET");
+  t.add("MIN");
+  t.add("AVG");
+  t.add("MAX");
+
+  for (size_t i = 0; i < points.size(); i++) {
+    const TimeSeriesStore::Point& p = points[i];
+    time_t secs = p.time_ms / 1000;
+    char time_str[32];
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&secs));
+
+    t.start_row();
+    t.add(time_str, Table::ALIGN_LEFT);
+    if (p.level) {
+      t.add_fmt("%lldm", TimeSeriesStore::resolution_ms(p.level) / (60 * 1000));
+    } else {
+      t.add("-");
+    }
+    t.add_fmt("%0.1f", kb_to_mb(p.min_kb));
+    t.add_fmt("%0.1f", kb_to_mb(p.avg_kb));
+    t.add_fmt("%0.1f", kb_to_mb(p.max_kb));
+  }
+
+  t.print();
+  return 0;
+}
+
+/**
+ * Where b2g-launcher records its startup timestamps.
+ */
+static const char* startup_file = "/data/local/b2g-startup.txt";
+
+/**
+ * Prints the startup timeline recorded by b2g-launcher: when init started
+ * it, each of its phases, and (if library tracing was enabled) when each
+ * library was first mapped into b2g.
+ */
+int
+print_startup_info()
+{
+  string contents;
+  if (!FsSource::current().read_file(startup_file, contents)) {
+    fprintf(stderr, "Couldn't open %s: %s\n", startup_file, strerror(errno));
+    fputs("Is B2G started by b2g-launcher?\n", stderr);
+    return 1;
+  }
+
+  // (time, (kind, name)), so that sorting puts events in order.
+  vector<pair<long long, pair<string, string> > > events;
+  LineReader lines(contents);
+  while (const char* line = lines.next()) {
+    char kind[16];
+    char name[448];
+    long long ns;
+    if (sscanf(line, "%15s %lld %447s", kind, &ns, name) == 3) {
+      events.push_back(make_pair(ns, make_pair(string(kind), string(name))));
+    }
+  }
+
+  if (events.empty()) {
+    fprintf(stderr, "%s is empty.\n", startup_file);
+    return 1;
+  }
+  stable_sort(events.begin(), events.end());
+
+  Table t;
+  t.multi_col_header("milliseconds", 2, 5);
+
+  t.start_row();
+  t.add("EVENT", Table::ALIGN_LEFT);
+  t.add("NAME", Table::ALIGN_LEFT);
+  t.add("BOOT");
+  t.add("+PREV");
+  t.add("+START");
+
+  long long start = events[0].first;
+  long long prev = start;
+  int num_libs = 0;
+  for (size_t i = 0; i < events.size(); i++) {
+    long long ns = events[i].first;
+    const string& kind = events[i].second.first;
+    string name = events[i].second.second;
+    if (kind == "lib") {
+      name = name.substr(name.rfind('/') + 1);
+      num_libs++;
+    }
+
+    t.start_row();
+    t.add(kind, Table::ALIGN_LEFT);
+    t.add(name, Table::ALIGN_LEFT);
+    t.add_fmt("%0.1f", ns / 1e6);
+    t.add_fmt("%0.1f", (ns - prev) / 1e6);
+    t.add_fmt("%0.1f", (ns - start) / 1e6);
+    prev = ns;
+  }
+
+  t.print();
+  putchar('\n');
+  printf("%d libraries traced; %0.1f ms from %s to the last event.\n",
+         num_libs, (prev - start) / 1e6, events[0].second.second.c_str());
+  return 0;
+}
+
 void usage()
 {
   printf("usage: %s [args]\n", cmd_name);
@@ -323,42 +1253,289 @@ void usage()
   printf("  -p, --pids         Print a list of all B2G PIDs.\n");
   printf("  -m, --main-pid     Print only the main B2G process's PID.\n");
   printf("  -c, --child-pids   Print only the child B2G processes' PIDs.\n");
+  printf("  -x, --exe PATH     Print memory usage of processes running PATH.\n");
+  printf("                     May be given more than once.\n");
+  printf("  -s, --startup      Print the timeline of the last B2G startup.\n");
+  printf("  -b, --buffers      Print dma-buf, ashmem, and gralloc memory.\n");
+  printf("  -w, --working-set SECS\n");
+  printf("                     Print how much memory B2G processes touch in SECS.\n");
+  printf("  --benchmark        Print how long collecting the usual output takes, and\n");
+  printf("                     the system calls and allocations it makes.\n");
+  printf("  --capture FILE     Save what b2g-info reads from /proc and /sys to the tar\n");
+  printf("                     file FILE, for use with --root.\n");
+  printf("  --watch SECS       Print the B2G process table every SECS seconds.  May be\n");
+  printf("                     combined with --threads.\n");
+  printf("  --daemon SECS      Sample B2G processes every SECS seconds and publish the\n");
+  printf("                     samples in " DAEMON_RING_PATH " and on the socket\n");
+  printf("                     " DAEMON_SOCKET_PATH ".  Doesn't return.\n");
+  printf("  --daemon-latest    Print the daemon's latest sample, without reading /proc.\n");
+  printf("  --daemon-sample    Ask the daemon to take a sample now, and print it.\n");
+  printf("  --record DIR SECS  Record B2G processes' memory every SECS seconds into DIR,\n");
+  printf("                     keeping older data at 1- and 15-minute resolution, until\n");
+  printf("                     interrupted.\n");
+  printf("  --history DIR NAME:FIELD[:HOURS]\n");
+  printf("                     Print the min, average, and max of FIELD (uss, pss, rss,\n");
+  printf("                     or swap; or free, cache, used, or swap_used for NAME\n");
+  printf("                     \"system\") of processes named NAME over the last HOURS\n");
+  printf("                     hours (default 1), from a --record directory.\n");
   printf("  -h, --help         Display this message.\n");
   printf("\n");
   printf("Note that all of these options are mutually-exclusive.\n");
+  printf("\n");
+  printf("  --root PATH        Read /proc and /sys from a directory or a tar file made\n");
+  printf("                     with --capture, instead of from this device.  May be\n");
+  printf("                     combined with any option which doesn't watch the\n");
+  printf("                     device over time (--working-set, --watch, --daemon,\n");
+  printf("                     and --record).\n");
+  printf("  --rates            With --watch, add each task's minor and major page faults\n");
+  printf("                     and KB read from and written to storage per second.\n");
+  printf("  --sched            With --watch and --threads, add each thread's CPU use,\n");
+  printf("                     average wait on the runqueue each time it ran, and\n");
+  printf("                     voluntary and involuntary context switches per second.\n");
+  printf("                     A process's row is its main thread.\n");
+  printf("  --self-stats       After the output, print the system calls b2g-info made\n");
+  printf("                     for each kind of file, and the CPU time it used.  May\n");
+  printf("                     be combined with any option.\n");
 }
 
 int main(int argc, const char** argv)
 {
   cmd_name = argv[0];
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
 
   // We could use an option-parsing library, but this is easier for now.
-  if (argc > 2) {
-    fputs("Too many arguments.\n", stderr);
-    usage();
-    return 1;
-  }
-
   bool threads = false;
   bool pids_only = false;
   bool main_pid_only = false;
   bool child_pids_only = false;
-
-  if (argc > 1) {
-    if (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-h") || !strcmp(argv[1], "help")) {
+  bool startup = false;
+  bool buffers = false;
+  bool benchmark = false;
+  bool self_stats = false;
+  bool daemon_latest = false;
+  bool daemon_sample = false;
+  int working_set_secs = 0;
+  int daemon_secs = 0;
+  int watch_secs = 0;
+  bool show_rates = false;
+  bool show_sched = false;
+  int record_secs = 0;
+  const char* record_dir = NULL;
+  const char* history_dir = NULL;
+  const char* history_spec = NULL;
+  const char* capture_path = NULL;
+  vector<string> exes;
+
+  int num_modes = 0;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (!strcmp(arg, "--help") || !strcmp(arg, "-h") || !strcmp(arg, "help")) {
       usage();
       return 0;
     }
 
-    if (!(threads = !strcmp(argv[1], "-t") || !strcmp(argv[1], "--threads")) &&
-        !(pids_only = !strcmp(argv[1], "-p") || !strcmp(argv[1], "--pids")) &&
-        !(main_pid_only = !strcmp(argv[1], "-m") || !strcmp(argv[1], "--main-pid")) &&
-        !(child_pids_only = !strcmp(argv[1], "-c") || !strcmp(argv[1], "--child-pids"))) {
+    if (!strcmp(arg, "-x") || !strcmp(arg, "--exe")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "%s needs an argument.\n", arg);
+        usage();
+        return 1;
+      }
+      if (exes.empty()) {
+        num_modes++;
+      }
+      exes.push_back(argv[++i]);
+      continue;
+    }
 
-      fprintf(stderr, "Unknown argument %s.\n", argv[1]);
+    if (!strcmp(arg, "--root") || !strcmp(arg, "--capture")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "%s needs an argument.\n", arg);
+        usage();
+        return 1;
+      }
+      const char* path = argv[++i];
+      if (!strcmp(arg, "--capture")) {
+        capture_path = path;
+        num_modes++;
+      } else {
+        FsSource* source = FsSource::open_capture(path);
+        if (!source) {
+          return 1;
+        }
+        FsSource::set_current(source);
+      }
+      continue;
+    }
+
+    if (!strcmp(arg, "--self-stats")) {
+      self_stats = true;
+      continue;
+    }
+
+    if (!strcmp(arg, "-w") || !strcmp(arg, "--working-set")) {
+      if (i + 1 >= argc || !str_to_int(argv[i + 1], &working_set_secs) ||
+          working_set_secs <= 0) {
+        fprintf(stderr, "%s needs a number of seconds.\n", arg);
+        usage();
+        return 1;
+      }
+      i++;
+      num_modes++;
+      continue;
+    }
+
+    if (!strcmp(arg, "--record")) {
+      if (i + 2 >= argc || !str_to_int(argv[i + 2], &record_secs) ||
+          record_secs <= 0) {
+        fprintf(stderr, "%s needs a directory and a number of seconds.\n", arg);
+        usage();
+        return 1;
+      }
+      record_dir = argv[i + 1];
+      i += 2;
+      num_modes++;
+      continue;
+    }
+
+    if (!strcmp(arg, "--history")) {
+      if (i + 2 >= argc) {
+        fprintf(stderr, "%s needs a directory and NAME:FIELD[:HOURS].\n", arg);
+        usage();
+        return 1;
+      }
+      history_dir = argv[i + 1];
+      history_spec = argv[i + 2];
+      i += 2;
+      num_modes++;
+      continue;
+    }
+
+    if (!strcmp(arg, "--watch")) {
+      if (i + 1 >= argc || !str_to_int(argv[i + 1], &watch_secs) ||
+          watch_secs <= 0) {
+        fprintf(stderr, "%s needs a number of seconds.\n", arg);
+        usage();
+        return 1;
+      }
+      i++;
+      num_modes++;
+      continue;
+    }
+
+    if (!strcmp(arg, "--rates")) {
+      show_rates = true;
+      continue;
+    }
+
+    if (!strcmp(arg, "--sched")) {
+      show_sched = true;
+      continue;
+    }
+
+    if (!strcmp(arg, "--daemon")) {
+      if (i + 1 >= argc || !str_to_int(argv[i + 1], &daemon_secs) ||
+          daemon_secs <= 0) {
+        fprintf(stderr, "%s needs a number of seconds.\n", arg);
+        usage();
+        return 1;
+      }
+      i++;
+      num_modes++;
+      continue;
+    }
+
+    if (!(threads = threads || !strcmp(arg, "-t") || !strcmp(arg, "--threads")) &&
+        !(pids_only = pids_only || !strcmp(arg, "-p") || !strcmp(arg, "--pids")) &&
+        !(main_pid_only = main_pid_only || !strcmp(arg, "-m") || !strcmp(arg, "--main-pid")) &&
+        !(child_pids_only = child_pids_only || !strcmp(arg, "-c") || !strcmp(arg, "--child-pids")) &&
+        !(startup = startup || !strcmp(arg, "-s") || !strcmp(arg, "--startup")) &&
+        !(buffers = buffers || !strcmp(arg, "-b") || !strcmp(arg, "--buffers")) &&
+        !(benchmark = benchmark || !strcmp(arg, "--benchmark")) &&
+        !(daemon_latest = daemon_latest || !strcmp(arg, "--daemon-latest")) &&
+        !(daemon_sample = daemon_sample || !strcmp(arg, "--daemon-sample"))) {
+
+      fprintf(stderr, "Unknown argument %s.\n", arg);
       usage();
       return 1;
     }
+    num_modes++;
+  }
+
+  // --threads picks what --watch shows, rather than being a mode of its own.
+  if (watch_secs && threads) {
+    num_modes--;
+  }
+
+  if (show_rates && !watch_secs) {
+    fputs("--rates needs --watch.\n", stderr);
+    usage();
+    return 1;
+  }
+
+  // schedstat and status are per thread, so --sched shows a process's main
+  // thread; that only makes sense next to its other threads.
+  if (show_sched && !(watch_secs && threads)) {
+    fputs("--sched needs --watch and --threads.\n", stderr);
+    usage();
+    return 1;
+  }
+
+  if (num_modes > 1) {
+    fputs("Too many arguments.\n", stderr);
+    usage();
+    return 1;
+  }
+
+  if (self_stats) {
+    atexit(print_self_stats);
+  }
+
+  if (capture_path) {
+    return capture_state(capture_path);
+  }
+
+  if (!exes.empty()) {
+    return print_exe_info(exes);
+  }
+
+  if (startup) {
+    return print_startup_info();
+  }
+
+  if (buffers) {
+    return print_shared_buffers();
+  }
+
+  if (benchmark) {
+    return print_benchmark();
+  }
+
+  if (working_set_secs) {
+    return print_working_set(working_set_secs);
+  }
+
+  if (watch_secs) {
+    return print_watch(watch_secs, threads, show_rates, show_sched);
+  }
+
+  if (daemon_secs) {
+    return run_daemon(daemon_secs);
+  }
+
+  if (record_dir) {
+    return record_history(record_dir, record_secs);
+  }
+
+  if (history_dir) {
+    return print_history(history_dir, history_spec);
+  }
+
+  if (daemon_latest) {
+    return print_daemon_latest();
+  }
+
+  if (daemon_sample) {
+    return print_daemon_reply("sample");
   }
 
   if (pids_only || main_pid_only || child_pids_only) {
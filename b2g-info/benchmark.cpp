@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark.h"
+
+#include <new>
+#include <stdlib.h>
+#include <time.h>
+
+using namespace std;
+
+static long long sNumAllocs = 0;
+static long long sAllocBytes = 0;
+
+// Count every C++ allocation.  This costs an increment or two, so we leave it
+// on in normal runs too.
+
+void*
+operator new(size_t size)
+{
+  sNumAllocs++;
+  sAllocBytes += size;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    abort();
+  }
+  return p;
+}
+
+void*
+operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void
+operator delete(void* p) throw()
+{
+  free(p);
+}
+
+void
+operator delete[](void* p) throw()
+{
+  free(p);
+}
+
+// C++14 compilers call these sized forms instead when they know the size.
+
+void
+operator delete(void* p, size_t) throw()
+{
+  free(p);
+}
+
+void
+operator delete[](void* p, size_t) throw()
+{
+  free(p);
+}
+
+static long long
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+BenchmarkTable::Snapshot::Snapshot()
+  : ns(now_ns())
+  , io(FsSource::total_counters())
+  , allocs(sNumAllocs)
+  , alloc_bytes(sAllocBytes)
+{}
+
+/* static */ BenchmarkTable::Snapshot
+BenchmarkTable::Snapshot::zero()
+{
+  Snapshot s;
+  s.ns = s.allocs = s.alloc_bytes = 0;
+  s.io = FsSource::Counters();
+  return s;
+}
+
+void
+BenchmarkTable::Snapshot::add_difference(const Snapshot& from, const Snapshot& to)
+{
+  ns += to.ns - from.ns;
+  io.opens += to.io.opens - from.io.opens;
+  io.reads += to.io.reads - from.io.reads;
+  io.bytes_read += to.io.bytes_read - from.io.bytes_read;
+  io.readlinks += to.io.readlinks - from.io.readlinks;
+  io.dirs_listed += to.io.dirs_listed - from.io.dirs_listed;
+  io.stats += to.io.stats - from.io.stats;
+  allocs += to.allocs - from.allocs;
+  alloc_bytes += to.alloc_bytes - from.alloc_bytes;
+}
+
+BenchmarkTable::BenchmarkTable()
+{
+  // Allocate up front, so that end_phase() doesn't count against the next
+  // phase.
+  m_phases.reserve(16);
+  m_last = Snapshot();
+}
+
+void
+BenchmarkTable::end_phase(const char* name)
+{
+  Phase phase;
+  phase.end = Snapshot();
+  phase.name = name;
+  phase.start = m_last;
+  m_phases.push_back(phase);
+  m_last = Snapshot();
+}
+
+void
+BenchmarkTable::add_row(Table& t, const char* name, const Snapshot& from, const Snapshot& to)
+{
+  t.start_row();
+  t.add(name, Table::ALIGN_LEFT);
+  t.add_fmt("%0.2f", (to.ns - from.ns) / 1000000.0);
+  t.add_fmt("%lld", to.io.opens - from.io.opens);
+  t.add_fmt("%lld", to.io.reads - from.io.reads);
+  t.add_fmt("%lld", (to.io.bytes_read - from.io.bytes_read) / 1024);
+  t.add_fmt("%lld", to.io.readlinks - from.io.readlinks);
+  t.add_fmt("%lld", to.io.dirs_listed - from.io.dirs_listed);
+  t.add_fmt("%lld", to.io.stats - from.io.stats);
+  t.add_fmt("%lld", to.allocs - from.allocs);
+  t.add_fmt("%lld", (to.alloc_bytes - from.alloc_bytes) / 1024);
+}
+
+void
+BenchmarkTable::print()
+{
+  Table t;
+  t.start_row();
+  t.add("PHASE", Table::ALIGN_LEFT);
+  t.add("MS");
+  t.add("OPENS");
+  t.add("READS");
+  t.add("KB_READ");
+  t.add("READLINKS");
+  t.add("DIRS");
+  t.add("STATS");
+  t.add("ALLOCS");
+  t.add("KB_ALLOC");
+
+  // Sum the phases rather than taking the difference between the first and
+  // last snapshots, which would include our own bookkeeping.
+  Snapshot zero = Snapshot::zero();
+  Snapshot total = zero;
+  for (size_t i = 0; i < m_phases.size(); i++) {
+    const Phase& p = m_phases[i];
+    add_row(t, p.name, p.start, p.end);
+    total.add_difference(p.start, p.end);
+  }
+
+  t.add_delimiter();
+  add_row(t, "total", zero, total);
+  t.print();
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "fssource.h"
+#include "table.h"
+#include <vector>
+
+/**
+ * Measures the phases of a b2g-info run for --benchmark: how long each took,
+ * the system calls FsSource made, and how many heap allocations there were.
+ *
+ *   BenchmarkTable bench;
+ *   ... do some work ...
+ *   bench.end_phase("discovery");
+ *   ... do some more ...
+ *   bench.end_phase("smaps");
+ *   bench.print();
+ *
+ * Allocations are counted by our operator new, so they don't include
+ * malloc() calls from C code (or from stlport's allocator, which pools
+ * small allocations on the device).
+ */
+class BenchmarkTable
+{
+public:
+  BenchmarkTable();
+
+  /**
+   * Record everything since the last call (or since we were constructed) as
+   * the phase |name|, which must outlive us.
+   */
+  void end_phase(const char* name);
+
+  /**
+   * Print a row for each phase and their total.
+   */
+  void print();
+
+private:
+  struct Snapshot
+  {
+    Snapshot();
+
+    /**
+     * A snapshot of nothing at time 0.
+     */
+    static Snapshot zero();
+
+    /**
+     * Add what happened between |from| and |to| to this snapshot.
+     */
+    void add_difference(const Snapshot& from, const Snapshot& to);
+
+    long long ns;
+    FsSource::Counters io;
+    long long allocs;
+    long long alloc_bytes;
+  };
+
+  struct Phase
+  {
+    const char* name;
+    Snapshot start;
+    Snapshot end;
+  };
+
+  void add_row(Table& t, const char* name, const Snapshot& from, const Snapshot& to);
+
+  std::vector<Phase> m_phases;
+  Snapshot m_last;
+};
@@ -0,0 +1,197 @@
+#!/usr/bin/env python
+
+# Benchmarks b2g-info's collection against synthetic /proc trees.
+#
+#   benchmark.py generate DIR [options]
+#       writes a /proc (and the bits of /sys b2g-info reads) under DIR, which
+#       "b2g-info --root DIR" reads as though it were a device;
+#
+#   benchmark.py run [--b2g-info PATH]
+#       generates trees from 10 to 2000 processes and prints what
+#       "b2g-info --benchmark" reports for each.
+#
+# Use the host build of b2g-info (out/host/<os>/bin/b2g-info) to run this on a
+# workstation.
+
+from __future__ import print_function
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+from optparse import OptionParser
+
+MAIN_EXE = "/system/b2g/b2g"
+CHILD_EXE = "/system/b2g/plugin-container"
+OTHER_EXE = "/system/bin/sh"
+
+# Mappings for processes other than B2G's, which b2g-info mostly doesn't read.
+OTHER_MAPPINGS = 20
+
+# (processes, B2G processes, mappings per B2G process, threads per B2G process)
+SUITE = [
+    (10, 3, 500, 10),
+    (100, 10, 2000, 30),
+    (500, 20, 5000, 40),
+    (2000, 40, 5000, 50),
+]
+
+def write(path, contents):
+    d = os.path.dirname(path)
+    if not os.path.isdir(d):
+        os.makedirs(d)
+    with open(path, 'w') as f:
+        f.write(contents)
+
+def stat_line(pid, name, ppid, num_threads):
+    # All 52 fields of /proc/<pid>/stat, as of Linux 4.x.
+    fields = [pid, "(%s)" % name, "S", ppid, pid, pid, 0, -1, 4194560,
+              12000 + pid, 0, 30 + pid % 7, 0, 500 + pid, 200 + pid, 0, 0, 20, 0,
+              num_threads, 0, 1000 + pid, 120000000, 20000,
+              "18446744073709551615", 1, 1, 0, 0, 0, 0, 0, 4096, 1208,
+              0, 0, 0, 17, pid % 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0]
+    return " ".join(str(f) for f in fields) + "\n"
+
+def mapping_lines(num_mappings):
+    """Return the contents of maps and smaps for a process with
+    'num_mappings' mappings"""
+    maps = []
+    smaps = []
+    address = 0x40000000
+    for i in range(num_mappings):
+        size_kb = 4 * (1 + i % 64)
+        start = address
+        address += size_kb * 1024
+        if i % 3 == 0:
+            perms, path, inode = "r-xp", "/system/lib/lib%d.so" % (i % 200), 1000 + i % 200
+        elif i % 3 == 1:
+            perms, path, inode = "rw-p", "", 0
+        else:
+            perms, path, inode = "rw-s", "/dev/ashmem/buffer%d (deleted)" % i, 50000 + i
+        header = "%08x-%08x %s 00000000 00:00 %d %s\n" % (start, address, perms, inode, path)
+        maps.append(header)
+        rss = size_kb // 2
+        smaps.append(header)
+        smaps.append(
+            "Size:           %8d kB\n"
+            "Rss:            %8d kB\n"
+            "Pss:            %8d kB\n"
+            "Shared_Clean:   %8d kB\n"
+            "Shared_Dirty:   %8d kB\n"
+            "Private_Clean:  %8d kB\n"
+            "Private_Dirty:  %8d kB\n"
+            "Referenced:     %8d kB\n"
+            "Anonymous:      %8d kB\n"
+            "AnonHugePages:  %8d kB\n"
+            "Swap:           %8d kB\n"
+            "SwapPss:        %8d kB\n"
+            "KernelPageSize: %8d kB\n"
+            "MMUPageSize:    %8d kB\n"
+            "Locked:         %8d kB\n"
+            "VmFlags: rd wr mr mw me ac\n"
+            % (size_kb, rss, rss // 2, rss // 4, 0, rss // 4, rss // 2, rss,
+               rss if not path else 0, 0, 0, 0, 4, 4, 0))
+    return "".join(maps), "".join(smaps)
+
+def link_or_write(path, contents, cache):
+    """Write 'contents' to 'path', hard-linking to an earlier file with the
+    same contents where possible; smaps for thousands of mappings is big"""
+    d = os.path.dirname(path)
+    if not os.path.isdir(d):
+        os.makedirs(d)
+    original = cache.get(contents)
+    if original:
+        try:
+            os.link(original, path)
+            return
+        except OSError:
+            pass
+    write(path, contents)
+    cache[contents] = path
+
+def generate(root, num_processes, num_b2g, num_mappings, num_threads):
+    proc = os.path.join(root, "proc")
+    write(os.path.join(proc, "meminfo"),
+          "MemTotal:         250000 kB\n"
+          "MemFree:           20000 kB\n"
+          "Buffers:            2000 kB\n"
+          "Cached:            40000 kB\n"
+          "SwapCached:            0 kB\n"
+          "SwapTotal:         65536 kB\n"
+          "SwapFree:          30000 kB\n")
+    lmk = os.path.join(root, "sys/module/lowmemorykiller/parameters")
+    write(os.path.join(lmk, "adj"), "0,1,2,4,6,8\n")
+    write(os.path.join(lmk, "minfree"), "1024,2048,4096,5120,6144,7168\n")
+    write(os.path.join(lmk, "notify_trigger"), "3584\n")
+
+    b2g_maps = mapping_lines(num_mappings)
+    other_maps = mapping_lines(OTHER_MAPPINGS)
+    cache = {}
+    main_pid = 100
+    for i in range(num_processes):
+        pid = main_pid + i
+        if i == 0:
+            name, exe, ppid, threads, maps = "b2g", MAIN_EXE, 1, num_threads, b2g_maps
+        elif i < num_b2g:
+            name, exe, ppid, threads, maps = \
+                "App%d" % i, CHILD_EXE, main_pid, num_threads, b2g_maps
+        else:
+            name, exe, ppid, threads, maps = "daemon%d" % i, OTHER_EXE, 1, 1, other_maps
+
+        pid_dir = os.path.join(proc, str(pid))
+        write(os.path.join(pid_dir, "stat"), stat_line(pid, name, ppid, threads))
+        write(os.path.join(pid_dir, "oom_adj"), "%d\n" % (i % 10))
+        write(os.path.join(pid_dir, "oom_score_adj"), "%d\n" % (i % 10 * 58))
+        write(os.path.join(pid_dir, "oom_score"), "%d\n" % (i % 10 * 60))
+        link_or_write(os.path.join(pid_dir, "maps"), maps[0], cache)
+        link_or_write(os.path.join(pid_dir, "smaps"), maps[1], cache)
+        os.symlink(exe, os.path.join(pid_dir, "exe"))
+        for t in range(threads):
+            tid = pid if t == 0 else pid * 1000 + t
+            write(os.path.join(pid_dir, "task", str(tid), "stat"),
+                  stat_line(tid, "Thread%d" % t if t else name, ppid, threads))
+
+def run_suite(b2g_info, repeat):
+    for num_processes, num_b2g, num_mappings, num_threads in SUITE:
+        print("== %d processes, %d B2G processes with %d mappings and %d threads each"
+              % (num_processes, num_b2g, num_mappings, num_threads))
+        root = tempfile.mkdtemp(prefix="b2g-info-bench-")
+        try:
+            generate(root, num_processes, num_b2g, num_mappings, num_threads)
+            for i in range(repeat):
+                sys.stdout.flush()
+                subprocess.check_call([b2g_info, "--root", root, "--benchmark"])
+                print()
+        finally:
+            shutil.rmtree(root)
+
+def main():
+    parser = OptionParser(usage="%prog generate DIR [options]\n       %prog run [options]")
+    parser.add_option("--processes", dest="processes", type="int", default=100,
+                      help="number of processes [%default]")
+    parser.add_option("--b2g-processes", dest="b2g_processes", type="int", default=10,
+                      help="how many of them are B2G's [%default]")
+    parser.add_option("--mappings", dest="mappings", type="int", default=2000,
+                      help="mappings per B2G process [%default]")
+    parser.add_option("--threads", dest="threads", type="int", default=30,
+                      help="threads per B2G process [%default]")
+    parser.add_option("--b2g-info", dest="b2g_info", default="b2g-info",
+                      help="b2g-info binary to run [%default]")
+    parser.add_option("--repeat", dest="repeat", type="int", default=3,
+                      help="runs per tree [%default]")
+    (options, args) = parser.parse_args()
+
+    if args[:1] == ["generate"] and len(args) == 2:
+        if os.path.exists(os.path.join(args[1], "proc")):
+            parser.error("%s already has a proc directory" % args[1])
+        generate(args[1], options.processes, min(options.b2g_processes, options.processes),
+                 options.mappings, options.threads)
+    elif args == ["run"]:
+        run_suite(options.b2g_info, options.repeat)
+    else:
+        parser.error("specify generate DIR or run")
+    return 0
+
+if __name__=="__main__":
+    sys.exit(main())
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "capture.h"
+#include "fssource.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Writes a ustar file.  Names longer than ustar allows get a GNU long-name
+ * entry, which is what GNU tar does too.
+ */
+class TarWriter
+{
+public:
+  TarWriter()
+    : m_file(NULL)
+    , m_mtime(time(NULL))
+  {}
+
+  bool open(const char* path)
+  {
+    m_file = fopen(path, "wb");
+    return m_file;
+  }
+
+  void add_dir(const string& path, uid_t uid)
+  {
+    write_header(path, '5', 0, uid, "");
+  }
+
+  void add_file(const string& path, const string& contents, uid_t uid)
+  {
+    write_header(path, '0', contents.size(), uid, "");
+    write_data(contents);
+  }
+
+  void add_symlink(const string& path, const string& target, uid_t uid)
+  {
+    write_header(path, '2', 0, uid, target);
+  }
+
+  /**
+   * Finish the archive.  Returns false if anything failed to write.
+   */
+  bool close()
+  {
+    static const char zeros[1024] = { 0 };
+    fwrite(zeros, 1, sizeof(zeros), m_file);
+    bool ok = !ferror(m_file);
+    ok = !fclose(m_file) && ok;
+    m_file = NULL;
+    return ok;
+  }
+
+private:
+  void write_header(const string& path, char type, size_t size, uid_t uid,
+                    const string& link)
+  {
+    // Store names without the leading '/', as tar does.
+    string name = path.substr(path[0] == '/' ? 1 : 0);
+    if (name.size() >= 100) {
+      write_header("././@LongLink", 'L', name.size() + 1, 0, "");
+      write_data(string(name.c_str(), name.size() + 1));
+      name.resize(99);
+    }
+
+    char header[512];
+    memset(header, 0, sizeof(header));
+    strncpy(header, name.c_str(), 100);
+    snprintf(header + 100, 8, "%07o", type == '5' ? 0755 : 0644);
+    snprintf(header + 108, 8, "%07o", (unsigned) uid & 07777777);
+    snprintf(header + 116, 8, "%07o", 0);
+    snprintf(header + 124, 12, "%011llo", (unsigned long long) size);
+    snprintf(header + 136, 12, "%011llo", (unsigned long long) m_mtime);
+    header[156] = type;
+    strncpy(header + 157, link.c_str(), 100);
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+
+    // The checksum is computed with its own field set to spaces.
+    memset(header + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (size_t i = 0; i < sizeof(header); i++) {
+      checksum += (unsigned char) header[i];
+    }
+    snprintf(header + 148, 8, "%06o", checksum);
+
+    fwrite(header, 1, sizeof(header), m_file);
+  }
+
+  void write_data(const string& data)
+  {
+    static const char zeros[512] = { 0 };
+    fwrite(data.data(), 1, data.size(), m_file);
+    fwrite(zeros, 1, (512 - data.size() % 512) % 512, m_file);
+  }
+
+  FILE* m_file;
+  time_t m_mtime;
+};
+
+/**
+ * Copy the file at |path|, if it exists.
+ */
+static void
+capture_file(TarWriter& tar, const string& path, uid_t uid = 0)
+{
+  string contents;
+  if (FsSource::current().read_file(path.c_str(), contents)) {
+    tar.add_file(path, contents, uid);
+  }
+}
+
+/**
+ * Copy the dma-buf fds of the process in |proc_dir| along with their
+ * fdinfo, which is all b2g-info looks at.
+ */
+static void
+capture_fds(TarWriter& tar, const string& proc_dir, uid_t uid)
+{
+  FsSource& source = FsSource::current();
+  vector<string> fds;
+  if (!source.list_dir((proc_dir + "/fd").c_str(), fds)) {
+    return;
+  }
+
+  for (size_t i = 0; i < fds.size(); i++) {
+    string fd_path = proc_dir + "/fd/" + fds[i];
+    string target;
+    if (!source.read_link(fd_path.c_str(), target) ||
+        (target.compare(0, 8, "/dmabuf:") && target != "anon_inode:dmabuf")) {
+      continue;
+    }
+    tar.add_symlink(fd_path, target, uid);
+
+    string fdinfo_path = proc_dir + "/fdinfo/" + fds[i];
+    string fdinfo;
+    if (!source.read_file(fdinfo_path.c_str(), fdinfo)) {
+      continue;
+    }
+
+    // Older kernels don't put the dma-buf's size and inode in fdinfo, so we
+    // stat the fd for them.  We won't be able to do that offline, so write
+    // down what we find.
+    struct stat st;
+    if (source.is_live() && stat(fd_path.c_str(), &st) == 0) {
+      char line[64];
+      if (!strstr(fdinfo.c_str(), "\nsize:")) {
+        snprintf(line, sizeof(line), "size:\t%lld\n", (long long) st.st_size);
+        fdinfo += line;
+      }
+      if (!strstr(fdinfo.c_str(), "\nino:")) {
+        snprintf(line, sizeof(line), "ino:\t%llu\n", (unsigned long long) st.st_ino);
+        fdinfo += line;
+      }
+    }
+    tar.add_file(fdinfo_path, fdinfo, uid);
+  }
+}
+
+static void
+capture_process(TarWriter& tar, const string& pid)
+{
+  static const char* const files[] = {
+    "stat",
+    "smaps",
+    "maps",
+    "oom_adj",
+    "oom_score",
+    "oom_score_adj"
+  };
+
+  FsSource& source = FsSource::current();
+  string proc_dir = "/proc/" + pid;
+
+  uid_t uid;
+  if (!source.get_uid(proc_dir.c_str(), &uid)) {
+    // The process exited.
+    return;
+  }
+  tar.add_dir(proc_dir, uid);
+
+  for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+    capture_file(tar, proc_dir + "/" + files[i], uid);
+  }
+
+  string exe;
+  if (source.read_link((proc_dir + "/exe").c_str(), exe)) {
+    tar.add_symlink(proc_dir + "/exe", exe, uid);
+  }
+
+  vector<string> tids;
+  if (source.list_dir((proc_dir + "/task").c_str(), tids)) {
+    for (size_t i = 0; i < tids.size(); i++) {
+      capture_file(tar, proc_dir + "/task/" + tids[i] + "/stat", uid);
+    }
+  }
+
+  capture_fds(tar, proc_dir, uid);
+}
+
+int
+capture_state(const char* tar_path)
+{
+  TarWriter tar;
+  if (!tar.open(tar_path)) {
+    perror(tar_path);
+    return 1;
+  }
+
+  FsSource& source = FsSource::current();
+
+  capture_file(tar, "/proc/meminfo");
+  capture_file(tar, "/data/local/b2g-startup.txt");
+
+  vector<string> names;
+  const string lmk_dir = "/sys/module/lowmemorykiller/parameters/";
+  if (source.list_dir(lmk_dir.c_str(), names)) {
+    for (size_t i = 0; i < names.size(); i++) {
+      capture_file(tar, lmk_dir + names[i]);
+    }
+  }
+
+  if (source.list_dir("/sys/block", names)) {
+    static const char* const zram_files[] = {
+      "disksize",
+      "mm_stat",
+      "orig_data_size",
+      "compr_data_size",
+      "mem_used_total"
+    };
+    for (size_t i = 0; i < names.size(); i++) {
+      if (names[i].compare(0, 4, "zram")) {
+        continue;
+      }
+      for (size_t j = 0; j < sizeof(zram_files) / sizeof(zram_files[0]); j++) {
+        capture_file(tar, "/sys/block/" + names[i] + "/" + zram_files[j]);
+      }
+    }
+  }
+
+  int num_processes = 0;
+  if (source.list_dir("/proc", names)) {
+    for (size_t i = 0; i < names.size(); i++) {
+      int pid;
+      if (str_to_int(names[i], &pid)) {
+        capture_process(tar, names[i]);
+        num_processes++;
+      }
+    }
+  }
+
+  if (!tar.close()) {
+    fprintf(stderr, "Error writing %s: %s\n", tar_path, strerror(errno));
+    return 1;
+  }
+
+  printf("Captured %d processes to %s.\n", num_processes, tar_path);
+  return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "daemon.h"
+#include "fssource.h"
+#include "sample.h"
+#include "samplering.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+static long long
+now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static bool
+write_all(int fd, const char* data, size_t length)
+{
+  while (length) {
+    ssize_t written = TEMP_FAILURE_RETRY(write(fd, data, length));
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    length -= written;
+  }
+  return true;
+}
+
+static void
+make_socket_addr(struct sockaddr_un& addr)
+{
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, DAEMON_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+}
+
+/**
+ * Take a sample of the system as it is now, publish it to |ring|, and store
+ * its text in |latest|.
+ */
+static void
+take_sample(SampleRing& ring, string& latest)
+{
+  Sample sample;
+  sample.collect();
+  sample.serialize(latest);
+  ring.publish(latest);
+}
+
+/**
+ * Answer one client on |listen_fd|.  Clients get a second to send their
+ * request, so a stuck one can't hold up sampling for long.
+ */
+static void
+serve_client(int listen_fd, SampleRing& ring, string& latest)
+{
+  int fd = TEMP_FAILURE_RETRY(accept(listen_fd, NULL, NULL));
+  if (fd == -1) {
+    return;
+  }
+
+  struct timeval timeout = { 1, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  string request;
+  char buf[64];
+  while (request.find('\n') == string::npos && request.size() < sizeof(buf)) {
+    ssize_t nread = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)));
+    if (nread <= 0) {
+      break;
+    }
+    request.append(buf, nread);
+  }
+  request = request.substr(0, request.find('\n'));
+
+  if (request == "sample") {
+    take_sample(ring, latest);
+    write_all(fd, latest.data(), latest.size());
+  } else if (request == "latest") {
+    write_all(fd, latest.data(), latest.size());
+  } else {
+    const char error[] = "error unknown request\n";
+    write_all(fd, error, sizeof(error) - 1);
+  }
+  close(fd);
+}
+
+int
+run_daemon(int interval_secs)
+{
+  if (!FsSource::current().is_live()) {
+    fputs("--daemon can't be used with --root.\n", stderr);
+    return 1;
+  }
+
+  // A client hanging up early shouldn't kill us.
+  signal(SIGPIPE, SIG_IGN);
+
+  SampleRing ring;
+  if (!ring.create(DAEMON_RING_PATH)) {
+    return 1;
+  }
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd == -1) {
+    perror("Couldn't create socket");
+    return 1;
+  }
+
+  // Remove the socket a previous daemon left behind.
+  unlink(DAEMON_SOCKET_PATH);
+  struct sockaddr_un addr;
+  make_socket_addr(addr);
+  if (bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+      listen(listen_fd, 8) == -1) {
+    fprintf(stderr, "Couldn't listen on %s: %s\n", DAEMON_SOCKET_PATH,
+            strerror(errno));
+    close(listen_fd);
+    return 1;
+  }
+
+  string latest;
+  long long interval_ms = interval_secs * 1000LL;
+  long long next_sample = now_ms();
+  while (true) {
+    long long now = now_ms();
+    if (now >= next_sample) {
+      take_sample(ring, latest);
+      next_sample += interval_ms;
+      if (next_sample <= now) {
+        // We fell more than an interval behind (e.g. the device suspended);
+        // don't try to catch up.
+        next_sample = now + interval_ms;
+      }
+    }
+
+    struct pollfd pfd;
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int timeout = (int) max(next_sample - now_ms(), 0LL);
+    if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN)) {
+      serve_client(listen_fd, ring, latest);
+    }
+  }
+}
+
+int
+print_daemon_latest()
+{
+  SampleRing ring;
+  if (!ring.open(DAEMON_RING_PATH)) {
+    return 1;
+  }
+
+  string sample;
+  if (!ring.read_latest(sample)) {
+    if (!ring.num_published()) {
+      fputs("The b2g-info daemon hasn't published a sample yet.\n", stderr);
+    } else {
+      fputs("Couldn't read the latest sample; the b2g-info daemon may have "
+            "died while writing it.\n", stderr);
+    }
+    return 1;
+  }
+  fwrite(sample.data(), 1, sample.size(), stdout);
+  return 0;
+}
+
+int
+print_daemon_reply(const char* command)
+{
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    perror("Couldn't create socket");
+    return 1;
+  }
+
+  struct sockaddr_un addr;
+  make_socket_addr(addr);
+  if (TEMP_FAILURE_RETRY(connect(fd, (struct sockaddr*) &addr, sizeof(addr))) == -1) {
+    fprintf(stderr, "Couldn't connect to %s (is the b2g-info daemon running?): %s\n",
+            DAEMON_SOCKET_PATH, strerror(errno));
+    close(fd);
+    return 1;
+  }
+
+  string request = string(command) + "\n";
+  if (!write_all(fd, request.data(), request.size())) {
+    perror("Couldn't send request");
+    close(fd);
+    return 1;
+  }
+
+  char buf[4096];
+  ssize_t nread;
+  while ((nread = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)))) > 0) {
+    fwrite(buf, 1, nread, stdout);
+  }
+  close(fd);
+  return nread == 0 ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/**
+ * b2g-info --daemon takes a Sample every few seconds and publishes it in a
+ * SampleRing at DAEMON_RING_PATH.  It also answers requests on the Unix
+ * socket at DAEMON_SOCKET_PATH: a client sends one of
+ *
+ *   latest\n   the last sample the daemon took
+ *   sample\n   a sample taken now (which is also published)
+ *
+ * and reads the sample (see Sample::serialize) until the daemon closes the
+ * connection.
+ *
+ * Both live in tmpfs, so reading them costs no disk I/O.
+ */
+#define DAEMON_RING_PATH "/dev/b2g-info-samples"
+#define DAEMON_SOCKET_PATH "/dev/socket/b2g-info"
+
+/**
+ * Sample every |interval_secs| seconds until we're killed.  Returns 1 after
+ * printing an error if we can't start.
+ */
+int run_daemon(int interval_secs);
+
+/**
+ * Print the latest sample from the daemon's ring, without touching /proc.
+ */
+int print_daemon_latest();
+
+/**
+ * Ask the daemon for |command| (e.g. "sample") over its socket, and print
+ * what it replies.
+ */
+int print_daemon_reply(const char* command);
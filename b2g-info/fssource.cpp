@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fssource.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+static FsSource::Counters sCounters[FsSource::NUM_CATEGORIES];
+
+/* static */ const char*
+FsSource::category_name(Category category)
+{
+  switch (category) {
+    case CAT_STAT:    return "stat";
+    case CAT_SMAPS:   return "smaps";
+    case CAT_EXE:     return "exe";
+    case CAT_OOM:     return "oom_*";
+    case CAT_MEMINFO: return "meminfo";
+    case CAT_LMK:     return "lmk";
+    case CAT_DIRS:    return "dirs";
+    case CAT_OTHER:   return "other";
+    default:          return "?";
+  }
+}
+
+void
+FsSource::Counters::add(const Counters& other)
+{
+  opens += other.opens;
+  reads += other.reads;
+  bytes_read += other.bytes_read;
+  readlinks += other.readlinks;
+  dirs_listed += other.dirs_listed;
+  stats += other.stats;
+  ns += other.ns;
+}
+
+/* static */ const FsSource::Counters&
+FsSource::counters(Category category)
+{
+  return sCounters[category];
+}
+
+/* static */ FsSource::Counters
+FsSource::total_counters()
+{
+  Counters total;
+  for (int i = 0; i < NUM_CATEGORIES; i++) {
+    total.add(sCounters[i]);
+  }
+  return total;
+}
+
+/**
+ * The counters for the file at |path|.
+ */
+static FsSource::Counters&
+counters_for(const char* path)
+{
+  const char* slash = strrchr(path, '/');
+  const char* name = slash ? slash + 1 : path;
+
+  FsSource::Category category = FsSource::CAT_OTHER;
+  if (!strcmp(name, "stat")) {
+    category = FsSource::CAT_STAT;
+  } else if (!strcmp(name, "smaps")) {
+    category = FsSource::CAT_SMAPS;
+  } else if (!strcmp(name, "exe")) {
+    category = FsSource::CAT_EXE;
+  } else if (!strncmp(name, "oom_", 4)) {
+    category = FsSource::CAT_OOM;
+  } else if (!strcmp(path, "/proc/meminfo")) {
+    category = FsSource::CAT_MEMINFO;
+  } else if (!strncmp(path, "/sys/module/lowmemorykiller/", 28)) {
+    category = FsSource::CAT_LMK;
+  }
+  return sCounters[category];
+}
+
+static long long
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Adds the time until it goes out of scope to |counters|.
+ */
+class IoTimer
+{
+public:
+  IoTimer(FsSource::Counters& counters)
+    : m_counters(counters)
+    , m_start(now_ns())
+  {}
+
+  ~IoTimer()
+  {
+    m_counters.ns += now_ns() - m_start;
+  }
+
+private:
+  FsSource::Counters& m_counters;
+  long long m_start;
+};
+
+LineReader::LineReader(string& buf)
+{
+  // Make sure the last line is NUL-terminated, too.
+  buf.push_back('\0');
+  m_pos = &buf[0];
+  m_end = m_pos + buf.size() - 1;
+}
+
+const char*
+LineReader::next()
+{
+  if (m_pos >= m_end) {
+    return NULL;
+  }
+  char* line = m_pos;
+  char* newline = (char*) memchr(m_pos, '\n', m_end - m_pos);
+  if (newline) {
+    *newline = '\0';
+    m_pos = newline + 1;
+  } else {
+    m_pos = m_end;
+  }
+  return line;
+}
+
+static bool
+read_fd(int fd, string& contents, FsSource::Counters& counters)
+{
+  contents.clear();
+  char buf[4096];
+  while (true) {
+    ssize_t nread = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)));
+    counters.reads++;
+    if (nread == -1) {
+      return false;
+    }
+    if (nread == 0) {
+      return true;
+    }
+    counters.bytes_read += nread;
+    contents.append(buf, nread);
+  }
+}
+
+/**
+ * |name| is the path we count the calls against, which differs from |path|
+ * for a DirSource.
+ */
+static bool
+read_path(const char* path, const char* name, string& contents)
+{
+  FsSource::Counters& counters = counters_for(name);
+  IoTimer timer(counters);
+
+  int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY));
+  counters.opens++;
+  if (fd == -1) {
+    return false;
+  }
+  bool ok = read_fd(fd, contents, counters);
+  int saved_errno = errno;
+  TEMP_FAILURE_RETRY(close(fd));
+  errno = saved_errno;
+  return ok;
+}
+
+static bool
+read_link_path(const char* path, const char* name, string& target)
+{
+  FsSource::Counters& counters = counters_for(name);
+  IoTimer timer(counters);
+
+  char buf[256];
+  ssize_t len = readlink(path, buf, sizeof(buf) - 1);
+  counters.readlinks++;
+  if (len == -1) {
+    return false;
+  }
+  target.assign(buf, len);
+  return true;
+}
+
+static bool
+list_dir_path(const char* path, vector<string>& names)
+{
+  FsSource::Counters& counters = sCounters[FsSource::CAT_DIRS];
+  IoTimer timer(counters);
+
+  DIR* dir = safe_opendir(path);
+  counters.dirs_listed++;
+  if (!dir) {
+    return false;
+  }
+  names.clear();
+  dirent* de;
+  while ((de = readdir(dir))) {
+    if (strcmp(de->d_name, ".") && strcmp(de->d_name, "..")) {
+      names.push_back(de->d_name);
+    }
+  }
+  closedir(dir);
+  return true;
+}
+
+/**
+ * The filesystem we're running on.
+ */
+class LiveSource : public FsSource
+{
+public:
+  virtual bool is_live() { return true; }
+
+  virtual bool read_file(const char* path, string& contents)
+  {
+    return read_path(path, path, contents);
+  }
+
+  virtual bool read_link(const char* path, string& target)
+  {
+    return read_link_path(path, path, target);
+  }
+
+  virtual bool list_dir(const char* path, vector<string>& names)
+  {
+    return list_dir_path(path, names);
+  }
+
+  virtual bool get_uid(const char* path, uid_t* uid)
+  {
+    FsSource::Counters& counters = counters_for(path);
+    IoTimer timer(counters);
+    struct stat st;
+    counters.stats++;
+    if (stat(path, &st) == -1) {
+      return false;
+    }
+    *uid = st.st_uid;
+    return true;
+  }
+};
+
+/**
+ * A capture which has been extracted into a directory; /proc/1/stat is at
+ * <root>/proc/1/stat.
+ */
+class DirSource : public FsSource
+{
+public:
+  DirSource(const char* root)
+    : m_root(root)
+  {}
+
+  virtual bool read_file(const char* path, string& contents)
+  {
+    return read_path((m_root + path).c_str(), path, contents);
+  }
+
+  virtual bool read_link(const char* path, string& target)
+  {
+    return read_link_path((m_root + path).c_str(), path, target);
+  }
+
+  virtual bool list_dir(const char* path, vector<string>& names)
+  {
+    return list_dir_path((m_root + path).c_str(), names);
+  }
+
+  virtual bool get_uid(const char* path, uid_t* uid)
+  {
+    FsSource::Counters& counters = counters_for(path);
+    IoTimer timer(counters);
+    struct stat st;
+    counters.stats++;
+    if (lstat((m_root + path).c_str(), &st) == -1) {
+      return false;
+    }
+    *uid = st.st_uid;
+    return true;
+  }
+
+private:
+  string m_root;
+};
+
+/**
+ * A tar file written by --capture (or any other ustar file), which we read
+ * into memory in one go.
+ */
+class TarSource : public FsSource
+{
+public:
+  /**
+   * Read the tar file at |path|.  Returns false if it's not one.
+   */
+  bool load(const char* path);
+
+  virtual bool read_file(const char* path, string& contents)
+  {
+    const Entry* e = find(path, REGULAR);
+    if (e) {
+      contents = e->data;
+    }
+    return e;
+  }
+
+  virtual bool read_link(const char* path, string& target)
+  {
+    const Entry* e = find(path, SYMLINK);
+    if (e) {
+      target = e->data;
+    }
+    return e;
+  }
+
+  virtual bool list_dir(const char* path, vector<string>& names)
+  {
+    map<string, set<string> >::const_iterator it = m_dirs.find(normalize(path));
+    if (it == m_dirs.end()) {
+      errno = ENOENT;
+      return false;
+    }
+    names.assign(it->second.begin(), it->second.end());
+    return true;
+  }
+
+  virtual bool get_uid(const char* path, uid_t* uid)
+  {
+    map<string, Entry>::const_iterator it = m_entries.find(normalize(path));
+    if (it == m_entries.end()) {
+      errno = ENOENT;
+      return false;
+    }
+    *uid = it->second.uid;
+    return true;
+  }
+
+private:
+  enum Type {
+    REGULAR,
+    SYMLINK,
+    DIRECTORY
+  };
+
+  struct Entry
+  {
+    Type type;
+    uid_t uid;
+    // The file's contents, or a symlink's target.
+    string data;
+  };
+
+  const Entry* find(const char* path, Type type)
+  {
+    map<string, Entry>::const_iterator it = m_entries.find(normalize(path));
+    if (it == m_entries.end() || it->second.type != type) {
+      errno = ENOENT;
+      return NULL;
+    }
+    return &it->second;
+  }
+
+  static string normalize(const string& path);
+  void add(const string& path, const Entry& entry);
+
+  map<string, Entry> m_entries;
+  map<string, set<string> > m_dirs;
+};
+
+static long long
+parse_octal(const char* field, size_t len)
+{
+  string s(field, strnlen(field, len));
+  return strtoll(s.c_str(), NULL, 8);
+}
+
+/**
+ * Make names like "./proc/1/stat", "/proc/1//stat", and "proc/1/" into
+ * "/proc/1/stat" and "/proc/1", as the kernel would.
+ */
+/* static */ string
+TarSource::normalize(const string& path)
+{
+  string result = "/";
+  size_t pos = 0;
+  while (pos < path.size()) {
+    size_t end = path.find('/', pos);
+    if (end == string::npos) {
+      end = path.size();
+    }
+    if (end > pos && path.compare(pos, end - pos, ".")) {
+      if (result.size() > 1) {
+        result += '/';
+      }
+      result.append(path, pos, end - pos);
+    }
+    pos = end + 1;
+  }
+  return result;
+}
+
+void
+TarSource::add(const string& name, const Entry& entry)
+{
+  string path = normalize(name);
+  if (path == "/") {
+    return;
+  }
+
+  m_entries[path] = entry;
+
+  // Tar files needn't list every directory, so register each entry with
+  // all of its parents.
+  string child = path;
+  while (child.size() > 1) {
+    size_t slash = child.rfind('/');
+    string parent = slash ? child.substr(0, slash) : "/";
+    m_dirs[parent].insert(child.substr(slash + 1));
+    child = parent;
+  }
+  if (entry.type == DIRECTORY) {
+    m_dirs[path];
+  }
+}
+
+bool
+TarSource::load(const char* path)
+{
+  string tar;
+  if (!read_path(path, path, tar)) {
+    return false;
+  }
+
+  string long_name;
+  size_t pos = 0;
+  while (pos + 512 <= tar.size()) {
+    const char* header = tar.data() + pos;
+    if (!header[0]) {
+      // A zero block ends the archive.
+      break;
+    }
+    if (memcmp(header + 257, "ustar", 5)) {
+      errno = EINVAL;
+      return false;
+    }
+
+    long long size = parse_octal(header + 124, 12);
+    char typeflag = header[156];
+    pos += 512;
+    if (size < 0 || pos + size > tar.size()) {
+      errno = EINVAL;
+      return false;
+    }
+    string data(tar, pos, size);
+    pos += (size + 511) / 512 * 512;
+
+    if (typeflag == 'L') {
+      // GNU tar puts names longer than 100 characters in an entry of their
+      // own, just before the entry they name.
+      long_name.assign(data.c_str());
+      continue;
+    }
+
+    string name;
+    if (!long_name.empty()) {
+      name.swap(long_name);
+    } else {
+      string prefix(header + 345, strnlen(header + 345, 155));
+      name.assign(header, strnlen(header, 100));
+      if (!prefix.empty()) {
+        name = prefix + "/" + name;
+      }
+    }
+
+    Entry e;
+    e.uid = parse_octal(header + 108, 8);
+    if (typeflag == '0' || typeflag == '\0') {
+      e.type = REGULAR;
+      e.data.swap(data);
+    } else if (typeflag == '2') {
+      e.type = SYMLINK;
+      e.data.assign(header + 157, strnlen(header + 157, 100));
+    } else if (typeflag == '5') {
+      e.type = DIRECTORY;
+    } else {
+      continue;
+    }
+    add(name, e);
+  }
+  return true;
+}
+
+static FsSource* sCurrent = NULL;
+
+/* static */ FsSource&
+FsSource::current()
+{
+  if (!sCurrent) {
+    sCurrent = new LiveSource();
+  }
+  return *sCurrent;
+}
+
+/* static */ void
+FsSource::set_current(FsSource* source)
+{
+  delete sCurrent;
+  sCurrent = source;
+}
+
+/* static */ FsSource*
+FsSource::open_capture(const char* path)
+{
+  struct stat st;
+  if (stat(path, &st) == -1) {
+    perror(path);
+    return NULL;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    return new DirSource(path);
+  }
+
+  TarSource* tar = new TarSource();
+  if (!tar->load(path)) {
+    fprintf(stderr, "Couldn't read %s as a tar file: %s\n", path, strerror(errno));
+    delete tar;
+    return NULL;
+  }
+  return tar;
+}
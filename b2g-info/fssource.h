@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+/**
+ * Where b2g-info reads /proc, /sys, and its other inputs from.
+ *
+ * Every reader asks FsSource::current() for files by their path on the
+ * device (e.g. "/proc/1/smaps").  Normally that's the live filesystem, but
+ * with --root it's a directory tree or a tar file captured from a device
+ * with --capture, so we can look at a field device's state offline, or run
+ * the parsers on a workstation.
+ *
+ * All methods return false and set errno (ENOENT if the path isn't there)
+ * on failure.
+ */
+class FsSource
+{
+public:
+  virtual ~FsSource() {}
+
+  /**
+   * The kinds of file we count system calls for, by name (e.g. both
+   * /proc/<pid>/stat and /proc/<pid>/task/<tid>/stat are CAT_STAT).  All
+   * directory listings are CAT_DIRS.
+   */
+  enum Category {
+    CAT_STAT,
+    CAT_SMAPS,
+    CAT_EXE,
+    CAT_OOM,
+    CAT_MEMINFO,
+    CAT_LMK,
+    CAT_DIRS,
+    CAT_OTHER,
+    NUM_CATEGORIES
+  };
+
+  static const char* category_name(Category category);
+
+  /**
+   * The system calls FsSources have made so far, and how long they took.  A
+   * tar capture is read into memory up front, so reading from one doesn't
+   * count.
+   */
+  struct Counters
+  {
+    Counters()
+      : opens(0)
+      , reads(0)
+      , bytes_read(0)
+      , readlinks(0)
+      , dirs_listed(0)
+      , stats(0)
+      , ns(0)
+    {}
+
+    void add(const Counters& other);
+
+    long long opens;
+    long long reads;
+    long long bytes_read;
+    long long readlinks;
+    // Each takes an open, a close, and getdents() calls for every few KB of
+    // entries.
+    long long dirs_listed;
+    long long stats;
+    // Time spent in the calls above (not in parsing what they returned).
+    long long ns;
+  };
+
+  static const Counters& counters(Category category);
+
+  /**
+   * The sum of counters() over all categories.
+   */
+  static Counters total_counters();
+
+  /**
+   * The source all readers use.
+   */
+  static FsSource& current();
+
+  /**
+   * Make |source| the current source.  We take ownership of it.
+   */
+  static void set_current(FsSource* source);
+
+  /**
+   * Open a captured directory tree or tar file, or print an error and
+   * return NULL.
+   */
+  static FsSource* open_capture(const char* path);
+
+  /**
+   * Is this the filesystem of the machine we're running on?  Modes which do
+   * more than read files (e.g. --working-set) need one.
+   */
+  virtual bool is_live() { return false; }
+
+  /**
+   * Replace |contents| with the contents of the file at |path|.
+   */
+  virtual bool read_file(const char* path, std::string& contents) = 0;
+
+  virtual bool read_link(const char* path, std::string& target) = 0;
+
+  /**
+   * Replace |names| with the names of the entries in directory |path|,
+   * excluding "." and "..".
+   */
+  virtual bool list_dir(const char* path, std::vector<std::string>& names) = 0;
+
+  /**
+   * Get the owner of |path|.  (A capture doesn't keep the rest of struct
+   * stat.)
+   */
+  virtual bool get_uid(const char* path, uid_t* uid) = 0;
+};
+
+/**
+ * Splits a buffer returned by FsSource::read_file into lines, in place.
+ *
+ *   string contents;
+ *   FsSource::current().read_file("/proc/meminfo", contents);
+ *   LineReader lines(contents);
+ *   while (const char* line = lines.next()) ...
+ *
+ * The lines don't include their '\n'.
+ */
+class LineReader
+{
+public:
+  LineReader(std::string& buf);
+
+  /**
+   * Get the next line, or NULL at the end of the buffer.
+   */
+  const char* next();
+
+private:
+  char* m_pos;
+  char* m_end;
+};
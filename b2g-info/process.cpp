@@ -15,10 +15,13 @@
  */
 
 #include "process.h"
+#include "fssource.h"
+#include <algorithm>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <pwd.h>
+#include <stdio.h>
 #include <sys/stat.h>
 
 using namespace std;
@@ -28,10 +31,24 @@ Task::Task(pid_t pid)
   , m_got_stat(false)
   , m_ppid(-1)
   , m_nice(0)
+  , m_start_time(0)
+  , m_minflt(-1)
+  , m_majflt(-1)
+  , m_got_io(false)
+  , m_read_bytes(-1)
+  , m_write_bytes(-1)
+  , m_got_sched(false)
+  , m_run_ns(-1)
+  , m_runqueue_ns(-1)
+  , m_timeslices(-1)
+  , m_voluntary_switches(-1)
+  , m_involuntary_switches(-1)
 {
   char procdir[128];
   snprintf(procdir, sizeof(procdir), "/proc/%d/", pid);
   m_proc_dir = procdir;
+  snprintf(procdir, sizeof(procdir), "/proc/%d/task/%d/", pid, pid);
+  m_thread_dir = procdir;
 }
 
 Task::Task(pid_t pid, pid_t tid)
@@ -39,10 +56,23 @@ Task::Task(pid_t pid, pid_t tid)
   , m_got_stat(false)
   , m_ppid(-1)
   , m_nice(0)
+  , m_start_time(0)
+  , m_minflt(-1)
+  , m_majflt(-1)
+  , m_got_io(false)
+  , m_read_bytes(-1)
+  , m_write_bytes(-1)
+  , m_got_sched(false)
+  , m_run_ns(-1)
+  , m_runqueue_ns(-1)
+  , m_timeslices(-1)
+  , m_voluntary_switches(-1)
+  , m_involuntary_switches(-1)
 {
   char procdir[128];
   snprintf(procdir, sizeof(procdir), "/proc/%d/task/%d/", pid, tid);
   m_proc_dir = procdir;
+  m_thread_dir = procdir;
 }
 
 pid_t
@@ -72,6 +102,125 @@ Task::nice()
   return m_nice;
 }
 
+unsigned long long
+Task::start_time()
+{
+  ensure_got_stat();
+  return m_start_time;
+}
+
+long long
+Task::minflt()
+{
+  ensure_got_stat();
+  return m_minflt;
+}
+
+long long
+Task::majflt()
+{
+  ensure_got_stat();
+  return m_majflt;
+}
+
+long long
+Task::read_bytes()
+{
+  ensure_got_io();
+  return m_read_bytes;
+}
+
+long long
+Task::write_bytes()
+{
+  ensure_got_io();
+  return m_write_bytes;
+}
+
+long long
+Task::run_ns()
+{
+  ensure_got_sched();
+  return m_run_ns;
+}
+
+long long
+Task::runqueue_ns()
+{
+  ensure_got_sched();
+  return m_runqueue_ns;
+}
+
+long long
+Task::timeslices()
+{
+  ensure_got_sched();
+  return m_timeslices;
+}
+
+long long
+Task::voluntary_switches()
+{
+  ensure_got_sched();
+  return m_voluntary_switches;
+}
+
+long long
+Task::involuntary_switches()
+{
+  ensure_got_sched();
+  return m_involuntary_switches;
+}
+
+void
+Task::ensure_got_sched()
+{
+  if (m_got_sched) {
+    return;
+  }
+  m_got_sched = true;
+
+  string contents;
+  if (FsSource::current().read_file((m_thread_dir + "schedstat").c_str(), contents) &&
+      sscanf(contents.c_str(), "%lld %lld %lld",
+             &m_run_ns, &m_runqueue_ns, &m_timeslices) != 3) {
+    m_run_ns = m_runqueue_ns = m_timeslices = -1;
+  }
+
+  if (!FsSource::current().read_file((m_thread_dir + "status").c_str(), contents)) {
+    return;
+  }
+
+  // The switch counts are the last lines of the file.
+  LineReader lines(contents);
+  while (const char* line = lines.next()) {
+    if (sscanf(line, "voluntary_ctxt_switches: %lld", &m_voluntary_switches) != 1) {
+      sscanf(line, "nonvoluntary_ctxt_switches: %lld", &m_involuntary_switches);
+    }
+  }
+}
+
+void
+Task::ensure_got_io()
+{
+  if (m_got_io) {
+    return;
+  }
+  m_got_io = true;
+
+  string contents;
+  if (!FsSource::current().read_file((m_proc_dir + "io").c_str(), contents)) {
+    return;
+  }
+
+  LineReader lines(contents);
+  while (const char* line = lines.next()) {
+    if (sscanf(line, "read_bytes: %lld", &m_read_bytes) != 1) {
+      sscanf(line, "write_bytes: %lld", &m_write_bytes);
+    }
+  }
+}
+
 void
 Task::ensure_got_stat()
 {
@@ -87,8 +236,8 @@ Task::ensure_got_stat()
   // once.
   m_got_stat = true;
 
-  FILE* stat_file = fopen(filename, "r");
-  if (!stat_file) {
+  string contents;
+  if (!FsSource::current().read_file(filename, contents)) {
     // We expect ENOENT; that indicates that the file doesn't exist (maybe the
     // process exited or something).  If we get anything else, print a warning
     // to the console.
@@ -101,8 +250,10 @@ Task::ensure_got_stat()
   int pid2, ppid;
   char comm[32];
   long int niceness;
+  long long minflt, majflt;
+  unsigned long long start_time = 0;
   int nread =
-    fscanf(stat_file,
+    sscanf(contents.c_str(),
            "%d "   // pid
            "%17[^)]) "// comm
            "%*c "  // state
@@ -112,22 +263,24 @@ Task::ensure_got_stat()
            "%*d "  // tty_nr
            "%*d "  // tpgid
            "%*u "  // flags
-           "%*u "  // minflt (%lu)
+           "%lld " // minflt (%lu)
            "%*u "  // cminflt (%lu)
-           "%*u "  // majflt (%lu)
+           "%lld " // majflt (%lu)
            "%*u "  // cmajflt (%lu)
            "%*u "  // utime (%lu)
            "%*u "  // stime (%ld)
            "%*d "  // cutime (%ld)
            "%*d "  // cstime (%ld)
            "%*d "  // priority (%ld)
-           "%ld ", // niceness
-           &pid2, comm, &ppid, &niceness);
-
-  fclose(stat_file);
-
-  if (nread != 4) {
-    fprintf(stderr, "Expected to read 4 fields from fscanf(%s), but got %d.\n",
+           "%ld "  // niceness
+           "%*d "  // num_threads (%ld)
+           "%*d "  // itrealvalue (%ld)
+           "%llu", // starttime
+           &pid2, comm, &ppid, &minflt, &majflt, &niceness, &start_time);
+
+  // Don't insist on starttime; nothing needs it to print a table.
+  if (nread != 6 && nread != 7) {
+    fprintf(stderr, "Expected to read 6 fields from sscanf(%s), but got %d.\n",
             filename, nread);
     return;
   }
@@ -142,6 +295,9 @@ Task::ensure_got_stat()
 
   m_ppid = ppid;
   m_nice = niceness;
+  m_start_time = start_time;
+  m_minflt = minflt;
+  m_majflt = majflt;
 
   if (comm[0] != '\0') {
     // If comm is non-empty, it should start with a paren, which we strip off.
@@ -171,14 +327,57 @@ Process::Process(pid_t pid)
   , m_rss_kb(-1)
   , m_pss_kb(-1)
   , m_uss_kb(-1)
+  , m_swap_kb(-1)
+  , m_swap_pss_kb(-1)
+  , m_got_shared_buffers(false)
 {}
 
+Process::~Process()
+{
+  for (size_t i = 0; i < m_threads.size(); i++) {
+    delete m_threads[i];
+  }
+}
+
 pid_t
 Process::pid()
 {
   return m_pid;
 }
 
+void
+Process::refresh()
+{
+  // The ensure_got_* functions leave a field alone if they can't read it, so
+  // reset everything they fill in; a task we can't read now shows up as
+  // unknown rather than with its old values.
+  m_got_stat = false;
+  m_ppid = -1;
+  m_nice = 0;
+  m_start_time = 0;
+  m_minflt = m_majflt = -1;
+  m_got_io = false;
+  m_read_bytes = m_write_bytes = -1;
+  m_got_sched = false;
+  m_run_ns = m_runqueue_ns = m_timeslices = -1;
+  m_voluntary_switches = m_involuntary_switches = -1;
+  m_got_meminfo = false;
+  m_vsize_kb = m_rss_kb = m_pss_kb = m_uss_kb = m_swap_kb = m_swap_pss_kb = -1;
+
+  for (size_t i = 0; i < m_threads.size(); i++) {
+    delete m_threads[i];
+  }
+  m_threads.clear();
+  m_got_threads = false;
+
+  m_shared_buffers.clear();
+  m_got_shared_buffers = false;
+
+  m_exe.clear();
+  m_got_exe = false;
+  m_user.clear();
+}
+
 const vector<Thread*>&
 Process::threads()
 {
@@ -188,21 +387,18 @@ Process::threads()
 
   m_got_threads = true;
 
-  DIR* tasks = safe_opendir((m_proc_dir + "task").c_str());
-  if (!tasks) {
+  vector<string> tids;
+  if (!FsSource::current().list_dir((m_proc_dir + "task").c_str(), tids)) {
     return m_threads;
   }
 
-  dirent *de;
-  while ((de = readdir(tasks))) {
+  for (vector<string>::const_iterator it = tids.begin(); it != tids.end(); ++it) {
     int tid;
-    if (str_to_int(de->d_name, &tid) && tid != pid()) {
+    if (str_to_int(*it, &tid) && tid != pid()) {
       m_threads.push_back(new Thread(m_pid, tid));
     }
   }
 
-  closedir(tasks);
-
   return m_threads;
 }
 
@@ -216,18 +412,12 @@ Process::exe()
   char filename[128];
   snprintf(filename, sizeof(filename), "/proc/%d/exe", pid());
 
-  char link[128];
-  ssize_t link_length = readlink(filename, link, sizeof(link) - 1);
-  if (link_length == -1) {
+  if (!FsSource::current().read_link(filename, m_exe)) {
     // Maybe this process doesn't exist anymore, or maybe |exe| is a broken
     // link.  If so, that's OK; just let m_exe be the empty string.
-    link[0] = '\0';
-  } else {
-    link[link_length] = '\0';
+    m_exe.clear();
   }
 
-  m_exe = link;
-
   m_got_exe = true;
   return m_exe;
 }
@@ -240,21 +430,11 @@ Process::get_int_file(const char* name)
   char filename[128];
   snprintf(filename, sizeof(filename), "/proc/%d/%s", pid(), name);
 
-  int fd = TEMP_FAILURE_RETRY(open(filename, O_RDONLY));
-  if (fd == -1) {
-    return -1;
-  }
-
-  char buf[32];
-  int nread = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf) - 1));
-  TEMP_FAILURE_RETRY(close(fd));
-
-  if (nread == -1) {
+  string contents;
+  if (!FsSource::current().read_file(filename, contents)) {
     return -1;
   }
-
-  buf[nread] = '\0';
-  return str_to_int(buf, -1);
+  return str_to_int(contents, -1);
 }
 
 int
@@ -297,15 +477,15 @@ Process::ensure_got_meminfo()
 
   char filename[128];
   snprintf(filename, sizeof(filename), "/proc/%d/smaps", pid());
-  FILE *f = fopen(filename, "r");
-  if (!f) {
+  string contents;
+  if (!FsSource::current().read_file(filename, contents)) {
     return;
   }
 
-  m_vsize_kb = m_rss_kb = m_pss_kb = m_uss_kb = 0;
+  m_vsize_kb = m_rss_kb = m_pss_kb = m_uss_kb = m_swap_kb = 0;
 
-  char line[256];
-  while(fgets(line, sizeof(line), f)) {
+  LineReader lines(contents);
+  while (const char* line = lines.next()) {
       int val = 0;
       if (sscanf(line, "Size: %d kB", &val) == 1) {
         m_vsize_kb += val;
@@ -316,10 +496,12 @@ Process::ensure_got_meminfo()
       } else if (sscanf(line, "Private_Dirty: %d kB", &val) == 1 ||
                  sscanf(line, "Private_Clean: %d kB", &val) == 1) {
         m_uss_kb += val;
+      } else if (sscanf(line, "Swap: %d kB", &val) == 1) {
+        m_swap_kb += val;
+      } else if (sscanf(line, "SwapPss: %d kB", &val) == 1) {
+        m_swap_pss_kb = max(m_swap_pss_kb, 0) + val;
       }
   }
-
-  fclose(f);
 }
 
 int
@@ -350,6 +532,30 @@ Process::uss_kb()
   return m_uss_kb;
 }
 
+int
+Process::swap_kb()
+{
+  ensure_got_meminfo();
+  return m_swap_kb;
+}
+
+int
+Process::swap_pss_kb()
+{
+  ensure_got_meminfo();
+  return m_swap_pss_kb;
+}
+
+const vector<SharedBuffer>&
+Process::shared_buffers()
+{
+  if (!m_got_shared_buffers) {
+    m_got_shared_buffers = true;
+    read_shared_buffers(m_pid, m_shared_buffers);
+  }
+  return m_shared_buffers;
+}
+
 const string&
 Process::user()
 {
@@ -360,19 +566,19 @@ Process::user()
   char filename[128];
   snprintf(filename, sizeof(filename), "/proc/%d", pid());
 
-  struct stat st;
-  if (stat(filename, &st) == -1) {
+  uid_t uid;
+  if (!FsSource::current().get_uid(filename, &uid)) {
     m_user = "?";
     return m_user;
   }
 
-  passwd* pw = getpwuid(st.st_uid);
+  passwd* pw = getpwuid(uid);
   if (pw) {
     m_user = pw->pw_name;
   } else {
-    char uid[32];
-    snprintf(uid, sizeof(uid), "%lu", st.st_uid);
-    m_user = uid;
+    char uid_str[32];
+    snprintf(uid_str, sizeof(uid_str), "%lu", (unsigned long) uid);
+    m_user = uid_str;
   }
 
   return m_user;
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "sharedbuffers.h"
 #include "utils.h"
 #include <string>
 #include <vector>
@@ -47,11 +48,47 @@ public:
    */
   pid_t task_id();
 
+  /**
+   * When this task started, in clock ticks since boot, or 0 if we can't tell.
+   * Together with task_id() this identifies a task even if its id is reused.
+   */
+  unsigned long long start_time();
+
+  /**
+   * Minor and major page faults this task has taken since it started, or -1
+   * if we can't tell.
+   */
+  long long minflt();
+  long long majflt();
+
+  /**
+   * Bytes this task has caused to be read from and written to storage
+   * (including paging in file-backed memory), from /proc/<pid>/io.  -1 if we
+   * can't tell (e.g. because we're not root).
+   */
+  long long read_bytes();
+  long long write_bytes();
+
+  /**
+   * Time this thread has spent running and waiting on a runqueue, in ns, and
+   * how many timeslices it has run, from its schedstat; and its voluntary
+   * and involuntary context switches, from its status.  For a Process,
+   * these are its main thread's.  -1 if we can't tell (schedstat needs
+   * CONFIG_SCHED_INFO).
+   */
+  long long run_ns();
+  long long runqueue_ns();
+  long long timeslices();
+  long long voluntary_switches();
+  long long involuntary_switches();
+
 protected:
   Task(pid_t pid);
   Task(pid_t pid, pid_t tid);
 
   void ensure_got_stat();
+  void ensure_got_io();
+  void ensure_got_sched();
 
   pid_t m_task_id;
 
@@ -60,9 +97,29 @@ protected:
    */
   std::string m_proc_dir;
 
+  /**
+   * /proc/<pid>/task/<tid>/, which for a Process is its main thread's
+   * directory.
+   */
+  std::string m_thread_dir;
+
   bool m_got_stat;
   pid_t m_ppid;
   int m_nice;
+  unsigned long long m_start_time;
+  long long m_minflt;
+  long long m_majflt;
+
+  bool m_got_io;
+  long long m_read_bytes;
+  long long m_write_bytes;
+
+  bool m_got_sched;
+  long long m_run_ns;
+  long long m_runqueue_ns;
+  long long m_timeslices;
+  long long m_voluntary_switches;
+  long long m_involuntary_switches;
 
   std::string m_name;
 };
@@ -87,8 +144,18 @@ class Process : public Task
 {
 public:
   Process(pid_t pid);
+  ~Process();
   pid_t pid();
 
+  /**
+   * Forget everything we've cached, so that the next calls read the
+   * process's current state.  That includes exe() and user(): a child
+   * refreshed between fork and exec, or before it drops privileges, would
+   * otherwise keep its parent's.  Pointers returned by threads() become
+   * invalid.
+   */
+  void refresh();
+
   const std::vector<Thread*>& threads();
 
   /**
@@ -114,8 +181,24 @@ public:
   int uss_kb();
   double uss_mb() { return kb_to_mb(uss_kb()); }
 
+  /**
+   * Memory of this process which has been swapped out (e.g. to zram), and
+   * this process's proportional share of it.  SwapPss needs kernel 4.3 or
+   * later; on older kernels swap_pss_kb() returns -1.
+   */
+  int swap_kb();
+  double swap_mb() { return kb_to_mb(swap_kb()); }
+
+  int swap_pss_kb();
+  double swap_pss_mb() { return kb_to_mb(swap_pss_kb()); }
+
   const std::string& user();
 
+  /**
+   * dma-buf, ashmem, and gralloc buffers which this process holds.
+   */
+  const std::vector<SharedBuffer>& shared_buffers();
+
 private:
   void ensure_got_meminfo();
 
@@ -134,6 +217,11 @@ private:
   int m_rss_kb;
   int m_pss_kb;
   int m_uss_kb;
+  int m_swap_kb;
+  int m_swap_pss_kb;
 
   std::string m_user;
+
+  bool m_got_shared_buffers;
+  std::vector<SharedBuffer> m_shared_buffers;
 };
@@ -21,8 +21,12 @@
 
 #include "processlist.h"
 #include "process.h"
+#include "fssource.h"
 #include <assert.h>
-#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
 
 using namespace std;
 
@@ -47,27 +51,35 @@ ProcessList::all_processes()
 
   // Create a Process object for each pid in /proc.
 
-  DIR* proc = safe_opendir("/proc");
-  if (!proc) {
+  vector<string> names;
+  if (!FsSource::current().list_dir("/proc", names)) {
     perror("Error opening /proc");
     exit(2);
   }
 
-  dirent* de;
-  while ((de = readdir(proc))) {
+  for (vector<string>::const_iterator it = names.begin(); it != names.end(); ++it) {
     int pid;
-    if (str_to_int(de->d_name, &pid)) {
+    if (str_to_int(*it, &pid)) {
       m_all_processes.push_back(new Process(pid));
     }
   }
 
-  closedir(proc);
-
   return m_all_processes;
 }
 
 Process*
 ProcessList::main_process()
+{
+  if (!main_process_if_running()) {
+    fprintf(stderr, "Fatal error: B2G main process not found.\n");
+    exit(2);
+  }
+
+  return m_main_process;
+}
+
+Process*
+ProcessList::main_process_if_running()
 {
   if (m_main_process) {
     return m_main_process;
@@ -88,11 +100,6 @@ ProcessList::main_process()
     }
   }
 
-  if (!m_main_process) {
-    fprintf(stderr, "Fatal error: B2G main process not found.\n");
-    exit(2);
-  }
-
   return m_main_process;
 }
 
@@ -139,3 +146,52 @@ ProcessList::b2g_processes()
 
   return m_b2g_processes;
 }
+
+void
+ProcessList::refresh()
+{
+  map<pid_t, Process*> old_processes;
+  for (vector<Process*>::const_iterator it = m_all_processes.begin();
+       it != m_all_processes.end(); ++it) {
+    old_processes[(*it)->pid()] = *it;
+  }
+
+  m_main_process = NULL;
+  m_got_child_processes = false;
+  m_child_processes.clear();
+  m_b2g_processes.clear();
+  m_all_processes.clear();
+
+  vector<string> names;
+  if (!FsSource::current().list_dir("/proc", names)) {
+    perror("Error opening /proc");
+    exit(2);
+  }
+
+  for (vector<string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+    int pid;
+    if (!str_to_int(*it, &pid)) {
+      continue;
+    }
+
+    // Process::refresh() forgets everything it knew, so reusing the object
+    // is safe even if the pid now belongs to a different process.
+    Process* process;
+    map<pid_t, Process*>::iterator old = old_processes.find(pid);
+    if (old != old_processes.end()) {
+      process = old->second;
+      old_processes.erase(old);
+      process->refresh();
+    } else {
+      process = new Process(pid);
+    }
+
+    m_all_processes.push_back(process);
+  }
+
+  // Whatever's left has exited.
+  for (map<pid_t, Process*>::iterator it = old_processes.begin();
+       it != old_processes.end(); ++it) {
+    delete it->second;
+  }
+}
@@ -40,6 +40,12 @@ public:
    */
   Process* main_process();
 
+  /**
+   * Get the main B2G process, or NULL if it isn't running (e.g. while it
+   * restarts).  This still crashes if there are two.
+   */
+  Process* main_process_if_running();
+
   /**
    * Get all of the B2G child processes on the system.
    */
@@ -55,6 +61,21 @@ public:
    */
   const std::vector<Process*>& all_processes();
 
+  /**
+   * Forget the cached process lists and re-read /proc, for programs which
+   * watch the system over time.
+   *
+   * Processes which are still running keep their Process objects (refreshed
+   * with Process::refresh()), so we don't read every process's exe again.
+   * Pointers to processes which have exited become invalid.
+   *
+   * A B2G process whose pid is reused between refreshes is caught by its
+   * start time.  Other processes aren't checked, since that would cost a
+   * read of every process's stat; one whose pid is reused by a new B2G
+   * process will be missed until its pid is reused again.
+   */
+  void refresh();
+
 private:
   ProcessList();
 
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sample.h"
+#include "process.h"
+#include "processlist.h"
+#include <stdio.h>
+#include <time.h>
+
+using namespace std;
+
+bool
+read_system_meminfo(SystemMeminfo& meminfo)
+{
+  // We can't use sysinfo() here because iit doesn't tell us how much cached
+  // memory we're using.  (On B2G, this is often upwards of 30mb.)
+  //
+  // Instead, we have to parse /proc/meminfo.
+
+  string contents;
+  if (!FsSource::current().read_file("/proc/meminfo", contents)) {
+    perror("Couldn't open /proc/meminfo");
+    return false;
+  }
+
+  meminfo = SystemMeminfo();
+
+  // The swap fields come well after the first four, so we have to read the
+  // whole file.  Stop as soon as we have everything, though.
+  LineReader lines(contents);
+  const char* line;
+  int num_found = 0;
+  while(num_found < 6 && (line = lines.next())) {
+    if (sscanf(line, "MemTotal: %d kB", &meminfo.total_kb) == 1 ||
+        sscanf(line, "MemFree: %d kB", &meminfo.free_kb) == 1 ||
+        sscanf(line, "Buffers: %d kB", &meminfo.buffers_kb) == 1 ||
+        sscanf(line, "Cached: %d kB", &meminfo.cached_kb) == 1 ||
+        sscanf(line, "SwapTotal: %d kB", &meminfo.swap_total_kb) == 1 ||
+        sscanf(line, "SwapFree: %d kB", &meminfo.swap_free_kb) == 1) {
+      num_found++;
+    }
+  }
+
+  if (meminfo.total_kb == -1 || meminfo.free_kb == -1 ||
+      meminfo.buffers_kb == -1 || meminfo.cached_kb == -1) {
+    fprintf(stderr, "Unable to parse /proc/meminfo.\n");
+    return false;
+  }
+
+  return true;
+}
+
+ProcessSample::ProcessSample()
+  : pid(-1)
+  , ppid(-1)
+  , nice(0)
+  , oom_adj(-1)
+  , uss_kb(-1)
+  , pss_kb(-1)
+  , rss_kb(-1)
+  , vsize_kb(-1)
+  , swap_kb(-1)
+  , swap_pss_kb(-1)
+{}
+
+Sample::Sample()
+  : time_ms(0)
+  , cost_ns(0)
+{}
+
+static long long
+now_ns(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void
+Sample::collect()
+{
+  long long start_ns = now_ns(CLOCK_MONOTONIC);
+  FsSource::Counters start_io = FsSource::total_counters();
+
+  time_ms = now_ns(CLOCK_REALTIME) / 1000000;
+  ProcessList& list = ProcessList::singleton();
+  list.refresh();
+
+  if (!read_system_meminfo(meminfo)) {
+    meminfo = SystemMeminfo();
+  }
+
+  // B2G may be restarting; that's worth recording rather than dying over.
+  processes.clear();
+  if (list.main_process_if_running()) {
+    const vector<Process*>& b2g = list.b2g_processes();
+    processes.resize(b2g.size());
+    for (size_t i = 0; i < b2g.size(); i++) {
+      Process* p = b2g[i];
+      ProcessSample& s = processes[i];
+      s.pid = p->pid();
+      s.ppid = p->ppid();
+      s.nice = p->nice();
+      s.oom_adj = p->oom_adj();
+      s.uss_kb = p->uss_kb();
+      s.pss_kb = p->pss_kb();
+      s.rss_kb = p->rss_kb();
+      s.vsize_kb = p->vsize_kb();
+      s.swap_kb = p->swap_kb();
+      s.swap_pss_kb = p->swap_pss_kb();
+      s.name = p->name();
+    }
+  }
+
+  FsSource::Counters end_io = FsSource::total_counters();
+  cost.opens = end_io.opens - start_io.opens;
+  cost.reads = end_io.reads - start_io.reads;
+  cost.bytes_read = end_io.bytes_read - start_io.bytes_read;
+  cost.readlinks = end_io.readlinks - start_io.readlinks;
+  cost.dirs_listed = end_io.dirs_listed - start_io.dirs_listed;
+  cost.stats = end_io.stats - start_io.stats;
+  cost.ns = end_io.ns - start_io.ns;
+  cost_ns = now_ns(CLOCK_MONOTONIC) - start_ns;
+}
+
+void
+Sample::serialize(string& out) const
+{
+  char buf[256];
+  out.clear();
+
+  snprintf(buf, sizeof(buf), "time %lld\n", time_ms);
+  out += buf;
+
+  snprintf(buf, sizeof(buf), "meminfo %d %d %d %d %d %d\n",
+           meminfo.total_kb, meminfo.free_kb, meminfo.buffers_kb,
+           meminfo.cached_kb, meminfo.swap_total_kb, meminfo.swap_free_kb);
+  out += buf;
+
+  snprintf(buf, sizeof(buf), "cost %lld %lld %lld %lld %lld %lld %lld %lld\n",
+           cost.opens, cost.reads, cost.bytes_read, cost.readlinks,
+           cost.dirs_listed, cost.stats, cost.ns, cost_ns);
+  out += buf;
+
+  for (size_t i = 0; i < processes.size(); i++) {
+    const ProcessSample& p = processes[i];
+    snprintf(buf, sizeof(buf), "process %d %d %d %d %d %d %d %d %d %d ",
+             p.pid, p.ppid, p.nice, p.oom_adj, p.uss_kb, p.pss_kb, p.rss_kb,
+             p.vsize_kb, p.swap_kb, p.swap_pss_kb);
+    out += buf;
+    out += p.name;
+    out += '\n';
+  }
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "fssource.h"
+#include <string>
+#include <vector>
+
+/**
+ * The fields of /proc/meminfo we use, in kb.  Fields we couldn't find are -1.
+ */
+struct SystemMeminfo
+{
+  SystemMeminfo()
+    : total_kb(-1)
+    , free_kb(-1)
+    , buffers_kb(-1)
+    , cached_kb(-1)
+    , swap_total_kb(-1)
+    , swap_free_kb(-1)
+  {}
+
+  int total_kb;
+  int free_kb;
+  int buffers_kb;
+  int cached_kb;
+  int swap_total_kb;
+  int swap_free_kb;
+};
+
+/**
+ * Read /proc/meminfo into |meminfo|.  Returns false after printing an error
+ * if the file can't be read or lacks any of the first four fields.  (The
+ * swap fields are missing on kernels without swap support.)
+ */
+bool read_system_meminfo(SystemMeminfo& meminfo);
+
+/**
+ * One B2G process in a Sample.
+ */
+struct ProcessSample
+{
+  ProcessSample();
+
+  int pid;
+  int ppid;
+  int nice;
+  int oom_adj;
+  int uss_kb;
+  int pss_kb;
+  int rss_kb;
+  int vsize_kb;
+  int swap_kb;
+  int swap_pss_kb;
+  std::string name;
+};
+
+/**
+ * Everything b2g-info's default output shows, at one point in time, in a
+ * form that's cheap to keep and to pass to other programs.
+ */
+struct Sample
+{
+  Sample();
+
+  /**
+   * Refresh ProcessList::singleton() and fill this sample in from it.
+   * Between samples, the refresh only reads the exe of new processes.
+   */
+  void collect();
+
+  /**
+   * Replace |out| with this sample as text, one record per line:
+   *
+   *   time <ms since the epoch>
+   *   meminfo <total> <free> <buffers> <cached> <swap total> <swap free>
+   *   cost <opens> <reads> <bytes read> <readlinks> <dirs> <stats> <io ns> <ns>
+   *   process <pid> <ppid> <nice> <oom_adj> <uss> <pss> <rss> <vsize> <swap> <swap_pss> <name>
+   *   ...
+   *
+   * Memory is in kb and -1 means unknown.  |cost| is what collect() spent:
+   * the system calls it made, the time they took, and its total time.  The
+   * name goes last because it may contain spaces.
+   */
+  void serialize(std::string& out) const;
+
+  long long time_ms;
+  SystemMeminfo meminfo;
+  std::vector<ProcessSample> processes;
+  FsSource::Counters cost;
+  long long cost_ns;
+};
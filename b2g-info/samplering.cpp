@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "samplering.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char kMagic[8] = {'B', '2', 'G', 'R', 'I', 'N', 'G', '1'};
+
+// How long a reader waits for the writer to finish a slot before deciding
+// that it died while writing it: MAX_TRIES tries, RETRY_US apart.
+static const int MAX_TRIES = 1000;
+static const int RETRY_US = 100;
+
+struct SampleRing::Header
+{
+  char magic[8];
+  uint32_t num_slots;
+  uint32_t slot_size;
+  volatile uint32_t num_published;
+  uint32_t padding;
+};
+
+struct SampleRing::Slot
+{
+  volatile uint32_t seq;
+  uint32_t index;
+  uint32_t length;
+  char data[SLOT_SIZE - 3 * sizeof(uint32_t)];
+};
+
+SampleRing::SampleRing()
+  : m_header(NULL)
+  , m_size(sizeof(Header) + NUM_SLOTS * sizeof(Slot))
+{}
+
+SampleRing::~SampleRing()
+{
+  if (m_header) {
+    munmap(m_header, m_size);
+  }
+}
+
+bool
+SampleRing::create(const char* path)
+{
+  int fd = TEMP_FAILURE_RETRY(::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644));
+  if (fd == -1) {
+    fprintf(stderr, "Couldn't create %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  // The file starts out all zeroes: no samples, and every seq even.
+  if (ftruncate(fd, m_size) == -1) {
+    fprintf(stderr, "Couldn't size %s: %s\n", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  void* addr = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "Couldn't map %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  m_header = static_cast<Header*>(addr);
+  m_header->num_slots = NUM_SLOTS;
+  m_header->slot_size = sizeof(Slot);
+  __sync_synchronize();
+  memcpy(m_header->magic, kMagic, sizeof(kMagic));
+  return true;
+}
+
+bool
+SampleRing::open(const char* path)
+{
+  int fd = TEMP_FAILURE_RETRY(::open(path, O_RDONLY));
+  if (fd == -1) {
+    fprintf(stderr, "Couldn't open %s (is the b2g-info daemon running?): %s\n",
+            path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t) st.st_size != m_size) {
+    fprintf(stderr, "%s isn't a b2g-info sample ring.\n", path);
+    close(fd);
+    return false;
+  }
+
+  void* addr = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "Couldn't map %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  m_header = static_cast<Header*>(addr);
+  if (memcmp(m_header->magic, kMagic, sizeof(kMagic)) ||
+      m_header->num_slots != NUM_SLOTS || m_header->slot_size != sizeof(Slot)) {
+    fprintf(stderr, "%s isn't a b2g-info sample ring.\n", path);
+    munmap(m_header, m_size);
+    m_header = NULL;
+    return false;
+  }
+  return true;
+}
+
+SampleRing::Slot*
+SampleRing::slot(uint32_t index)
+{
+  Slot* slots = reinterpret_cast<Slot*>(m_header + 1);
+  return &slots[index % NUM_SLOTS];
+}
+
+void
+SampleRing::publish(const string& sample)
+{
+  uint32_t index = m_header->num_published;
+  Slot* s = slot(index);
+
+  size_t length = sample.size();
+  if (length > sizeof(s->data)) {
+    length = sample.rfind('\n', sizeof(s->data) - 1) + 1;
+  }
+
+  s->seq++;
+  __sync_synchronize();
+  s->index = index;
+  memcpy(s->data, sample.data(), length);
+  s->length = length;
+  __sync_synchronize();
+  s->seq++;
+  __sync_synchronize();
+  m_header->num_published = index + 1;
+}
+
+uint32_t
+SampleRing::num_published()
+{
+  return m_header->num_published;
+}
+
+bool
+SampleRing::read(uint32_t index, string& sample)
+{
+  Slot* s = slot(index);
+  for (int tries = 0; tries < MAX_TRIES; tries++) {
+    if (tries) {
+      usleep(RETRY_US);
+    }
+
+    uint32_t published = m_header->num_published;
+    if (published - index - 1 >= NUM_SLOTS) {
+      return false;
+    }
+
+    uint32_t seq = s->seq;
+    __sync_synchronize();
+    if (seq & 1) {
+      continue;
+    }
+
+    uint32_t slot_index = s->index;
+    uint32_t length = s->length;
+    if (length <= sizeof(s->data)) {
+      sample.assign(s->data, length);
+    }
+    __sync_synchronize();
+    if (s->seq != seq) {
+      continue;
+    }
+
+    // We read a consistent slot, but the writer may have moved on to
+    // sample |index| + NUM_SLOTS since we read num_published.
+    return slot_index == index && length <= sizeof(s->data);
+  }
+
+  // The writer has held the slot for far longer than a memcpy takes, so it
+  // probably died part way through.
+  return false;
+}
+
+bool
+SampleRing::read_latest(string& sample)
+{
+  while (true) {
+    uint32_t published = m_header->num_published;
+    if (!published) {
+      return false;
+    }
+    if (read(published - 1, sample)) {
+      return true;
+    }
+    // Try again only if we lost the slot to a newer sample.
+    if (m_header->num_published == published) {
+      return false;
+    }
+  }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+/**
+ * A ring of the last few samples the b2g-info daemon published, in a file
+ * which the daemon and its readers all map.  A reader gets the latest sample
+ * with a memcpy, without a system call (after mapping the file) and without
+ * the daemon knowing it's there.
+ *
+ * There's one writer.  Each slot is guarded by a seqlock: the writer makes
+ * the slot's sequence number odd while it writes and even again when it's
+ * done, and a reader retries if the number was odd or changed while it was
+ * copying.  Each slot also records which sample it holds, so a reader can
+ * tell that the writer has reused it.  Readers never block the writer.
+ *
+ *   SampleRing ring;
+ *   if (ring.open(DAEMON_RING_PATH)) {
+ *     string sample;
+ *     ring.read_latest(sample);
+ *   }
+ */
+class SampleRing
+{
+public:
+  enum {
+    NUM_SLOTS = 16,   // A power of two, so that slot() survives wrapping.
+    SLOT_SIZE = 32 * 1024
+  };
+
+  SampleRing();
+  ~SampleRing();
+
+  /**
+   * Create (or truncate) the ring file at |path| and map it for writing.
+   * Returns false after printing an error.
+   */
+  bool create(const char* path);
+
+  /**
+   * Map the existing ring file at |path| for reading.  Returns false after
+   * printing an error.
+   */
+  bool open(const char* path);
+
+  /**
+   * Write |sample| to the next slot.  Anything past SLOT_SIZE bytes, less a
+   * header, is cut off at a line boundary.
+   */
+  void publish(const std::string& sample);
+
+  /**
+   * How many samples have been published.  This wraps at 2^32.
+   */
+  uint32_t num_published();
+
+  /**
+   * Copy the |index|th sample published into |sample|.  Returns false if
+   * it's not in the ring any more (or hasn't been written yet), or if the
+   * writer has been part way through writing its slot for over 100ms.
+   */
+  bool read(uint32_t index, std::string& sample);
+
+  /**
+   * Copy the latest sample into |sample|.  Returns false if there isn't one
+   * or it can't be read.
+   */
+  bool read_latest(std::string& sample);
+
+private:
+  struct Header;
+  struct Slot;
+
+  Slot* slot(uint32_t index);
+
+  Header* m_header;
+  size_t m_size;
+};
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sharedbuffers.h"
+#include "fssource.h"
+
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+
+using namespace std;
+
+const char*
+SharedBuffer::kind_name(Kind kind)
+{
+  switch (kind) {
+    case DMA_BUF: return "dma-buf";
+    case ASHMEM:  return "ashmem";
+    case GRALLOC: return "gralloc";
+    default:      return "?";
+  }
+}
+
+static bool
+starts_with(const char* str, const char* prefix)
+{
+  return !strncmp(str, prefix, strlen(prefix));
+}
+
+/**
+ * Is |path| a device which gralloc allocates graphics buffers from?
+ */
+static bool
+is_gralloc_device(const char* path)
+{
+  static const char* const devices[] = {
+    "/dev/ion",
+    "/dev/kgsl",
+    "/dev/pmem",
+    "/dev/nvmap",
+    "/dev/mali",
+    "/dev/graphics/"
+  };
+  for (size_t i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
+    if (starts_with(path, devices[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Is |path|, the target of an fd or the name of a mapping, a dma-buf?  If
+ * so, set *unique_inode to whether its inode tells it apart from other
+ * dma-bufs.
+ */
+static bool
+is_dma_buf(const char* path, bool* unique_inode)
+{
+  if (starts_with(path, "/dmabuf:")) {
+    *unique_inode = true;
+    return true;
+  }
+  if (!strcmp(path, "anon_inode:dmabuf")) {
+    *unique_inode = false;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Merges the fds and mappings of one process which refer to the same buffer.
+ */
+class BufferCollector
+{
+public:
+  BufferCollector(vector<SharedBuffer>& buffers)
+    : m_buffers(buffers)
+  {}
+
+  void add(SharedBuffer::Kind kind, ino_t inode, long long size)
+  {
+    if (inode) {
+      // ashmem and dma-buf inodes come from different filesystems, so they
+      // may have the same numbers.
+      pair<int, ino_t> key(kind, inode);
+      map<pair<int, ino_t>, size_t>::iterator it = m_index.find(key);
+      if (it != m_index.end()) {
+        SharedBuffer& b = m_buffers[it->second];
+        b.size = max(b.size, size);
+        return;
+      }
+      m_index[key] = m_buffers.size();
+    }
+
+    SharedBuffer b;
+    b.kind = kind;
+    b.inode = inode;
+    b.size = size;
+    m_buffers.push_back(b);
+  }
+
+private:
+  vector<SharedBuffer>& m_buffers;
+  map<pair<int, ino_t>, size_t> m_index;
+};
+
+/**
+ * Read the size and inode of a dma-buf out of its fdinfo.  Kernels since 4.5
+ * put the size there and kernels since 5.14 the inode; fields which aren't
+ * there are left alone.
+ */
+static void
+parse_dma_buf_fdinfo(const string& fdinfo, long long* size, ino_t* inode)
+{
+  const char* field = strstr(fdinfo.c_str(), "\nsize:");
+  if (field) {
+    *size = strtoll(field + strlen("\nsize:"), NULL, 10);
+  }
+  field = strstr(fdinfo.c_str(), "\nino:");
+  if (field) {
+    *inode = strtoull(field + strlen("\nino:"), NULL, 10);
+  }
+}
+
+static void
+read_fds(pid_t pid, BufferCollector& collector)
+{
+  FsSource& source = FsSource::current();
+
+  char fd_dir[64];
+  snprintf(fd_dir, sizeof(fd_dir), "/proc/%d/fd", pid);
+  vector<string> fds;
+  if (!source.list_dir(fd_dir, fds)) {
+    return;
+  }
+
+  // Every path we look at is /proc/<pid>/fd/<n> or /proc/<pid>/fdinfo/<n>,
+  // so reuse the prefixes and only replace the fd number for each entry.
+  string path = string(fd_dir) + "/";
+  string fdinfo_path = path.substr(0, path.size() - 3) + "fdinfo/";
+  const size_t prefix_len = path.size();
+  const size_t fdinfo_prefix_len = fdinfo_path.size();
+  string target, fdinfo;
+
+  for (size_t i = 0; i < fds.size(); i++) {
+    path.replace(prefix_len, string::npos, fds[i]);
+    bool unique_inode;
+    if (!source.read_link(path.c_str(), target) ||
+        !is_dma_buf(target.c_str(), &unique_inode)) {
+      // ashmem and gralloc fds don't tell us the size of the buffer; we pick
+      // those up from the mappings instead.
+      continue;
+    }
+
+    long long size = 0;
+    ino_t inode = 0;
+    fdinfo_path.replace(fdinfo_prefix_len, string::npos, fds[i]);
+    if (source.read_file(fdinfo_path.c_str(), fdinfo)) {
+      parse_dma_buf_fdinfo(fdinfo, &size, &inode);
+    }
+
+    struct stat st;
+    if ((!size || !inode) && source.is_live() && stat(path.c_str(), &st) == 0) {
+      size = size ? size : st.st_size;
+      inode = inode ? inode : st.st_ino;
+    }
+    collector.add(SharedBuffer::DMA_BUF, unique_inode ? inode : 0, size);
+  }
+}
+
+static void
+read_maps(pid_t pid, BufferCollector& collector)
+{
+  char filename[64];
+  snprintf(filename, sizeof(filename), "/proc/%d/maps", pid);
+  string maps;
+  if (!FsSource::current().read_file(filename, maps)) {
+    return;
+  }
+
+  LineReader lines(maps);
+  while (const char* line = lines.next()) {
+    unsigned long long start, end;
+    unsigned long inode;
+    int path_offset = 0;
+    if (sscanf(line, "%llx-%llx %*s %*x %*s %lu %n",
+               &start, &end, &inode, &path_offset) < 3 || !path_offset) {
+      continue;
+    }
+    const char* path = line + path_offset;
+    long long size = end - start;
+
+    bool unique_inode;
+    if (starts_with(path, "/dev/ashmem")) {
+      // Each ashmem region is backed by its own shmem file, whose inode is
+      // what maps shows.
+      collector.add(SharedBuffer::ASHMEM, inode, size);
+    } else if (is_dma_buf(path, &unique_inode)) {
+      // If we can't tell dma-bufs apart, we've already counted this one
+      // through its fd (assuming it's still open).
+      if (unique_inode) {
+        collector.add(SharedBuffer::DMA_BUF, inode, size);
+      }
+    } else if (is_gralloc_device(path)) {
+      collector.add(SharedBuffer::GRALLOC, 0, size);
+    }
+  }
+}
+
+void
+read_shared_buffers(pid_t pid, vector<SharedBuffer>& buffers)
+{
+  BufferCollector collector(buffers);
+  read_fds(pid, collector);
+  read_maps(pid, collector);
+}
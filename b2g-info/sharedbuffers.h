@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * A graphics or shared-memory buffer which a process holds, through an fd,
+ * a mapping, or both.  These mostly don't show up in smaps' PSS: dma-bufs
+ * often aren't mapped at all, and device mappings aren't counted as resident.
+ */
+struct SharedBuffer
+{
+  enum Kind {
+    DMA_BUF,
+    ASHMEM,
+    GRALLOC,
+    NUM_KINDS
+  };
+
+  static const char* kind_name(Kind kind);
+
+  Kind kind;
+
+  /**
+   * Identifies this buffer across processes, or 0 if we can't tell buffers
+   * of this kind apart.  Kernels before 4.11 give every dma-buf the same
+   * anonymous inode, and gralloc devices (ion, kgsl, pmem) hand out all of
+   * their buffers through the one device node.
+   */
+  ino_t inode;
+
+  /**
+   * In bytes, or 0 if we don't know.  Mappings only give us their extent, so
+   * for ashmem and gralloc this is how much is mapped, not how much is
+   * resident.
+   */
+  long long size;
+};
+
+/**
+ * Append the shared buffers which |pid| holds to |buffers|, one entry per
+ * buffer where we can tell them apart.
+ *
+ * We read /proc/<pid>/fd once, and fdinfo only for the dma-buf fds, reusing
+ * the path buffers, so this stays cheap for processes with thousands of fds.
+ */
+void read_shared_buffers(pid_t pid, std::vector<SharedBuffer>& buffers);
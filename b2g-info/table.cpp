@@ -20,10 +20,26 @@
 #endif
 
 #include "table.h"
+#include "Utf8Index.h"
 #include <assert.h>
+#include <stdio.h>
 
 using namespace std;
 
+/**
+ * Process names are app names, which needn't be ASCII, so cells are
+ * measured in code points rather than bytes.
+ */
+static size_t
+cell_width(const string& str)
+{
+  utf8_index index;
+  utf8_index_init(&index, str.data(), str.size(), 0);
+  ssize_t width = utf8_index_length(&index);
+  utf8_index_release(&index);
+  return width < 0 ? str.size() : width;
+}
+
 Table::Table()
   : m_multi_col_header_start(-1)
   , m_multi_col_header_end(-1)
@@ -126,7 +142,7 @@ Table::print_with_indent(int indent)
     }
 
     for (size_t i = 0; i < row->size(); i++) {
-      col_widths[i] = max(col_widths[i], row->at(i).first.length());
+      col_widths[i] = max(col_widths[i], cell_width(row->at(i).first));
     }
   }
 
@@ -183,8 +199,14 @@ Table::print_with_indent(int indent)
 
     for (size_t i = 0; i < row->size(); i++) {
       const cell_t& cell = row->at(i);
-      const char* fmt_string = cell.second == ALIGN_RIGHT ? "%*s" : "%-*s";
-      printf(fmt_string, col_widths[i], cell.first.c_str());
+      int padding = col_widths[i] - cell_width(cell.first);
+      if (cell.second == ALIGN_RIGHT) {
+        print_spaces(padding);
+      }
+      fputs(cell.first.c_str(), stdout);
+      if (cell.second == ALIGN_LEFT) {
+        print_spaces(padding);
+      }
       if (i != row->size() - 1) {
         putchar(' ');
       }
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <stdarg.h>
 #include <vector>
 #include <string>
 
@@ -0,0 +1,599 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "timeseries.h"
+#include "utils.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace std;
+
+static const char kBlockMagic[4] = {'B', 'T', 'S', '1'};
+
+// How often we write the blocks we're filling in.
+static const long long kFlushIntervalMs = 60 * 1000;
+
+static long long
+now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void
+put_varint(string& out, unsigned long long v)
+{
+  while (v >= 0x80) {
+    out += (char) (v | 0x80);
+    v >>= 7;
+  }
+  out += (char) v;
+}
+
+static bool
+get_varint(const char*& p, const char* end, unsigned long long* v)
+{
+  *v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    unsigned char c = *p++;
+    *v |= (unsigned long long) (c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Append |values| as zigzag-encoded varint deltas, so that a column which
+ * changes slowly takes about a byte per value.
+ */
+static void
+put_column(string& out, const vector<long long>& values)
+{
+  long long prev = 0;
+  for (size_t i = 0; i < values.size(); i++) {
+    long long delta = values[i] - prev;
+    put_varint(out, ((unsigned long long) delta << 1) ^ (delta >> 63));
+    prev = values[i];
+  }
+}
+
+static bool
+get_column(const char*& p, const char* end, size_t count, vector<long long>& values)
+{
+  values.resize(count);
+  long long prev = 0;
+  for (size_t i = 0; i < count; i++) {
+    unsigned long long zigzag;
+    if (!get_varint(p, end, &zigzag)) {
+      return false;
+    }
+    prev += (long long) (zigzag >> 1) ^ -(long long) (zigzag & 1);
+    values[i] = prev;
+  }
+  return true;
+}
+
+/**
+ * A process name we can use as a directory name.
+ */
+static string
+series_dir_name(const string& name)
+{
+  string dir = name;
+  for (size_t i = 0; i < dir.size(); i++) {
+    if (dir[i] == '/' || (i == 0 && dir[i] == '.')) {
+      dir[i] = '_';
+    }
+  }
+  return dir;
+}
+
+static string
+block_name(const string& field, int level, long long start_ms)
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "-%d-%lld", level, start_ms);
+  return field + buf;
+}
+
+/**
+ * Parse a block's file name.  Returns false if it's not a block of |field|.
+ */
+static bool
+parse_block_name(const string& name, const string& field, int* level, long long* start_ms)
+{
+  if (name.compare(0, field.size(), field) ||
+      sscanf(name.c_str() + field.size(), "-%d-%lld", level, start_ms) != 2) {
+    return false;
+  }
+  return *level >= 0 && *level < TimeSeriesStore::NUM_LEVELS &&
+         name == block_name(field, *level, *start_ms);
+}
+
+/**
+ * List the blocks of |field| in |dir|, by level and then start time.
+ */
+static bool
+list_blocks(const string& dir, const string& field,
+            vector<long long> (&blocks)[TimeSeriesStore::NUM_LEVELS])
+{
+  DIR* d = safe_opendir(dir.c_str());
+  if (!d) {
+    return false;
+  }
+  while (dirent* de = readdir(d)) {
+    int level;
+    long long start_ms;
+    if (parse_block_name(de->d_name, field, &level, &start_ms)) {
+      blocks[level].push_back(start_ms);
+    }
+  }
+  closedir(d);
+
+  for (int i = 0; i < TimeSeriesStore::NUM_LEVELS; i++) {
+    sort(blocks[i].begin(), blocks[i].end());
+  }
+  return true;
+}
+
+static bool
+read_block(const string& path, int level, vector<TimeSeriesStore::Point>& points)
+{
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    return false;
+  }
+  string contents;
+  char buf[4096];
+  size_t nread;
+  while ((nread = fread(buf, 1, sizeof(buf), f)) > 0) {
+    contents.append(buf, nread);
+  }
+  fclose(f);
+
+  const char* p = contents.data();
+  const char* end = p + contents.size();
+  unsigned long long count;
+  if (contents.size() < sizeof(kBlockMagic) ||
+      memcmp(p, kBlockMagic, sizeof(kBlockMagic))) {
+    return false;
+  }
+  p += sizeof(kBlockMagic);
+  if (!get_varint(p, end, &count) || count > TimeSeriesStore::POINTS_PER_BLOCK) {
+    return false;
+  }
+
+  vector<long long> times, mins, maxes, avgs;
+  if (!get_column(p, end, count, times) || !get_column(p, end, count, avgs)) {
+    return false;
+  }
+  if (level == 0) {
+    mins = maxes = avgs;
+  } else if (!get_column(p, end, count, mins) || !get_column(p, end, count, maxes)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    TimeSeriesStore::Point point;
+    point.time_ms = times[i];
+    point.level = level;
+    point.min_kb = mins[i];
+    point.max_kb = maxes[i];
+    point.avg_kb = avgs[i];
+    points.push_back(point);
+  }
+  return true;
+}
+
+TimeSeriesStore::TimeSeriesStore(const string& dir, long long interval_ms)
+  : m_dir(dir)
+  , m_interval_ms(interval_ms)
+  , m_last_flush_ms(now_ms())
+{}
+
+TimeSeriesStore::~TimeSeriesStore()
+{
+  for (map<string, Series*>::iterator it = m_series.begin();
+       it != m_series.end(); ++it) {
+    delete it->second;
+  }
+}
+
+/* static */ long long
+TimeSeriesStore::resolution_ms(int level)
+{
+  static const long long resolutions[NUM_LEVELS] = {0, 60 * 1000, 15 * 60 * 1000};
+  return resolutions[level];
+}
+
+bool
+TimeSeriesStore::init()
+{
+  if (mkdir(m_dir.c_str(), 0755) == -1 && errno != EEXIST) {
+    fprintf(stderr, "Couldn't create %s: %s\n", m_dir.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void
+TimeSeriesStore::add(const Sample& sample)
+{
+  // Sum processes with the same name first.
+  map<string, vector<int> > totals;
+  static const char* const fields[] = {"uss", "pss", "rss", "swap"};
+  const int num_fields = sizeof(fields) / sizeof(fields[0]);
+  for (size_t i = 0; i < sample.processes.size(); i++) {
+    const ProcessSample& p = sample.processes[i];
+    int values[num_fields] = {p.uss_kb, p.pss_kb, p.rss_kb, p.swap_kb};
+    vector<int>& total = totals[p.name];
+    total.resize(num_fields, 0);
+    for (int j = 0; j < num_fields; j++) {
+      total[j] += max(values[j], 0);
+    }
+  }
+
+  map<string, Series*> updated;
+  for (map<string, vector<int> >::const_iterator it = totals.begin();
+       it != totals.end(); ++it) {
+    for (int j = 0; j < num_fields; j++) {
+      add_value(it->first, fields[j], sample.time_ms, it->second[j], updated);
+    }
+  }
+
+  const SystemMeminfo& m = sample.meminfo;
+  if (m.total_kb != -1) {
+    int cache_kb = m.buffers_kb + m.cached_kb;
+    add_value("system", "free", sample.time_ms, m.free_kb, updated);
+    add_value("system", "cache", sample.time_ms, cache_kb, updated);
+    add_value("system", "used", sample.time_ms, m.total_kb - m.free_kb - cache_kb, updated);
+    if (m.swap_total_kb > 0) {
+      add_value("system", "swap_used", sample.time_ms,
+                m.swap_total_kb - max(m.swap_free_kb, 0), updated);
+    }
+  }
+
+  // Series which weren't in this sample belong to processes which have gone
+  // away.  Write them out rather than keep them in memory.
+  for (map<string, Series*>::iterator it = m_series.begin();
+       it != m_series.end(); ++it) {
+    if (!updated.count(it->first)) {
+      finish(*it->second);
+      delete it->second;
+    }
+  }
+  m_series.swap(updated);
+
+  if (sample.time_ms - m_last_flush_ms >= kFlushIntervalMs) {
+    flush();
+  }
+}
+
+void
+TimeSeriesStore::add_value(const string& name, const string& field,
+                           long long time_ms, int value_kb,
+                           map<string, Series*>& updated)
+{
+  string dir = m_dir + "/" + series_dir_name(name);
+  string key = dir + "/" + field;
+  Series* series;
+  map<string, Series*>::iterator it = m_series.find(key);
+  if (it != m_series.end()) {
+    series = it->second;
+    m_series.erase(it);
+  } else {
+    series = new Series();
+    series->dir = dir;
+    series->field = field;
+    resume(*series, time_ms);
+  }
+  updated[key] = series;
+
+  Point point;
+  point.time_ms = time_ms;
+  point.level = 0;
+  point.min_kb = point.max_kb = point.avg_kb = value_kb;
+  emit(*series, 0, point);
+
+  for (int level = 1; level < NUM_LEVELS; level++) {
+    Bucket& b = series->buckets[level];
+    long long start_ms = time_ms - time_ms % resolution_ms(level);
+    if (b.count && b.start_ms != start_ms) {
+      Point rolled;
+      rolled.time_ms = b.start_ms;
+      rolled.level = level;
+      rolled.min_kb = b.min_kb;
+      rolled.max_kb = b.max_kb;
+      rolled.avg_kb = b.sum_kb / b.count;
+      emit(*series, level, rolled);
+      b = Bucket();
+    }
+    if (!b.count) {
+      b.start_ms = start_ms;
+      b.min_kb = b.max_kb = value_kb;
+    }
+    b.min_kb = min(b.min_kb, value_kb);
+    b.max_kb = max(b.max_kb, value_kb);
+    b.sum_kb += value_kb;
+    b.count++;
+  }
+}
+
+void
+TimeSeriesStore::emit(Series& series, int level, const Point& point)
+{
+  Block& block = series.blocks[level];
+  if (block.points.empty()) {
+    block.start_ms = point.time_ms;
+  }
+  block.points.push_back(point);
+  block.dirty = true;
+
+  if (block.points.size() == POINTS_PER_BLOCK) {
+    write_block(series, level);
+    block = Block();
+  }
+}
+
+void
+TimeSeriesStore::resume(Series& series, long long time_ms)
+{
+  vector<long long> blocks[NUM_LEVELS];
+  if (!list_blocks(series.dir, series.field, blocks)) {
+    return;
+  }
+
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    if (blocks[level].empty()) {
+      continue;
+    }
+    Block& block = series.blocks[level];
+    block.start_ms = blocks[level].back();
+    string path = series.dir + "/" + block_name(series.field, level, block.start_ms);
+    if (!read_block(path, level, block.points) ||
+        block.points.size() >= POINTS_PER_BLOCK) {
+      block = Block();
+      continue;
+    }
+    block.on_disk = true;
+
+    // If the last bucket is the one |time_ms| goes in, take it back so that
+    // we don't write two points for it.  We don't know how many samples it
+    // had, so it counts as one.
+    const Point& last = block.points.back();
+    if (level > 0 && last.time_ms == time_ms - time_ms % resolution_ms(level)) {
+      Bucket& b = series.buckets[level];
+      b.start_ms = last.time_ms;
+      b.min_kb = last.min_kb;
+      b.max_kb = last.max_kb;
+      b.sum_kb = last.avg_kb;
+      b.count = 1;
+      block.points.pop_back();
+    }
+  }
+}
+
+void
+TimeSeriesStore::write_block(Series& series, int level)
+{
+  Block& block = series.blocks[level];
+  if (!block.dirty) {
+    return;
+  }
+  block.dirty = false;
+
+  string out(kBlockMagic, sizeof(kBlockMagic));
+  put_varint(out, block.points.size());
+
+  vector<long long> times, mins, maxes, avgs;
+  for (size_t i = 0; i < block.points.size(); i++) {
+    const Point& p = block.points[i];
+    times.push_back(p.time_ms);
+    mins.push_back(p.min_kb);
+    maxes.push_back(p.max_kb);
+    avgs.push_back(p.avg_kb);
+  }
+  put_column(out, times);
+  put_column(out, avgs);
+  if (level > 0) {
+    put_column(out, mins);
+    put_column(out, maxes);
+  }
+
+  // Write a new file and rename it over the old one, so that a query never
+  // sees half a block.
+  if (mkdir(series.dir.c_str(), 0755) == -1 && errno != EEXIST) {
+    fprintf(stderr, "Couldn't create %s: %s\n", series.dir.c_str(), strerror(errno));
+    return;
+  }
+  string path = series.dir + "/" + block_name(series.field, level, block.start_ms);
+  string tmp_path = path + ".tmp";
+  FILE* f = fopen(tmp_path.c_str(), "w");
+  if (!f) {
+    fprintf(stderr, "Couldn't write %s: %s\n", tmp_path.c_str(), strerror(errno));
+    return;
+  }
+  bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+  ok = !fclose(f) && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) == -1) {
+    fprintf(stderr, "Couldn't write %s: %s\n", path.c_str(), strerror(errno));
+    unlink(tmp_path.c_str());
+    return;
+  }
+
+  if (!block.on_disk) {
+    block.on_disk = true;
+    prune(series, level);
+  }
+}
+
+void
+TimeSeriesStore::prune(Series& series, int level)
+{
+  vector<long long> blocks[NUM_LEVELS];
+  if (!list_blocks(series.dir, series.field, blocks)) {
+    return;
+  }
+  vector<long long>& starts = blocks[level];
+  for (size_t i = 0; i + BLOCKS_KEPT < starts.size(); i++) {
+    unlink((series.dir + "/" + block_name(series.field, level, starts[i])).c_str());
+  }
+}
+
+void
+TimeSeriesStore::finish(Series& series)
+{
+  for (int level = 1; level < NUM_LEVELS; level++) {
+    Bucket& b = series.buckets[level];
+    if (b.count) {
+      Point rolled;
+      rolled.time_ms = b.start_ms;
+      rolled.level = level;
+      rolled.min_kb = b.min_kb;
+      rolled.max_kb = b.max_kb;
+      rolled.avg_kb = b.sum_kb / b.count;
+      emit(series, level, rolled);
+      b = Bucket();
+    }
+  }
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    write_block(series, level);
+  }
+}
+
+void
+TimeSeriesStore::flush()
+{
+  for (map<string, Series*>::iterator it = m_series.begin();
+       it != m_series.end(); ++it) {
+    for (int level = 0; level < NUM_LEVELS; level++) {
+      write_block(*it->second, level);
+    }
+  }
+  m_last_flush_ms = now_ms();
+}
+
+void
+TimeSeriesStore::expire()
+{
+  DIR* d = safe_opendir(m_dir.c_str());
+  if (!d) {
+    return;
+  }
+
+  time_t now = time(NULL);
+  while (dirent* de = readdir(d)) {
+    if (de->d_name[0] == '.') {
+      continue;
+    }
+    string dir = m_dir + "/" + de->d_name;
+    DIR* series_d = safe_opendir(dir.c_str());
+    if (!series_d) {
+      continue;
+    }
+    while (dirent* block_de = readdir(series_d)) {
+      // The level is the number before the last '-'.
+      const char* last_dash = strrchr(block_de->d_name, '-');
+      if (!last_dash || last_dash == block_de->d_name) {
+        continue;
+      }
+      const char* p = last_dash - 1;
+      while (p > block_de->d_name && *p != '-') {
+        p--;
+      }
+      int level = atoi(p + 1);
+      if (*p != '-' || level < 0 || level >= NUM_LEVELS) {
+        continue;
+      }
+
+      long long resolution = level ? resolution_ms(level) : m_interval_ms;
+      long long keep_secs = resolution * POINTS_PER_BLOCK * BLOCKS_KEPT / 1000;
+      string path = dir + "/" + block_de->d_name;
+      struct stat st;
+      if (stat(path.c_str(), &st) == 0 && now - st.st_mtime > keep_secs) {
+        unlink(path.c_str());
+      }
+    }
+    closedir(series_d);
+
+    // This fails unless we deleted everything.
+    rmdir(dir.c_str());
+  }
+  closedir(d);
+}
+
+static bool
+point_before(const TimeSeriesStore::Point& a, const TimeSeriesStore::Point& b)
+{
+  return a.time_ms < b.time_ms;
+}
+
+/* static */ bool
+TimeSeriesStore::query(const string& dir, const string& name,
+                       const string& field, long long since_ms,
+                       vector<Point>& points)
+{
+  points.clear();
+
+  string series_dir = dir + "/" + series_dir_name(name);
+  vector<long long> blocks[NUM_LEVELS];
+  if (!list_blocks(series_dir, field, blocks)) {
+    return false;
+  }
+
+  // Take each level's points from before the time the finer levels cover,
+  // reading only the blocks which overlap [since_ms, covered_from).
+  long long covered_from = now_ms() + 1;
+  bool found = false;
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    const vector<long long>& starts = blocks[level];
+    found = found || !starts.empty();
+    if (since_ms >= covered_from) {
+      break;
+    }
+    for (size_t i = 0; i < starts.size(); i++) {
+      bool last = i + 1 == starts.size();
+      if ((!last && starts[i + 1] <= since_ms) || starts[i] >= covered_from) {
+        continue;
+      }
+
+      vector<Point> block_points;
+      read_block(series_dir + "/" + block_name(field, level, starts[i]), level,
+                 block_points);
+      for (size_t j = 0; j < block_points.size(); j++) {
+        const Point& p = block_points[j];
+        if (p.time_ms >= since_ms && p.time_ms < covered_from) {
+          points.push_back(p);
+        }
+      }
+    }
+    if (!starts.empty()) {
+      covered_from = min(covered_from, starts[0]);
+    }
+  }
+
+  sort(points.begin(), points.end(), point_before);
+  return found;
+}
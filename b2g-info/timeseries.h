@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "sample.h"
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Records Samples over hours or days in a directory, in bounded space.
+ *
+ * Each series (one field of one B2G process, by name, or of the system) is
+ * kept at three resolutions ("levels"): every sample, one-minute buckets,
+ * and fifteen-minute buckets.  A bucket holds the min, max, and average of
+ * the samples in it.  Each level keeps its last BLOCKS_KEPT blocks of
+ * POINTS_PER_BLOCK points, so the recent past is at full resolution and
+ * older data is only available rolled up.
+ *
+ * A block is a file DIR/<process>/<field>-<level>-<start ms>, holding its
+ * columns (times, then values, or min/max/avg) one after the other, each as
+ * varint-encoded deltas.  A query reads only the files for its series and
+ * time range.  A series which starts again (a new process with the same
+ * name, or a new recording in the same directory) goes on filling its last
+ * blocks, and writing a new block deletes all but the last BLOCKS_KEPT of
+ * its level, so a series never has more than NUM_LEVELS * BLOCKS_KEPT files.
+ *
+ * Processes with the same name (e.g. several preallocated processes) are
+ * summed.  The system's series are under the name "system".
+ *
+ *   TimeSeriesStore store(dir, interval_ms);
+ *   while (...) {
+ *     Sample s;
+ *     s.collect();
+ *     store.add(s);
+ *   }
+ *   store.flush();
+ */
+class TimeSeriesStore
+{
+public:
+  enum {
+    NUM_LEVELS = 3,
+    POINTS_PER_BLOCK = 1024,
+    BLOCKS_KEPT = 8
+  };
+
+  struct Point
+  {
+    long long time_ms;
+    int level;
+    int min_kb;
+    int max_kb;
+    int avg_kb;
+  };
+
+  /**
+   * Record to |dir|, which we create if need be, with samples every
+   * |interval_ms|.
+   */
+  TimeSeriesStore(const std::string& dir, long long interval_ms);
+  ~TimeSeriesStore();
+
+  /**
+   * Create our directory.  Returns false after printing an error.
+   */
+  bool init();
+
+  void add(const Sample& sample);
+
+  /**
+   * Write the blocks we're filling in.  We do this every minute ourselves,
+   * so a query sees data which is at most a minute old.
+   */
+  void flush();
+
+  /**
+   * Delete blocks which haven't been written in longer than their level
+   * keeps data, i.e. those of processes which have gone away.
+   */
+  void expire();
+
+  /**
+   * The bucket size of |level| in ms; 0 for every sample.
+   */
+  static long long resolution_ms(int level);
+
+  /**
+   * Replace |points| with the series |name|/|field| in |dir| from |since_ms|
+   * on, sorted by time, each part at the finest level which covers it.
+   * Returns false if there's no such series.
+   */
+  static bool query(const std::string& dir, const std::string& name,
+                    const std::string& field, long long since_ms,
+                    std::vector<Point>& points);
+
+private:
+  struct Bucket
+  {
+    Bucket() : start_ms(0), min_kb(0), max_kb(0), sum_kb(0), count(0) {}
+
+    long long start_ms;
+    int min_kb;
+    int max_kb;
+    long long sum_kb;
+    int count;
+  };
+
+  struct Block
+  {
+    Block() : start_ms(0), dirty(false), on_disk(false) {}
+
+    long long start_ms;
+    std::vector<Point> points;
+    bool dirty;
+    bool on_disk;
+  };
+
+  struct Series
+  {
+    std::string dir;
+    std::string field;
+    Bucket buckets[NUM_LEVELS];
+    Block blocks[NUM_LEVELS];
+  };
+
+  void add_value(const std::string& name, const std::string& field,
+                 long long time_ms, int value_kb,
+                 std::map<std::string, Series*>& updated);
+  void emit(Series& series, int level, const Point& point);
+  void resume(Series& series, long long time_ms);
+  void write_block(Series& series, int level);
+  void finish(Series& series);
+  void prune(Series& series, int level);
+
+  std::string m_dir;
+  long long m_interval_ms;
+  long long m_last_flush_ms;
+  std::map<std::string, Series*> m_series;
+};
@@ -20,9 +20,13 @@
 
 #pragma once
 
+#include <dirent.h>
 #include <string>
 
-struct DIR;
+/**
+ * The system's page size in bytes.
+ */
+extern long sPageSize;
 
 /**
  * Convert a number of pages to kb.
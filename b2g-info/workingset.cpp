@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "workingset.h"
+#include "process.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define PAGE_IDLE_BITMAP "/sys/kernel/mm/page_idle/bitmap"
+
+// pagemap entries are 64 bits: bit 63 says the page is present, and bits
+// 0-54 hold its page frame number (which reads as 0 unless we're root).
+static const uint64_t PM_PRESENT = 1ULL << 63;
+static const uint64_t PM_PFN_MASK = (1ULL << 55) - 1;
+
+// How many pagemap entries or bitmap words we read or write per syscall.
+static const size_t BATCH_SIZE = 4096;
+
+const char*
+WorkingSet::category_name(Category category)
+{
+  switch (category) {
+    case CAT_ANON:  return "anon";
+    case CAT_STACK: return "stack";
+    case CAT_CODE:  return "code";
+    case CAT_FILE:  return "file";
+    case CAT_DEV:   return "dev";
+    default:        return "?";
+  }
+}
+
+WorkingSet::WorkingSet(const vector<Process*>& processes)
+  : m_processes(processes)
+  , m_usage(processes.size(), vector<Usage>(NUM_CATEGORIES))
+  , m_method(PAGE_IDLE)
+  , m_bitmap_fd(-1)
+{}
+
+const WorkingSet::Usage&
+WorkingSet::usage(size_t index, Category category) const
+{
+  return m_usage[index][category];
+}
+
+WorkingSet::Usage
+WorkingSet::total(size_t index) const
+{
+  Usage sum;
+  for (int i = 0; i < NUM_CATEGORIES; i++) {
+    sum.hot_kb += m_usage[index][i].hot_kb;
+    sum.cold_kb += m_usage[index][i].cold_kb;
+  }
+  return sum;
+}
+
+bool
+WorkingSet::start()
+{
+  if (start_page_idle()) {
+    m_method = PAGE_IDLE;
+    return true;
+  }
+  if (start_clear_refs()) {
+    m_method = CLEAR_REFS;
+    return true;
+  }
+  return false;
+}
+
+void
+WorkingSet::finish()
+{
+  if (m_method == PAGE_IDLE) {
+    finish_page_idle();
+  } else {
+    finish_clear_refs();
+  }
+}
+
+WorkingSet::Category
+WorkingSet::categorize(const char* perms, const char* path)
+{
+  if (!strncmp(path, "/dev/", 5)) {
+    return CAT_DEV;
+  }
+  if (path[0] == '/') {
+    return perms[2] == 'x' ? CAT_CODE : CAT_FILE;
+  }
+  if (!strncmp(path, "[stack", 6)) {
+    return CAT_STACK;
+  }
+  return CAT_ANON;
+}
+
+/**
+ * Parse one line of maps or a mapping header in smaps.  Returns false if
+ * |line| isn't one.
+ */
+static bool
+parse_mapping_line(const char* line, uint64_t* start, uint64_t* end,
+                   char* perms, const char** path)
+{
+  unsigned long long s, e;
+  int path_offset = 0;
+  if (sscanf(line, "%llx-%llx %4s %*x %*s %*u %n", &s, &e, perms, &path_offset) < 3 ||
+      !path_offset) {
+    return false;
+  }
+  *start = s;
+  *end = e;
+  *path = line + path_offset;
+  return true;
+}
+
+bool
+WorkingSet::read_mappings(pid_t pid, vector<Mapping>& mappings)
+{
+  char filename[64];
+  snprintf(filename, sizeof(filename), "/proc/%d/maps", pid);
+  FILE* f = fopen(filename, "r");
+  if (!f) {
+    return false;
+  }
+
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    Mapping m;
+    char perms[5];
+    const char* path;
+    if (parse_mapping_line(line, &m.start, &m.end, perms, &path)) {
+      m.category = categorize(perms, path);
+      mappings.push_back(m);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+/**
+ * Append the frame number and category of every resident page of |pid| to
+ * |frames|.
+ */
+bool
+WorkingSet::read_frames(pid_t pid, vector<Frame>& frames)
+{
+  vector<Mapping> mappings;
+  if (!read_mappings(pid, mappings)) {
+    return false;
+  }
+
+  char filename[64];
+  snprintf(filename, sizeof(filename), "/proc/%d/pagemap", pid);
+  int fd = TEMP_FAILURE_RETRY(open(filename, O_RDONLY));
+  if (fd == -1) {
+    return false;
+  }
+
+  vector<uint64_t> entries(BATCH_SIZE);
+  for (size_t i = 0; i < mappings.size(); i++) {
+    uint64_t page = mappings[i].start / sPageSize;
+    uint64_t end_page = mappings[i].end / sPageSize;
+    while (page < end_page) {
+      size_t count = min<uint64_t>(end_page - page, BATCH_SIZE);
+      ssize_t nread = TEMP_FAILURE_RETRY(
+        pread(fd, &entries[0], count * sizeof(uint64_t), page * sizeof(uint64_t)));
+      if (nread <= 0) {
+        break;
+      }
+      size_t nentries = nread / sizeof(uint64_t);
+      for (size_t j = 0; j < nentries; j++) {
+        if (entries[j] & PM_PRESENT) {
+          Frame frame;
+          frame.pfn = entries[j] & PM_PFN_MASK;
+          frame.category = mappings[i].category;
+          frames.push_back(frame);
+        }
+      }
+      page += nentries;
+    }
+  }
+
+  TEMP_FAILURE_RETRY(close(fd));
+  return true;
+}
+
+bool
+WorkingSet::start_page_idle()
+{
+  m_bitmap_fd = TEMP_FAILURE_RETRY(open(PAGE_IDLE_BITMAP, O_RDWR));
+  if (m_bitmap_fd == -1) {
+    return false;
+  }
+
+  vector<uint64_t> pfns;
+  for (size_t i = 0; i < m_processes.size(); i++) {
+    vector<Frame> frames;
+    read_frames(m_processes[i]->pid(), frames);
+    for (size_t j = 0; j < frames.size(); j++) {
+      pfns.push_back(frames[j].pfn);
+    }
+  }
+  sort(pfns.begin(), pfns.end());
+  pfns.erase(unique(pfns.begin(), pfns.end()), pfns.end());
+
+  if (!pfns.empty() && pfns.back() == 0) {
+    // Every frame number read as 0, so we can't see physical pages.
+    close(m_bitmap_fd);
+    m_bitmap_fd = -1;
+    return false;
+  }
+
+  // Each 64-bit word of the bitmap covers 64 frames; writing a word marks
+  // the frames whose bits are set as idle and leaves the others alone.  Gather
+  // runs of consecutive words and write each run at once.
+  vector<uint64_t> words;
+  uint64_t first_word = 0;
+  for (size_t i = 0; i <= pfns.size(); i++) {
+    uint64_t word = i < pfns.size() ? pfns[i] / 64 : 0;
+    bool flush = i == pfns.size() ||
+                 (!words.empty() && (word >= first_word + words.size() + 1 ||
+                                     words.size() == BATCH_SIZE));
+    if (flush && !words.empty()) {
+      TEMP_FAILURE_RETRY(pwrite(m_bitmap_fd, &words[0], words.size() * sizeof(uint64_t),
+                                first_word * sizeof(uint64_t)));
+      words.clear();
+    }
+    if (i == pfns.size()) {
+      break;
+    }
+    if (words.empty()) {
+      first_word = word;
+    }
+    words.resize(word - first_word + 1, 0);
+    words.back() |= 1ULL << (pfns[i] % 64);
+  }
+  return true;
+}
+
+void
+WorkingSet::finish_page_idle()
+{
+  const long page_kb = sPageSize / 1024;
+  vector<uint64_t> words(BATCH_SIZE);
+
+  for (size_t i = 0; i < m_processes.size(); i++) {
+    vector<Frame> frames;
+    read_frames(m_processes[i]->pid(), frames);
+    sort(frames.begin(), frames.end());
+
+    // Frames are sorted, so read the bitmap in chunks as we go.
+    uint64_t chunk_start = 0;
+    size_t chunk_words = 0;
+    for (size_t j = 0; j < frames.size(); j++) {
+      uint64_t word = frames[j].pfn / 64;
+      if (!chunk_words || word < chunk_start || word >= chunk_start + chunk_words) {
+        chunk_start = word;
+        ssize_t nread = TEMP_FAILURE_RETRY(
+          pread(m_bitmap_fd, &words[0], BATCH_SIZE * sizeof(uint64_t),
+                chunk_start * sizeof(uint64_t)));
+        chunk_words = nread > 0 ? nread / sizeof(uint64_t) : 0;
+      }
+      bool idle = chunk_words &&
+                  (words[word - chunk_start] >> (frames[j].pfn % 64)) & 1;
+      Usage& u = m_usage[i][frames[j].category];
+      if (idle) {
+        u.cold_kb += page_kb;
+      } else {
+        u.hot_kb += page_kb;
+      }
+    }
+  }
+
+  close(m_bitmap_fd);
+  m_bitmap_fd = -1;
+}
+
+bool
+WorkingSet::start_clear_refs()
+{
+  bool any = false;
+  for (size_t i = 0; i < m_processes.size(); i++) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/proc/%d/clear_refs", m_processes[i]->pid());
+    int fd = TEMP_FAILURE_RETRY(open(filename, O_WRONLY));
+    if (fd == -1) {
+      continue;
+    }
+    // "1" clears the referenced bits of every page in the process.
+    if (TEMP_FAILURE_RETRY(write(fd, "1\n", 2)) == 2) {
+      any = true;
+    }
+    TEMP_FAILURE_RETRY(close(fd));
+  }
+  return any;
+}
+
+void
+WorkingSet::finish_clear_refs()
+{
+  for (size_t i = 0; i < m_processes.size(); i++) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/proc/%d/smaps", m_processes[i]->pid());
+    FILE* f = fopen(filename, "r");
+    if (!f) {
+      continue;
+    }
+
+    Category category = CAT_ANON;
+    int rss = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+      uint64_t start, end;
+      char perms[5];
+      const char* path;
+      int val;
+      if (parse_mapping_line(line, &start, &end, perms, &path)) {
+        category = categorize(perms, path);
+      } else if (sscanf(line, "Rss: %d kB", &val) == 1) {
+        rss = val;
+      } else if (sscanf(line, "Referenced: %d kB", &val) == 1) {
+        m_usage[i][category].hot_kb += val;
+        m_usage[i][category].cold_kb += max(rss - val, 0);
+      }
+    }
+    fclose(f);
+  }
+}
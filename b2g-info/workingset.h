@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+class Process;
+
+/**
+ * Estimates the working set of a group of processes: how much of their
+ * resident memory they touch over an interval.
+ *
+ * Example use:
+ *
+ *   WorkingSet ws(processes);
+ *   ws.start();
+ *   sleep(10);
+ *   ws.finish();
+ *   ws.usage(0, WorkingSet::CAT_ANON).hot_kb ...
+ *
+ * Where the kernel supports it, start() marks every resident page idle in
+ * /sys/kernel/mm/page_idle/bitmap (finding the pages' frame numbers through
+ * /proc/<pid>/pagemap), and finish() checks which of them are still idle.
+ * Otherwise we write to /proc/<pid>/clear_refs and read the "Referenced"
+ * counts out of smaps, which is coarser (it can't see pages that were
+ * touched and then reclaimed) and disturbs the kernel's reclaim decisions.
+ */
+class WorkingSet
+{
+public:
+  enum Method {
+    PAGE_IDLE,
+    CLEAR_REFS
+  };
+
+  enum Category {
+    CAT_ANON,
+    CAT_STACK,
+    CAT_CODE,
+    CAT_FILE,
+    CAT_DEV,
+    NUM_CATEGORIES
+  };
+
+  static const char* category_name(Category category);
+
+  struct Usage
+  {
+    Usage() : hot_kb(0), cold_kb(0) {}
+    long long hot_kb;
+    long long cold_kb;
+  };
+
+  WorkingSet(const std::vector<Process*>& processes);
+
+  /**
+   * Start the interval.  Returns false if neither page_idle nor clear_refs
+   * could be used (e.g. because we're not root).
+   */
+  bool start();
+
+  /**
+   * End the interval and count what was touched.
+   */
+  void finish();
+
+  Method method() const { return m_method; }
+
+  /**
+   * Memory of the |index|'th process in |category|, or in all categories.
+   */
+  const Usage& usage(size_t index, Category category) const;
+  Usage total(size_t index) const;
+
+private:
+  struct Mapping
+  {
+    uint64_t start;
+    uint64_t end;
+    Category category;
+  };
+
+  struct Frame
+  {
+    uint64_t pfn;
+    Category category;
+    bool operator<(const Frame& other) const { return pfn < other.pfn; }
+  };
+
+  static Category categorize(const char* perms, const char* path);
+  bool read_mappings(pid_t pid, std::vector<Mapping>& mappings);
+  bool read_frames(pid_t pid, std::vector<Frame>& frames);
+
+  bool start_page_idle();
+  void finish_page_idle();
+  bool start_clear_refs();
+  void finish_clear_refs();
+
+  std::vector<Process*> m_processes;
+  std::vector<std::vector<Usage> > m_usage;
+  Method m_method;
+  int m_bitmap_fd;
+};
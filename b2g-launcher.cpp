@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * This program starts B2G.  It does what b2g.sh does on a normal boot
+ * (environment, LD_PRELOAD, rlimits) without spawning a shell, and records
+ * how long each step took so that startup regressions can be tracked.
+ *
+ * The timestamps, in nanoseconds of CLOCK_MONOTONIC, are written to
+ * sStartupFile just before we exec b2g; "b2g-info --startup" displays them.
+ *
+ * If persist.b2g.startup.tracelibs is set to 1, we also leave behind a
+ * process which polls /proc/<pid>/maps of b2g and appends the time at which
+ * each shared library first showed up.  These times are accurate to the
+ * polling interval (sTracePollUs), and the polling costs some CPU, so it's
+ * off by default.
+ *
+ * Anything unusual -- a missing /system/b2g that needs recovering, or a
+ * COMMAND_PREFIX -- is left to b2g.sh, which we exec instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <cutils/properties.h>
+
+#define LOG_TAG "b2g-launcher"
+#include <android/log.h>
+
+using namespace std;
+
+static const char *sStartupFile = "/data/local/b2g-startup.txt";
+static const char *sFallbackScript = "/system/bin/b2g.sh";
+static const char *sDefaultB2GDir = "/system/b2g";
+static const char *sTmpDir = "/data/local/tmp";
+static const rlim_t sMaxOpenFiles = 8192;
+
+static const char *sTraceLibsProperty = "persist.b2g.startup.tracelibs";
+static const int64_t sTraceTimeoutNs = 20 * 1000000000LL;
+// Stop tracing once libxul.so is loaded and nothing new has shown up for
+// this long.
+static const int64_t sTraceSettleNs = 1000000000LL;
+static const int sTracePollUs = 2000;
+
+#define ARRAY_LENGTH(x) (sizeof(x)/sizeof(x[0]))
+
+#define LOG(prio, ...) __android_log_print(prio, LOG_TAG, __VA_ARGS__)
+
+struct Phase {
+  const char *name;
+  int64_t ns;
+};
+
+static Phase sPhases[8];
+static int sNumPhases = 0;
+
+static int64_t nowNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void markPhase(const char *name, int64_t ns)
+{
+  if (sNumPhases < (int)ARRAY_LENGTH(sPhases)) {
+    sPhases[sNumPhases].name = name;
+    sPhases[sNumPhases].ns = ns;
+    sNumPhases++;
+  }
+}
+
+/*
+ * Returns the time at which this process was forked by init, or -1.  The
+ * kernel gives it to us in clock ticks since boot.
+ */
+static int64_t processStartNs()
+{
+  char buf[512];
+  int fd = open("/proc/self/stat", O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  ssize_t len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0) {
+    return -1;
+  }
+  buf[len] = '\0';
+
+  // The command name may contain spaces, so count fields from the ')'
+  // which ends it.  starttime is field 22; the state after ')' is field 3.
+  char *p = strrchr(buf, ')');
+  if (!p) {
+    return -1;
+  }
+  for (int field = 2; field < 22 && p; field++) {
+    p = strchr(p + 1, ' ');
+  }
+  if (!p) {
+    return -1;
+  }
+  long long ticks = strtoll(p + 1, NULL, 10);
+  return ticks * (1000000000LL / sysconf(_SC_CLK_TCK));
+}
+
+static void writePhases()
+{
+  FILE *out = fopen(sStartupFile, "w");
+  if (!out) {
+    LOG(ANDROID_LOG_WARN, "Couldn't write %s: %s", sStartupFile, strerror(errno));
+    return;
+  }
+  for (int i = 0; i < sNumPhases; i++) {
+    fprintf(out, "phase %lld %s\n", (long long)sPhases[i].ns, sPhases[i].name);
+  }
+  fclose(out);
+}
+
+/*
+ * A small set of library paths, so we only report each one once.
+ */
+class LibrarySet
+{
+public:
+  LibrarySet() : mCount(0) { memset(mHashes, 0, sizeof(mHashes)); }
+
+  // Returns true if |path| wasn't in the set before.
+  bool add(const char *path)
+  {
+    uint32_t hash = 2166136261u;
+    for (const char *c = path; *c; c++) {
+      hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    hash |= 1;  // 0 marks an empty slot
+    for (uint32_t i = 0; i < kSize; i++) {
+      uint32_t slot = (hash + i) % kSize;
+      if (mHashes[slot] == hash) {
+        return false;
+      }
+      if (!mHashes[slot]) {
+        if (mCount == kSize - 1) {
+          return false;
+        }
+        mHashes[slot] = hash;
+        mCount++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  static const uint32_t kSize = 1024;
+  uint32_t mHashes[kSize];
+  uint32_t mCount;
+};
+
+/*
+ * Polls the maps of |pid|, once it has exec'ed |exe|, appending a line to
+ * sStartupFile for each new shared library.
+ */
+static void traceLibraryLoads(pid_t pid, const char *exe)
+{
+  char exeLink[64], mapsPath[64];
+  snprintf(exeLink, sizeof(exeLink), "/proc/%d/exe", pid);
+  snprintf(mapsPath, sizeof(mapsPath), "/proc/%d/maps", pid);
+
+  int64_t deadline = nowNs() + sTraceTimeoutNs;
+  for (;;) {
+    char target[PATH_MAX];
+    ssize_t len = readlink(exeLink, target, sizeof(target) - 1);
+    if (len < 0 || nowNs() > deadline) {
+      return;
+    }
+    target[len] = '\0';
+    if (!strcmp(target, exe)) {
+      break;
+    }
+    usleep(sTracePollUs / 4);
+  }
+
+  FILE *out = fopen(sStartupFile, "a");
+  if (!out) {
+    return;
+  }
+
+  LibrarySet seen;
+  bool sawLibxul = false;
+  int64_t lastNew = nowNs();
+  while (nowNs() < deadline) {
+    FILE *maps = fopen(mapsPath, "r");
+    if (!maps) {
+      break;
+    }
+    int64_t now = nowNs();
+    char line[512];
+    while (fgets(line, sizeof(line), maps)) {
+      char *path = strchr(line, '/');
+      if (!path) {
+        continue;
+      }
+      path[strcspn(path, "\n")] = '\0';
+      size_t len = strlen(path);
+      if (len < 3 || strcmp(path + len - 3, ".so") || !seen.add(path)) {
+        continue;
+      }
+      fprintf(out, "lib %lld %s\n", (long long)now, path);
+      lastNew = now;
+      if (strstr(path, "/libxul.so")) {
+        sawLibxul = true;
+      }
+    }
+    fclose(maps);
+    fflush(out);
+
+    if (sawLibxul && nowNs() - lastNew > sTraceSettleNs) {
+      break;
+    }
+    usleep(sTracePollUs);
+  }
+  fclose(out);
+}
+
+/*
+ * Leaves behind a process tracing our library loads after we exec |exe|.
+ * The tracer is a grandchild, so it's reparented to init rather than
+ * becoming a zombie child of b2g when it exits.
+ */
+static void startLibraryTracer(const char *exe)
+{
+  pid_t parent = getpid();
+  pid_t child = fork();
+  if (child < 0) {
+    LOG(ANDROID_LOG_WARN, "Couldn't fork library tracer: %s", strerror(errno));
+    return;
+  }
+  if (child == 0) {
+    if (fork() == 0) {
+      traceLibraryLoads(parent, exe);
+    }
+    _exit(0);
+  }
+  waitpid(child, NULL, 0);
+}
+
+static void execFallback()
+{
+  execl(sFallbackScript, sFallbackScript, (char *)NULL);
+  LOG(ANDROID_LOG_ERROR, "Failed to exec %s: %s", sFallbackScript, strerror(errno));
+  exit(1);
+}
+
+int main()
+{
+  int64_t launcherStart = nowNs();
+  int64_t processStart = processStartNs();
+  if (processStart >= 0) {
+    markPhase("process-start", processStart);
+  }
+  markPhase("launcher-start", launcherStart);
+
+  umask(0027);
+  setenv("TMPDIR", sTmpDir, 1);
+  mkdir(sTmpDir, 01777);
+  chmod(sTmpDir, 01777);
+
+  struct rlimit rl;
+  rl.rlim_cur = rl.rlim_max = sMaxOpenFiles;
+  if (setrlimit(RLIMIT_NOFILE, &rl)) {
+    LOG(ANDROID_LOG_WARN, "Couldn't raise RLIMIT_NOFILE: %s", strerror(errno));
+  }
+
+  const char *commandPrefix = getenv("COMMAND_PREFIX");
+  if (commandPrefix && *commandPrefix) {
+    execFallback();
+  }
+
+  struct stat st;
+  if (stat(sDefaultB2GDir, &st) || !S_ISDIR(st.st_mode)) {
+    LOG(ANDROID_LOG_WARN, "No %s directory. Letting %s attempt recovery.",
+        sDefaultB2GDir, sFallbackScript);
+    execFallback();
+  }
+  markPhase("recovery-check", nowNs());
+
+  const char *b2gDir = getenv("B2G_DIR");
+  if (!b2gDir || !*b2gDir) {
+    b2gDir = sDefaultB2GDir;
+  }
+
+  char preload[2 * PATH_MAX];
+  char dmd[PATH_MAX];
+  snprintf(preload, sizeof(preload), "%s/libmozglue.so", b2gDir);
+  snprintf(dmd, sizeof(dmd), "%s/libdmd.so", b2gDir);
+  if (!access(dmd, F_OK)) {
+    puts("Running with DMD.");
+    snprintf(preload, sizeof(preload), "%s %s/libmozglue.so", dmd, b2gDir);
+    setenv("DMD", "1", 1);
+  }
+  setenv("LD_PRELOAD", preload, 1);
+
+  char libraryPath[PATH_MAX];
+  snprintf(libraryPath, sizeof(libraryPath), "/vendor/lib:/system/lib:%s", b2gDir);
+  setenv("LD_LIBRARY_PATH", libraryPath, 1);
+  setenv("GRE_HOME", b2gDir, 1);
+  markPhase("preload", nowNs());
+
+  char exe[PATH_MAX];
+  snprintf(exe, sizeof(exe), "%s/b2g", b2gDir);
+
+  char traceLibs[PROPERTY_VALUE_MAX];
+  property_get(sTraceLibsProperty, traceLibs, "0");
+  if (!strcmp(traceLibs, "1")) {
+    startLibraryTracer(exe);
+  }
+
+  markPhase("exec", nowNs());
+  writePhases();
+
+  execl(exe, exe, (char *)NULL);
+  LOG(ANDROID_LOG_ERROR, "Failed to exec %s: %s", exe, strerror(errno));
+  execFallback();
+  return 1;
+}
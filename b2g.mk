@@ -4,11 +4,11 @@ HTTP := android
 
 PRODUCT_PACKAGES += \
 	b2g.sh \
+	b2g-launcher \
 	b2g-info \
 	b2g-ps \
-	fakeperm \
-	fakesched \
-	fakeappops \
+	fakeperm.conf \
+	fakeservices \
 	fs_config \
 	gaia \
 	gecko \
@@ -1,4 +1,7 @@
 #!/system/bin/sh
+# init starts b2g through b2g-launcher, which does the same setup as this
+# script and only execs it to recover /system/b2g or honour COMMAND_PREFIX.
+# Keep the two in sync.
 umask 0027
 export TMPDIR=/data/local/tmp
 mkdir -p $TMPDIR
@@ -19,19 +19,34 @@
 #include <binder/ProcessState.h>
 #include <binder/IServiceManager.h>
 #include <binder/IAppOpsService.h>
+#include <binder/IAppOpsCallback.h>
+#include <cutils/atomic.h>
+#include <private/android_filesystem_config.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "fakeservices.h"
+#include "fakeservicestats.h"
 
 namespace android {
 
 class FakeAppOpsService :
 	public BinderService<FakeAppOpsService>,
-	public BnAppOpsService
+	public BnAppOpsService,
+	public IBinder::DeathRecipient
 {
 public:
     FakeAppOpsService();
     virtual ~FakeAppOpsService();
     static const char *getServiceName() { return "appops"; }
 
+    virtual status_t dump(int fd, const Vector<String16>& args);
+
     virtual int32_t checkOperation(int32_t code, int32_t uid, const String16& packageName);
     virtual int32_t noteOperation(int32_t code, int32_t uid, const String16& packageName);
     virtual int32_t startOperation(int32_t code, int32_t uid, const String16& packageName);
@@ -46,70 +61,449 @@ public:
     virtual void startWatchingMode(int32_t op, const String16& packageName,
             const sp<IAppOpsCallback>& callback);
     virtual void stopWatchingMode(const sp<IAppOpsCallback>& callback);
+
+    virtual void binderDied(const wp<IBinder>& who);
+
+private:
+    // Every (op, uid) pair is MODE_ALLOWED unless it has an entry in this
+    // open-addressed table.  Modes change rarely (only via dumpsys) but are
+    // read on every call, so readers don't take a lock: writers bump mSeq to
+    // an odd value while they modify the table and back to even when done,
+    // and readers retry if mSeq changed under them.
+    struct ModeEntry {
+        volatile int32_t op;  // -1 if the slot is free
+        volatile int32_t uid;
+        volatile int32_t mode;
+    };
+    static const size_t kTableSize = 256;
+
+    // Ops at or above this are counted together in the last slot.
+    static const int32_t kMaxOps = 64;
+
+    // Readers that find a write in progress this many times in a row yield
+    // the CPU, in case they're spinning on the writer's core.
+    static const int kSpinsBeforeYield = 16;
+
+    struct Watcher {
+        int32_t op;
+        String16 packageName;
+        sp<IAppOpsCallback> callback;
+    };
+
+    int32_t lookupMode(int32_t op, int32_t uid);
+    bool setMode(int32_t op, int32_t uid, int32_t mode, bool *changed);
+    void notifyWatchers(const SortedVector<int32_t>& ops);
+    status_t handleDumpCommand(int fd, const Vector<String16>& args);
+    static size_t opIndex(int32_t op);
+
+    enum {
+        METHOD_CHECK_OPERATION,
+        METHOD_NOTE_OPERATION,
+        METHOD_START_OPERATION,
+        METHOD_FINISH_OPERATION,
+        METHOD_GET_TOKEN,
+        METHOD_START_WATCHING_MODE,
+        METHOD_STOP_WATCHING_MODE,
+        NUM_METHODS
+    };
+    static const char* const kMethodNames[NUM_METHODS];
+    ServiceStats mStats;
+
+    Mutex mLock;  // serializes writers of mTable and guards mWatchers
+    volatile int32_t mSeq;
+    ModeEntry mTable[kTableSize];
+    size_t mNumEntries;
+
+    Vector<Watcher> mWatchers;
+
+    volatile int32_t mNoteCount[kMaxOps];
+    volatile int32_t mStartCount[kMaxOps];
+};
+
+const char* const FakeAppOpsService::kMethodNames[NUM_METHODS] = {
+    "checkOperation",
+    "noteOperation",
+    "startOperation",
+    "finishOperation",
+    "getToken",
+    "startWatchingMode",
+    "stopWatchingMode",
 };
 
 FakeAppOpsService::FakeAppOpsService()
   : BnAppOpsService()
+  , mStats(kMethodNames, NUM_METHODS)
+  , mSeq(0)
+  , mNumEntries(0)
 {
+    for (size_t i = 0; i < kTableSize; i++) {
+        mTable[i].op = -1;
+    }
+    for (int32_t i = 0; i < kMaxOps; i++) {
+        mNoteCount[i] = 0;
+        mStartCount[i] = 0;
+    }
 }
 
 FakeAppOpsService::~FakeAppOpsService()
 {
 }
 
+static size_t
+hashOpUid(int32_t op, int32_t uid)
+{
+    return (uint32_t) (op * 31 + uid) * 2654435761u;
+}
+
+size_t
+FakeAppOpsService::opIndex(int32_t op)
+{
+    return (op >= 0 && op < kMaxOps) ? op : kMaxOps - 1;
+}
+
+int32_t
+FakeAppOpsService::lookupMode(int32_t op, int32_t uid)
+{
+    for (int spins = 0;;) {
+        if (spins < kSpinsBeforeYield) {
+            spins++;
+        } else {
+            sched_yield();
+        }
+        int32_t seq = android_atomic_acquire_load(&mSeq);
+        if (seq & 1) {
+            continue;  // a writer is busy
+        }
+
+        int32_t mode = MODE_ALLOWED;
+        for (size_t i = 0, slot = hashOpUid(op, uid) % kTableSize;
+             i < kTableSize && mTable[slot].op != -1;
+             i++, slot = (slot + 1) % kTableSize) {
+            if (mTable[slot].op == op && mTable[slot].uid == uid) {
+                mode = mTable[slot].mode;
+                break;
+            }
+        }
+
+        android_memory_barrier();
+        if (android_atomic_acquire_load(&mSeq) == seq) {
+            return mode;
+        }
+    }
+}
+
+// Must be called with mLock held.  Returns false if the table is full.
+bool
+FakeAppOpsService::setMode(int32_t op, int32_t uid, int32_t mode, bool *changed)
+{
+    *changed = false;
+
+    size_t slot = hashOpUid(op, uid) % kTableSize;
+    size_t i;
+    for (i = 0; i < kTableSize && mTable[slot].op != -1; i++) {
+        if (mTable[slot].op == op && mTable[slot].uid == uid) {
+            break;
+        }
+        slot = (slot + 1) % kTableSize;
+    }
+
+    bool found = i < kTableSize && mTable[slot].op != -1;
+    if (found && mTable[slot].mode == mode) {
+        return true;
+    }
+    if (!found && mode == MODE_ALLOWED) {
+        return true;  // that's the default already
+    }
+    if (!found && mNumEntries >= kTableSize - 1) {
+        return false;  // keep one slot free so probes terminate
+    }
+
+    android_atomic_inc(&mSeq);
+    if (!found) {
+        mTable[slot].uid = uid;
+        mTable[slot].op = op;
+        mNumEntries++;
+    }
+    mTable[slot].mode = mode;
+    android_atomic_inc(&mSeq);
+    *changed = true;
+    return true;
+}
+
+// Tells every watcher of one of |ops| that it changed.  Each watcher gets
+// at most one callback per op, however many uids changed.
+void
+FakeAppOpsService::notifyWatchers(const SortedVector<int32_t>& ops)
+{
+    Vector<Watcher> toNotify;
+    Vector<int32_t> toNotifyOps;
+    {
+        Mutex::Autolock lock(mLock);
+        for (size_t i = 0; i < mWatchers.size(); i++) {
+            for (size_t j = 0; j < ops.size(); j++) {
+                if (mWatchers[i].op == ops[j]) {
+                    toNotify.add(mWatchers[i]);
+                    toNotifyOps.add(ops[j]);
+                }
+            }
+        }
+    }
+
+    // Call out without holding the lock; a callback may well call back in.
+    for (size_t i = 0; i < toNotify.size(); i++) {
+        toNotify[i].callback->opChanged(toNotifyOps[i], toNotify[i].packageName);
+    }
+}
+
+static void
+writeString(int fd, const String8& str)
+{
+    write(fd, str.string(), str.size());
+}
+
+static int32_t
+parseMode(const String8& str)
+{
+    if (str == "allow") return IAppOpsService::MODE_ALLOWED;
+    if (str == "ignore") return IAppOpsService::MODE_IGNORED;
+    if (str == "error") return IAppOpsService::MODE_ERRORED;
+    return -1;
+}
+
+static const char*
+modeName(int32_t mode)
+{
+    switch (mode) {
+    case IAppOpsService::MODE_ALLOWED: return "allow";
+    case IAppOpsService::MODE_IGNORED: return "ignore";
+    case IAppOpsService::MODE_ERRORED: return "error";
+    default: return "?";
+    }
+}
+
+// dumpsys appops set <op> <uid> <allow|ignore|error> [<op> <uid> <mode> ...]
+// dumpsys appops reset
+status_t
+FakeAppOpsService::handleDumpCommand(int fd, const Vector<String16>& args)
+{
+    uid_t callingUid = IPCThreadState::self()->getCallingUid();
+    if (callingUid != AID_ROOT && callingUid != AID_SHELL &&
+        callingUid != AID_SYSTEM) {
+        writeString(fd, String8("Permission denied\n"));
+        return PERMISSION_DENIED;
+    }
+
+    String8 cmd(args[0]);
+    String8 result;
+    SortedVector<int32_t> changedOps;
+    if (cmd == "reset") {
+        Mutex::Autolock lock(mLock);
+        android_atomic_inc(&mSeq);
+        for (size_t i = 0; i < kTableSize; i++) {
+            if (mTable[i].op != -1) {
+                // Entries set back to "allow" stay in the table, but
+                // clearing them changes nothing.
+                if (mTable[i].mode != MODE_ALLOWED) {
+                    changedOps.add((int32_t) mTable[i].op);
+                }
+                mTable[i].op = -1;
+            }
+        }
+        mNumEntries = 0;
+        android_atomic_inc(&mSeq);
+    } else if (cmd == "set" && args.size() > 1 && (args.size() - 1) % 3 == 0) {
+        Mutex::Autolock lock(mLock);
+        for (size_t i = 1; i < args.size(); i += 3) {
+            int32_t op = atoi(String8(args[i]).string());
+            int32_t uid = atoi(String8(args[i + 1]).string());
+            int32_t mode = parseMode(String8(args[i + 2]));
+            if (op < 0 || uid < 0 || mode < 0) {
+                result.appendFormat("Bad op/uid/mode: %s %s %s\n",
+                        String8(args[i]).string(), String8(args[i + 1]).string(),
+                        String8(args[i + 2]).string());
+                continue;
+            }
+            bool changed;
+            if (!setMode(op, uid, mode, &changed)) {
+                result.appendFormat("Too many modes set, ignoring op %d uid %d\n", op, uid);
+            } else if (changed) {
+                changedOps.add(op);
+            }
+        }
+    } else {
+        writeString(fd, String8(
+                "Usage: dumpsys appops [set <op> <uid> <allow|ignore|error> ...]\n"
+                "       dumpsys appops reset\n"));
+        return BAD_VALUE;
+    }
+
+    writeString(fd, result);
+    notifyWatchers(changedOps);
+    return NO_ERROR;
+}
+
+status_t
+FakeAppOpsService::dump(int fd, const Vector<String16>& args)
+{
+    if (args.size() > 0) {
+        return handleDumpCommand(fd, args);
+    }
+
+    String8 result;
+    {
+        Mutex::Autolock lock(mLock);
+        result.append("Modes (everything else is allowed):\n");
+        for (size_t i = 0; i < kTableSize; i++) {
+            if (mTable[i].op != -1) {
+                result.appendFormat("  op %d uid %d: %s\n", mTable[i].op, mTable[i].uid,
+                        modeName(mTable[i].mode));
+            }
+        }
+        result.appendFormat("Watchers: %d\n", (int) mWatchers.size());
+    }
+
+    result.append("Calls per op (note/start):\n");
+    for (int32_t op = 0; op < kMaxOps; op++) {
+        int32_t notes = android_atomic_acquire_load(&mNoteCount[op]);
+        int32_t starts = android_atomic_acquire_load(&mStartCount[op]);
+        if (notes || starts) {
+            result.appendFormat("  op %d%s: %d/%d\n", op,
+                    op == kMaxOps - 1 ? "+" : "", notes, starts);
+        }
+    }
+
+    mStats.dump(result);
+
+    writeString(fd, result);
+    return NO_ERROR;
+}
+
 int32_t
 FakeAppOpsService::checkOperation(int32_t code, int32_t uid, const String16& packageName)
 {
-    return MODE_ALLOWED;
+    ServiceStats::Call call(mStats, METHOD_CHECK_OPERATION);
+    return lookupMode(code, uid);
 }
 
 int32_t
 FakeAppOpsService::noteOperation(int32_t code, int32_t uid, const String16& packageName)
 {
-    return MODE_ALLOWED;
+    ServiceStats::Call call(mStats, METHOD_NOTE_OPERATION);
+    android_atomic_inc(&mNoteCount[opIndex(code)]);
+    return lookupMode(code, uid);
 }
 
 int32_t
 FakeAppOpsService::startOperation(int32_t code, int32_t uid, const String16& packageName)
 {
-    return MODE_ALLOWED;
+    ServiceStats::Call call(mStats, METHOD_START_OPERATION);
+    android_atomic_inc(&mStartCount[opIndex(code)]);
+    return lookupMode(code, uid);
 }
 
 int32_t 
 FakeAppOpsService::startOperation(const sp<IBinder>& token, int32_t code, int32_t uid, 
     const String16& packageName)
 {
-    return MODE_ALLOWED;
+    ServiceStats::Call call(mStats, METHOD_START_OPERATION);
+    android_atomic_inc(&mStartCount[opIndex(code)]);
+    return lookupMode(code, uid);
 }
 
 void
 FakeAppOpsService::finishOperation(int32_t code, int32_t uid, const String16& packageName)
 {
+    ServiceStats::Call call(mStats, METHOD_FINISH_OPERATION);
 }
 
 void
 FakeAppOpsService::finishOperation(const sp<IBinder>& token, int32_t code, int32_t uid, 
     const String16& packageName)
 {
+    ServiceStats::Call call(mStats, METHOD_FINISH_OPERATION);
 }
 
 sp<IBinder>
 FakeAppOpsService::getToken(const sp<IBinder>& clientToken)
 {
+  ServiceStats::Call call(mStats, METHOD_GET_TOKEN);
   return NULL;
 }
 
 void
 FakeAppOpsService::startWatchingMode(int32_t op, const String16& packageName, const sp<IAppOpsCallback>& callback)
 {
+    ServiceStats::Call call(mStats, METHOD_START_WATCHING_MODE);
+
+    if (callback == NULL) {
+        return;
+    }
+
+    Watcher watcher;
+    watcher.op = op;
+    watcher.packageName = packageName;
+    watcher.callback = callback;
+
+    Mutex::Autolock lock(mLock);
+    sp<IBinder> binder = callback->asBinder();
+    bool linked = false;
+    for (size_t i = 0; i < mWatchers.size(); i++) {
+        const Watcher& w = mWatchers[i];
+        if (w.callback->asBinder() == binder) {
+            if (w.op == op && w.packageName == packageName) {
+                return;  // already watching; don't notify it twice
+            }
+            linked = true;
+        }
+    }
+    if (!linked) {
+        binder->linkToDeath(this);
+    }
+    mWatchers.add(watcher);
 }
 
 void
 FakeAppOpsService::stopWatchingMode(const sp<IAppOpsCallback>& callback)
 {
+    ServiceStats::Call call(mStats, METHOD_STOP_WATCHING_MODE);
+
+    if (callback == NULL) {
+        return;
+    }
+
+    Mutex::Autolock lock(mLock);
+    sp<IBinder> binder = callback->asBinder();
+    bool linked = false;
+    for (size_t i = mWatchers.size(); i > 0; i--) {
+        if (mWatchers[i - 1].callback->asBinder() == binder) {
+            mWatchers.removeAt(i - 1);
+            linked = true;
+        }
+    }
+    if (linked) {
+        binder->unlinkToDeath(this);
+    }
+}
+
+void
+FakeAppOpsService::binderDied(const wp<IBinder>& who)
+{
+    Mutex::Autolock lock(mLock);
+    for (size_t i = mWatchers.size(); i > 0; i--) {
+        if (mWatchers[i - 1].callback->asBinder().get() == who.unsafe_get()) {
+            mWatchers.removeAt(i - 1);
+        }
+    }
+}
+
+status_t
+publishFakeAppOpsService()
+{
+    return FakeAppOpsService::publish();
 }
 }; // namespace android
 
+#ifndef FAKESERVICES
 using namespace android;
 
 int main(int argc, char **argv)
@@ -117,3 +511,4 @@ int main(int argc, char **argv)
     FakeAppOpsService::publishAndJoinThreadPool();
     return 0;
 }
+#endif
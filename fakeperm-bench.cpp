@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * fakeperm-bench times fakeperm's checkPermission() in-process, against a
+ * policy and /proc files it writes itself, so no service manager or real
+ * client processes are needed.  It reports the cost of a check answered
+ * from the cache and of one which has to read /proc.
+ *
+ *   fakeperm-bench [<work dir> [<iterations>]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "fakeservices.h"
+
+using namespace android;
+
+static const char kPermission[] = "android.permission.CAMERA";
+
+// More processes than fakeperm caches, so cycling through them always
+// misses.
+static const int kNumPids = 64;
+static const int kFirstPid = 1000;
+static const int kUid = 10001;
+
+static bool
+writeFile(const String8& path, const String8& contents)
+{
+    FILE *f = fopen(path.string(), "w");
+    if (!f) {
+        fprintf(stderr, "Couldn't write %s: %s\n", path.string(), strerror(errno));
+        return false;
+    }
+    fwrite(contents.string(), 1, contents.size(), f);
+    fclose(f);
+    return true;
+}
+
+// Writes <procDir>/<pid>/stat and status, with |groups| on the Groups: line.
+static bool
+writeProcess(const String8& procDir, int pid, uint64_t startTime, const char *groups)
+{
+    String8 dir(procDir);
+    dir.appendFormat("/%d", pid);
+    mkdir(dir.string(), 0755);
+
+    String8 stat;
+    stat.appendFormat("%d (app) S 1 %d %d 0 -1 4194624 5291 0 0 0 45 12 0 0 "
+                      "20 0 11 0 %llu 199233536 10311 4294967295\n",
+                      pid, pid, pid, (unsigned long long) startTime);
+
+    // Real status files are this long; the Groups: line is past the middle.
+    String8 status;
+    status.appendFormat("Name:\tapp\nState:\tS (sleeping)\nTgid:\t%d\nPid:\t%d\n"
+                        "PPid:\t1\nTracerPid:\t0\nUid:\t%d\t%d\t%d\t%d\n"
+                        "Gid:\t%d\t%d\t%d\t%d\nFDSize:\t64\nGroups:\t%s\n"
+                        "VmPeak:\t  194568 kB\nVmSize:\t  194564 kB\nVmLck:\t       0 kB\n"
+                        "VmHWM:\t   41240 kB\nVmRSS:\t   41244 kB\nVmData:\t   84596 kB\n"
+                        "VmStk:\t     136 kB\nVmExe:\t      20 kB\nVmLib:\t   58736 kB\n"
+                        "VmPTE:\t     136 kB\nVmSwap:\t       0 kB\nThreads:\t11\n"
+                        "SigQ:\t0/5792\nSigPnd:\t0000000000000000\nShdPnd:\t0000000000000000\n"
+                        "SigBlk:\t0000000000001204\nSigIgn:\t0000000000001000\n"
+                        "SigCgt:\t00000002000084f8\nCapInh:\t0000000000000000\n"
+                        "CapPrm:\t0000000000000000\nCapEff:\t0000000000000000\n"
+                        "CapBnd:\tffffffffffffffff\nvoluntary_ctxt_switches:\t1219\n"
+                        "nonvoluntary_ctxt_switches:\t1408\n",
+                        pid, pid, kUid, kUid, kUid, kUid, kUid, kUid, kUid, kUid, groups);
+
+    return writeFile(dir + "/stat", stat) && writeFile(dir + "/status", status);
+}
+
+static void
+removeProcess(const String8& procDir, int pid)
+{
+    String8 dir(procDir);
+    dir.appendFormat("/%d", pid);
+    unlink((dir + "/stat").string());
+    unlink((dir + "/status").string());
+    rmdir(dir.string());
+}
+
+static bool
+expect(const sp<IPermissionController>& service, int pid, bool granted, const char *what)
+{
+    if (service->checkPermission(String16(kPermission), pid, kUid) != granted) {
+        fprintf(stderr, "FAILED: %s should be %s\n", what, granted ? "granted" : "denied");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *workDir = argc > 1 ? argv[1] : "/data/local/tmp";
+    int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [<work dir> [<iterations>]]\n", argv[0]);
+        return 1;
+    }
+
+    String8 procDir(workDir);
+    procDir.appendFormat("/fakeperm-bench.%d", getpid());
+    String8 policyFile = procDir + "/fakeperm.conf";
+    if (mkdir(procDir.string(), 0755)) {
+        fprintf(stderr, "Couldn't create %s: %s\n", procDir.string(), strerror(errno));
+        return 1;
+    }
+
+    // gid 1015 is sdcard_rw.
+    bool ok = writeFile(policyFile, String8(kPermission) + " 10000- 1015\n");
+    for (int i = 0; ok && i < kNumPids; i++) {
+        ok = writeProcess(procDir, kFirstPid + i, 5000 + i, "1015 3003");
+    }
+
+    sp<IPermissionController> service =
+        makeFakePermissionService(policyFile.string(), procDir.string());
+    String16 permission(kPermission);
+
+    // Check that the cache notices a pid being reused by a process which
+    // isn't in the group.  (We can't fake a process exiting: unlike a real
+    // stat file, ours still reads after it's deleted.)
+    const int otherPid = kFirstPid + kNumPids;
+    ok = ok &&
+         writeProcess(procDir, otherPid, 1, "1015") &&
+         expect(service, otherPid, true, "a process in the group") &&
+         writeProcess(procDir, otherPid, 2, "3003") &&
+         expect(service, otherPid, false, "a reused pid not in the group");
+    removeProcess(procDir, otherPid);
+
+    if (ok) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < iterations; i++) {
+            service->checkPermission(permission, kFirstPid, kUid);
+        }
+        nsecs_t cached = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < iterations; i++) {
+            service->checkPermission(permission, kFirstPid + i % kNumPids, kUid);
+        }
+        nsecs_t uncached = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        printf("checkPermission, cached:   %8lld ns/call\n",
+               (long long) (cached / iterations));
+        printf("checkPermission, uncached: %8lld ns/call\n",
+               (long long) (uncached / iterations));
+    }
+
+    for (int i = 0; i < kNumPids; i++) {
+        removeProcess(procDir, kFirstPid + i);
+    }
+    unlink(policyFile.string());
+    rmdir(procDir.string());
+    return ok ? 0 : 1;
+}
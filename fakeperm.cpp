@@ -20,6 +20,12 @@
 #include <binder/IServiceManager.h>
 #include <binder/IPermissionController.h>
 #include <private/android_filesystem_config.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
 
 #undef LOG_TAG
 #define LOG_TAG "fakeperm"
@@ -29,99 +35,544 @@
 #define ALOGE LOGE
 #endif
 
+#include "fakeservices.h"
+#include "fakeservicestats.h"
+#include "GonkUnicode.h"
+
 namespace android {
 
+// The policy is read from this file once, at startup.  See fakeperm.conf for
+// the format.  If the file is missing, we fall back to kDefaultPolicy.
+static const char kPolicyFile[] = "/system/etc/fakeperm.conf";
+
+// Camera/audio record permissions are only for apps with the "camera"
+// permission.  These apps are also the only apps granted the AID_SDCARD_RW
+// supplemental group (bug 785592)
+#define _STR(x) #x
+#define STR(x) _STR(x)
+static const char kDefaultPolicy[] =
+    "android.permission.CAMERA        " STR(AID_APP) "- " STR(AID_SDCARD_RW) "\n"
+    "android.permission.RECORD_AUDIO  " STR(AID_APP) "- " STR(AID_SDCARD_RW) "\n";
+
+// Reads the start time (in clock ticks since boot) of a process from field
+// 22 of its /proc/<pid>/stat, open as |fd|.  Returns false if the process
+// has exited; reading a stat file fails once its process is gone, even if
+// the pid has been reused.
+static bool
+readStartTime(int fd, uint64_t *startTime)
+{
+    char buf[512];
+    ssize_t nread = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf) - 1, 0));
+    if (nread <= 0)
+        return false;
+    buf[nread] = '\0';
+
+    // comm may contain spaces and parens, so start after the last ')'.
+    // What follows is field 3 (state); skip to field 22 (starttime).
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return false;
+    for (int field = 2; field < 22 && p; field++) {
+        p = strchr(p + 1, ' ');
+    }
+    if (!p)
+        return false;
+
+    *startTime = strtoull(p + 1, NULL, 10);
+    return true;
+}
+
+// FNV-1a over the UTF-16 code units of |str|.
+static uint32_t
+hashString16(const char16_t *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Writes |permission| to |buf| as UTF-8 for the log.  Unlike String8, this
+// doesn't allocate; a name too long for |buf| is cut short, and an invalid
+// one at its first unpaired surrogate.
+static const char *
+logName(const String16& permission, char *buf, size_t size)
+{
+    memset(buf, 0, size);
+    gonk::utf16_to_utf8_bounded(permission.string(), permission.size(),
+                                buf, size - 1, NULL);
+    return buf;
+}
+
 class FakePermissionService :
     public BinderService<FakePermissionService>,
     public BnPermissionController
 {
 public:
-    FakePermissionService();
+    // fakeperm-bench points us at a fake policy and /proc.
+    FakePermissionService(const char *policyFile = kPolicyFile,
+                          const char *procDir = "/proc");
     virtual ~FakePermissionService();
     static const char *getServiceName() { return "permission"; }
 
     virtual status_t dump(int fd, const Vector<String16>& args);
     virtual bool checkPermission(const String16& permission, int32_t pid, int32_t uid);
+
+private:
+    // One permission from the policy file.  A caller is granted the
+    // permission if its uid is in [uidMin, uidMax] and, unless groupMask is
+    // 0, its process is in at least one of the groups in groupMask.
+    struct Rule {
+        String16 permission;
+        uint32_t hash;
+        int32_t uidMin;
+        int32_t uidMax;
+        uint32_t groupMask;
+    };
+
+    // Rules live in an open-addressed hash table.  It's only ever a few
+    // entries, so it's sized generously to keep probe chains short.
+    static const size_t kMaxRules = 32;
+    static const size_t kTableSize = 64;
+
+    // Every gid mentioned by the policy gets one bit in a group mask.
+    static const size_t kMaxGroups = 32;
+
+    // In UTF-16 code units; real permission names are far shorter.
+    static const size_t kMaxPermissionLength = 128;
+
+    // Camera and audio services check the same client over and over during
+    // a recording session, so we remember the group mask of each process.
+    //
+    // We're only given a pid, and nothing but /proc tells us that the
+    // process has exited and its pid been reused, so a hit isn't free: we
+    // keep the process's stat file open and check that it still reads, with
+    // the same start time.  That's one pread(), where a miss opens, reads
+    // and closes both stat and status, and parses the groups.
+    struct CacheEntry {
+        int32_t pid;   // -1 if the entry is free
+        int statFd;
+        uint64_t startTime;
+        uint32_t groupMask;
+    };
+    static const size_t kCacheSize = 32;
+
+    void loadPolicy();
+    bool parsePolicy(const char *text, const char *source);
+    bool parseUidRange(const char *str, int32_t *uidMin, int32_t *uidMax);
+    int groupBit(gid_t gid, bool add);
+    const Rule *findRule(const String16& permission) const;
+
+    int openStat(int32_t pid);
+    bool readGroupMask(int32_t pid, uint32_t *groupMask);
+    bool findCachedGroupMask(int32_t pid, uint32_t *groupMask);
+    void cacheGroupMask(int32_t pid, int statFd, uint64_t startTime, uint32_t groupMask);
+    static void clearEntry(CacheEntry& e);
+
+    enum { METHOD_CHECK_PERMISSION, NUM_METHODS };
+    static const char* const kMethodNames[NUM_METHODS];
+    ServiceStats mStats;
+
+    Rule mRules[kMaxRules];
+    size_t mNumRules;
+    int8_t mTable[kTableSize];  // index into mRules, or -1
+
+    gid_t mGroups[kMaxGroups];
+    size_t mNumGroups;
+
+    String8 mPolicyFile;
+    String8 mProcDir;
+
+    Mutex mLock;
+    CacheEntry mCache[kCacheSize];
+    size_t mNextEntry;
+};
+
+const char* const FakePermissionService::kMethodNames[NUM_METHODS] = {
+    "checkPermission",
 };
 
-FakePermissionService::FakePermissionService()
+FakePermissionService::FakePermissionService(const char *policyFile,
+                                             const char *procDir)
     : BnPermissionController()
+    , mStats(kMethodNames, NUM_METHODS)
+    , mNumRules(0)
+    , mNumGroups(0)
+    , mPolicyFile(policyFile)
+    , mProcDir(procDir)
+    , mNextEntry(0)
 {
+    for (size_t i = 0; i < kCacheSize; i++) {
+        mCache[i].pid = -1;
+        mCache[i].statFd = -1;
+    }
+    loadPolicy();
 }
 
 FakePermissionService::~FakePermissionService()
 {
+    for (size_t i = 0; i < kCacheSize; i++) {
+        clearEntry(mCache[i]);
+    }
+}
+
+void
+FakePermissionService::loadPolicy()
+{
+    FILE *f = fopen(mPolicyFile.string(), "r");
+    if (f) {
+        String8 text;
+        char buf[256];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            text.append(buf, n);
+        }
+        fclose(f);
+        if (parsePolicy(text.string(), mPolicyFile.string()))
+            return;
+        ALOGE("%s is invalid, using the default policy", mPolicyFile.string());
+    }
+    parsePolicy(kDefaultPolicy, "default policy");
+}
+
+// Each non-blank line not starting with '#' is
+//
+//   <permission> <uid range> [<group> ...]
+//
+// where the uid range is "N-M", "N-" (no upper bound), "N" or "*", and each
+// group is a gid or an android_ids name such as "sdcard_rw".
+bool
+FakePermissionService::parsePolicy(const char *text, const char *source)
+{
+    mNumRules = 0;
+    mNumGroups = 0;
+    memset(mTable, -1, sizeof(mTable));
+
+    // String16 would quietly replace ill-formed UTF-8, and then a rule
+    // wouldn't match the permission its author wrote.
+    size_t errorPos;
+    if (gonk::utf8_validate((const uint8_t *) text, strlen(text), &errorPos) < 0) {
+        ALOGE("%s: invalid UTF-8 at byte %u", source, (unsigned) errorPos);
+        return false;
+    }
+
+    String8 copy(text);
+    char *save;
+    int lineno = 0;
+    for (char *line = strtok_r(copy.lockBuffer(copy.size()), "\n", &save);
+         line; line = strtok_r(NULL, "\n", &save)) {
+        lineno++;
+        char *lsave;
+        char *perm = strtok_r(line, " \t", &lsave);
+        if (!perm || perm[0] == '#')
+            continue;
+
+        char *uids = strtok_r(NULL, " \t", &lsave);
+        Rule rule;
+        if (!uids || !parseUidRange(uids, &rule.uidMin, &rule.uidMax)) {
+            ALOGE("%s:%d: bad uid range", source, lineno);
+            return false;
+        }
+
+        rule.groupMask = 0;
+        char *group;
+        while ((group = strtok_r(NULL, " \t", &lsave))) {
+            gid_t gid = 0;
+            if (isdigit(group[0])) {
+                gid = strtoul(group, NULL, 10);
+            } else {
+                size_t i;
+                for (i = 0; i < android_id_count; i++) {
+                    if (!strcmp(group, android_ids[i].name))
+                        break;
+                }
+                if (i == android_id_count) {
+                    ALOGE("%s:%d: unknown group %s", source, lineno, group);
+                    return false;
+                }
+                gid = android_ids[i].aid;
+            }
+            int bit = groupBit(gid, true);
+            if (bit < 0) {
+                ALOGE("%s:%d: too many groups", source, lineno);
+                return false;
+            }
+            rule.groupMask |= 1u << bit;
+        }
+
+        if (mNumRules == kMaxRules) {
+            ALOGE("%s:%d: too many permissions", source, lineno);
+            return false;
+        }
+        char16_t perm16[kMaxPermissionLength];
+        ssize_t len16 = gonk::utf8_to_utf16_bounded((const uint8_t *) perm, strlen(perm),
+                                                    perm16, kMaxPermissionLength, NULL);
+        if (len16 < 0) {
+            ALOGE("%s:%d: permission name too long", source, lineno);
+            return false;
+        }
+        rule.permission = String16(perm16, len16);
+        rule.hash = hashString16(rule.permission.string(), rule.permission.size());
+        if (findRule(rule.permission)) {
+            ALOGE("%s:%d: duplicate permission %s", source, lineno, perm);
+            return false;
+        }
+
+        size_t slot = rule.hash % kTableSize;
+        while (mTable[slot] != -1) {
+            slot = (slot + 1) % kTableSize;
+        }
+        mTable[slot] = mNumRules;
+        mRules[mNumRules++] = rule;
+    }
+    copy.unlockBuffer();
+    return true;
+}
+
+bool
+FakePermissionService::parseUidRange(const char *str, int32_t *uidMin, int32_t *uidMax)
+{
+    if (!strcmp(str, "*")) {
+        *uidMin = 0;
+        *uidMax = INT_MAX;
+        return true;
+    }
+
+    char *end;
+    *uidMin = strtol(str, &end, 10);
+    if (end == str)
+        return false;
+    if (!*end) {
+        *uidMax = *uidMin;
+        return true;
+    }
+    if (*end != '-')
+        return false;
+    if (!end[1]) {
+        *uidMax = INT_MAX;
+        return true;
+    }
+    const char *max = end + 1;
+    *uidMax = strtol(max, &end, 10);
+    return end != max && !*end && *uidMin <= *uidMax;
+}
+
+int
+FakePermissionService::groupBit(gid_t gid, bool add)
+{
+    for (size_t i = 0; i < mNumGroups; i++) {
+        if (mGroups[i] == gid)
+            return i;
+    }
+    if (!add || mNumGroups == kMaxGroups)
+        return -1;
+    mGroups[mNumGroups] = gid;
+    return mNumGroups++;
+}
+
+const FakePermissionService::Rule *
+FakePermissionService::findRule(const String16& permission) const
+{
+    uint32_t hash = hashString16(permission.string(), permission.size());
+    for (size_t slot = hash % kTableSize; mTable[slot] != -1;
+         slot = (slot + 1) % kTableSize) {
+        const Rule& rule = mRules[mTable[slot]];
+        if (rule.hash == hash &&
+            !gonk::strzcmp16(rule.permission.string(), rule.permission.size(),
+                             permission.string(), permission.size()))
+            return &rule;
+    }
+    return NULL;
 }
 
 status_t
 FakePermissionService::dump(int fd, const Vector<String16>& args)
 {
+    String8 result;
+    mStats.dump(result);
+    write(fd, result.string(), result.size());
     return NO_ERROR;
 }
 
 bool
 FakePermissionService::checkPermission(const String16& permission, int32_t pid, int32_t uid)
 {
+    ServiceStats::Call call(mStats, METHOD_CHECK_PERMISSION);
+    char name[128];
+
     if (0 == uid)
         return true;
 
-    // Camera/audio record permissions are only for apps with the
-    // "camera" permission.  These apps are also the only apps granted
-    // the AID_SDCARD_RW supplemental group (bug 785592)
+    const Rule *rule = findRule(permission);
+    if (!rule) {
+        ALOGE("%s for pid=%d,uid=%d denied: unsupported permission",
+            logName(permission, name, sizeof(name)), pid, uid);
+        return false;
+    }
 
-    if (uid < AID_APP) {
-        ALOGE("%s for pid=%d,uid=%d denied: not an app",
-            String8(permission).string(), pid, uid);
+    if (uid < rule->uidMin || uid > rule->uidMax) {
+        ALOGE("%s for pid=%d,uid=%d denied: uid not allowed",
+            logName(permission, name, sizeof(name)), pid, uid);
         return false;
     }
 
-    String8 perm8(permission);
-    if (perm8 != "android.permission.CAMERA" &&
-        perm8 != "android.permission.RECORD_AUDIO") {
+    if (!rule->groupMask)
+        return true;
 
-        ALOGE("%s for pid=%d,uid=%d denied: unsupported permission",
-            String8(permission).string(), pid, uid);
+    uint32_t groupMask;
+    if (!findCachedGroupMask(pid, &groupMask)) {
+        // A pid we can't get a start time for has exited (or never existed).
+        int statFd = openStat(pid);
+        uint64_t startTime;
+        if (statFd < 0 || !readStartTime(statFd, &startTime)) {
+            if (statFd >= 0)
+                close(statFd);
+            ALOGE("%s for pid=%d,uid=%d denied: no such process",
+                logName(permission, name, sizeof(name)), pid, uid);
+            return false;
+        }
+
+        if (!readGroupMask(pid, &groupMask)) {
+            close(statFd);
+            ALOGE("%s for pid=%d,uid=%d denied: unable to read groups",
+                logName(permission, name, sizeof(name)), pid, uid);
+            return false;
+        }
+        cacheGroupMask(pid, statFd, startTime, groupMask);
+    }
+
+    if (!(groupMask & rule->groupMask)) {
+        ALOGE("%s for pid=%d,uid=%d denied: missing group",
+            logName(permission, name, sizeof(name)), pid, uid);
+        return false;
+    }
+    return true;
+}
+
+// Parses the Groups: line of /proc/<pid>/status into a mask of the groups
+// the policy cares about.
+bool
+FakePermissionService::readGroupMask(int32_t pid, uint32_t *groupMask)
+{
+    char filename[PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/%d/status", mProcDir.string(), pid);
+    int fd = TEMP_FAILURE_RETRY(open(filename, O_RDONLY));
+    if (fd < 0)
         return false;
+
+    char buf[2048];
+    ssize_t total = 0;
+    ssize_t nread;
+    while (total < (ssize_t) sizeof(buf) - 1 &&
+           (nread = TEMP_FAILURE_RETRY(read(fd, buf + total,
+                                            sizeof(buf) - 1 - total))) > 0) {
+        total += nread;
     }
+    close(fd);
+    buf[total] = '\0';
 
-    char filename[32];
-    snprintf(filename, sizeof(filename), "/proc/%d/status", pid);
-    FILE *f = fopen(filename, "r");
-    if (!f) {
-        ALOGE("%s for pid=%d,uid=%d denied: unable to open %s",
-            String8(permission).string(), pid, uid, filename);
+    char *groups = strstr(buf, "\nGroups:");
+    if (!groups)
         return false;
+    groups += strlen("\nGroups:");
+
+    *groupMask = 0;
+    char *end;
+    for (;;) {
+        while (*groups == ' ' || *groups == '\t')
+            groups++;
+        if (!isdigit(*groups))
+            break;
+        int bit = groupBit(strtoul(groups, &end, 10), false);
+        if (bit >= 0)
+            *groupMask |= 1u << bit;
+        groups = end;
     }
+    return true;
+}
 
-    char line[80];
-    while (fgets(line, sizeof(line), f)) {
-        char *save;
-        char *name = strtok_r(line, "\t", &save);
-        if (!name)
-            continue;
+int
+FakePermissionService::openStat(int32_t pid)
+{
+    char filename[PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/%d/stat", mProcDir.string(), pid);
+    return TEMP_FAILURE_RETRY(open(filename, O_RDONLY));
+}
 
-        if (strcmp(name, "Groups:"))
+bool
+FakePermissionService::findCachedGroupMask(int32_t pid, uint32_t *groupMask)
+{
+    Mutex::Autolock lock(mLock);
+    for (size_t i = 0; i < kCacheSize; i++) {
+        CacheEntry& e = mCache[i];
+        if (e.pid != pid)
             continue;
-
-        char *group;
-        while ((group = strtok_r(NULL, " \n", &save))) {
-            #define _STR(x) #x
-            #define STR(x) _STR(x)
-            if (!strcmp(group, STR(AID_SDCARD_RW))) {
-                fclose(f);
-                return true;
-            }
+        uint64_t startTime;
+        if (readStartTime(e.statFd, &startTime) && startTime == e.startTime) {
+            *groupMask = e.groupMask;
+            return true;
         }
-        break;
+        // The process has exited, and perhaps its pid been reused.
+        clearEntry(e);
     }
-    fclose(f);
-
-    ALOGE("%s for pid=%d,uid=%d denied: missing group",
-        String8(permission).string(), pid, uid);
     return false;
 }
+
+// Takes ownership of |statFd|.
+void
+FakePermissionService::cacheGroupMask(int32_t pid, int statFd, uint64_t startTime,
+                                      uint32_t groupMask)
+{
+    Mutex::Autolock lock(mLock);
+
+    // Prefer the entry another thread made for this pid meanwhile, then a
+    // free entry; otherwise evict round-robin.
+    size_t slot = kCacheSize;
+    for (size_t i = 0; i < kCacheSize && slot == kCacheSize; i++) {
+        if (mCache[i].pid == pid)
+            slot = i;
+    }
+    for (size_t i = 0; i < kCacheSize && slot == kCacheSize; i++) {
+        if (mCache[i].pid == -1)
+            slot = i;
+    }
+    if (slot == kCacheSize) {
+        slot = mNextEntry;
+        mNextEntry = (mNextEntry + 1) % kCacheSize;
+    }
+
+    CacheEntry& e = mCache[slot];
+    clearEntry(e);
+    e.pid = pid;
+    e.statFd = statFd;
+    e.startTime = startTime;
+    e.groupMask = groupMask;
+}
+
+/* static */ void
+FakePermissionService::clearEntry(CacheEntry& e)
+{
+    if (e.statFd >= 0)
+        close(e.statFd);
+    e.pid = -1;
+    e.statFd = -1;
+}
+
+status_t
+publishFakePermissionService()
+{
+    return FakePermissionService::publish();
+}
+
+sp<IPermissionController>
+makeFakePermissionService(const char *policyFile, const char *procDir)
+{
+    return new FakePermissionService(policyFile, procDir);
+}
 }; // namespace android
 
+#ifndef FAKESERVICES
 using namespace android;
 
 int main(int argc, char **argv)
@@ -129,3 +580,4 @@ int main(int argc, char **argv)
     FakePermissionService::publishAndJoinThreadPool();
     return 0;
 }
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * fakesched-test calls fakesched's requestPriority() directly, without a
+ * service manager, and checks what happens to threads of its own.  It must
+ * run as root: outside a binder call the caller is the test itself, and
+ * setting SCHED_FIFO needs CAP_SYS_NICE.
+ *
+ *   fakesched-test
+ */
+
+#include <ISchedulingPolicyService.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fakeservices.h"
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+using namespace android;
+
+static const int32_t kMaxPriority = 3;
+
+static int sFailures = 0;
+
+static void
+check(bool ok, const char *what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok)
+        sFailures++;
+}
+
+// A thread that sleeps until |sDone| is written to, and its tid.
+static int sDone[2];
+static pid_t sTid;
+
+static void *
+threadMain(void *)
+{
+    sTid = syscall(__NR_gettid);
+    char c;
+    read(sDone[0], &c, 1);
+    return NULL;
+}
+
+// Returns |tid|'s SCHED_FIFO priority, or 0 if it isn't SCHED_FIFO with
+// SCHED_RESET_ON_FORK.
+static int
+fifoPriority(pid_t tid)
+{
+    struct sched_param param;
+    if (sched_getscheduler(tid) != (SCHED_FIFO | SCHED_RESET_ON_FORK) ||
+        sched_getparam(tid, &param))
+        return 0;
+    return param.sched_priority;
+}
+
+static void
+resetPriority(pid_t tid)
+{
+    struct sched_param param;
+    param.sched_priority = 0;
+    sched_setscheduler(tid, SCHED_OTHER, &param);
+}
+
+int main(int argc, char **argv)
+{
+    if (getuid() != 0) {
+        fprintf(stderr, "%s must run as root.\n", argv[0]);
+        return 1;
+    }
+
+    pipe(sDone);
+    pthread_t thread;
+    pthread_create(&thread, NULL, threadMain, NULL);
+    while (!sTid) {
+        usleep(1000);
+    }
+
+    sp<ISchedulingPolicyService> service = makeFakeSchedulePolicyService(kMaxPriority);
+    pid_t pid = getpid();
+
+    check(service->requestPriority(pid, sTid, 2, false) == 0 && fifoPriority(sTid) == 2,
+          "a priority in range is applied");
+    resetPriority(sTid);
+
+    check(service->requestPriority(pid, sTid, 50, false) == 0 &&
+          fifoPriority(sTid) == kMaxPriority,
+          "a priority above the maximum is clamped");
+    resetPriority(sTid);
+
+    check(service->requestPriority(pid, sTid, 0, false) != 0 && fifoPriority(sTid) == 0,
+          "priority 0 is rejected");
+
+    // An async request is applied by the worker thread some time later.
+    bool granted = service->requestPriority(pid, sTid, 1, true) == 0;
+    for (int i = 0; i < 100 && fifoPriority(sTid) != 1; i++) {
+        usleep(10000);
+    }
+    check(granted && fifoPriority(sTid) == 1, "an async request is applied");
+    resetPriority(sTid);
+
+    // A tid which isn't a thread of the pid the caller names.
+    pid_t child = fork();
+    if (!child) {
+        pause();
+        _exit(0);
+    }
+    check(service->requestPriority(pid, child, 2, false) != 0 && fifoPriority(child) == 0,
+          "a thread of another process is rejected");
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+
+    check(service->requestPriority(pid, child, 2, false) != 0,
+          "a thread which doesn't exist is rejected");
+
+    write(sDone[1], "", 1);
+    pthread_join(thread, NULL);
+
+    printf("%d failure(s)\n", sFailures);
+    return sFailures ? 1 : 0;
+}
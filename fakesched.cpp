@@ -18,10 +18,116 @@
 #include <binder/IPCThreadState.h>
 #include <binder/ProcessState.h>
 #include <binder/IServiceManager.h>
+#include <private/android_filesystem_config.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
 #include <ISchedulingPolicyService.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#undef LOG_TAG
+#define LOG_TAG "fakesched"
+#include <utils/Log.h>
+
+#ifndef ALOGE
+#define ALOGE LOGE
+#endif
+
+#include "fakeservices.h"
+#include "fakeservicestats.h"
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
 
 namespace android {
 
+// Return values of requestPriority(), as in PackageManager.
+static const int kPermissionGranted = 0;
+static const int kPermissionDenied = -1;
+
+// Real-time priorities we hand out are clamped to [1, sMaxPriority].  This
+// matches the range the framework's SchedulingPolicyService allows.
+static const int32_t kMinPriority = 1;
+static int32_t sMaxPriority = 3;
+
+// Puts |tid| into SCHED_FIFO at |prio|.  SCHED_RESET_ON_FORK keeps children
+// of the thread from inheriting real-time scheduling.
+static int
+applyPriority(int32_t pid, int32_t tid, int32_t prio)
+{
+    struct sched_param param;
+    param.sched_priority = prio;
+
+    // Skip the syscall if the thread is already where it asked to be.
+    struct sched_param current;
+    if (sched_getscheduler(tid) == (SCHED_FIFO | SCHED_RESET_ON_FORK) &&
+        sched_getparam(tid, &current) == 0 &&
+        current.sched_priority == prio) {
+        return kPermissionGranted;
+    }
+
+    if (sched_setscheduler(tid, SCHED_FIFO | SCHED_RESET_ON_FORK, &param)) {
+        ALOGE("failed to set priority %d for pid=%d,tid=%d: %s",
+            prio, pid, tid, strerror(errno));
+        return kPermissionDenied;
+    }
+    return kPermissionGranted;
+}
+
+// Applies asynchronous requests on a thread of its own so binder threads
+// return immediately.  Requests for a tid that is already queued replace
+// the queued one, so a client that asks repeatedly costs at most one
+// sched_setscheduler() per pass of the worker.
+class PriorityWorker : public Thread
+{
+public:
+    PriorityWorker() : Thread(false) {}
+
+    void enqueue(int32_t pid, int32_t tid, int32_t prio)
+    {
+        Mutex::Autolock lock(mLock);
+        Request req;
+        req.pid = pid;
+        req.prio = prio;
+        mPending.add(tid, req);
+        mCond.signal();
+    }
+
+private:
+    struct Request {
+        int32_t pid;
+        int32_t prio;
+    };
+
+    virtual bool threadLoop()
+    {
+        KeyedVector<int32_t, Request> pending;
+        {
+            Mutex::Autolock lock(mLock);
+            while (mPending.isEmpty()) {
+                mCond.wait(mLock);
+            }
+            pending = mPending;
+            mPending.clear();
+        }
+
+        for (size_t i = 0; i < pending.size(); i++) {
+            const Request& req = pending.valueAt(i);
+            applyPriority(req.pid, pending.keyAt(i), req.prio);
+        }
+        return true;
+    }
+
+    Mutex mLock;
+    Condition mCond;
+    KeyedVector<int32_t, Request> mPending;
+};
+
 class FakeSchedulePolicyService :
     public BinderService<FakeSchedulePolicyService>,
     public BnSchedulingPolicyService
@@ -33,11 +139,25 @@ public:
 
     virtual status_t dump(int fd, const Vector<String16>& args);
     virtual int requestPriority(int32_t pid, int32_t tid, int32_t prio, bool async);
+
+private:
+    enum { METHOD_REQUEST_PRIORITY, NUM_METHODS };
+    static const char* const kMethodNames[NUM_METHODS];
+    ServiceStats mStats;
+
+    sp<PriorityWorker> mWorker;
+};
+
+const char* const FakeSchedulePolicyService::kMethodNames[NUM_METHODS] = {
+    "requestPriority",
 };
 
 FakeSchedulePolicyService::FakeSchedulePolicyService()
   : BnSchedulingPolicyService()
+  , mStats(kMethodNames, NUM_METHODS)
+  , mWorker(new PriorityWorker())
 {
+    mWorker->run("fakesched");
 }
 
 FakeSchedulePolicyService::~FakeSchedulePolicyService()
@@ -47,20 +167,91 @@ FakeSchedulePolicyService::~FakeSchedulePolicyService()
 status_t
 FakeSchedulePolicyService::dump(int fd, const Vector<String16>& args)
 {
+    String8 result;
+    mStats.dump(result);
+    write(fd, result.string(), result.size());
     return NO_ERROR;
 }
 
 int
 FakeSchedulePolicyService::requestPriority(int32_t pid, int32_t tid, int32_t prio, bool async)
 {
-    return 0; /* PackageManger.PERMISSION_GRANTED */
+    ServiceStats::Call call(mStats, METHOD_REQUEST_PRIORITY);
+
+    // Only audioflinger and friends get to hand out real-time priorities.
+    uid_t callingUid = IPCThreadState::self()->getCallingUid();
+    if (callingUid != AID_ROOT && callingUid != AID_SYSTEM &&
+        callingUid != AID_MEDIA) {
+        ALOGE("priority %d for pid=%d,tid=%d denied: caller uid %d not allowed",
+            prio, pid, tid, callingUid);
+        return kPermissionDenied;
+    }
+
+    if (prio < kMinPriority) {
+        ALOGE("priority %d for pid=%d,tid=%d denied: out of range",
+            prio, pid, tid);
+        return kPermissionDenied;
+    }
+    if (prio > sMaxPriority) {
+        prio = sMaxPriority;
+    }
+
+    // The thread must belong to the process the caller named.
+    char taskdir[64];
+    snprintf(taskdir, sizeof(taskdir), "/proc/%d/task/%d", pid, tid);
+    if (access(taskdir, F_OK)) {
+        ALOGE("priority %d for pid=%d,tid=%d denied: no such thread",
+            prio, pid, tid);
+        return kPermissionDenied;
+    }
+
+    if (async) {
+        mWorker->enqueue(pid, tid, prio);
+        return kPermissionGranted;
+    }
+    return applyPriority(pid, tid, prio);
+}
+
+static void
+setMaxPriority(int32_t maxPriority)
+{
+    if (maxPriority >= kMinPriority) {
+        sMaxPriority = maxPriority;
+    }
+}
+
+status_t
+publishFakeSchedulePolicyService(int32_t maxPriority)
+{
+    setMaxPriority(maxPriority);
+    return FakeSchedulePolicyService::publish();
+}
+
+sp<ISchedulingPolicyService>
+makeFakeSchedulePolicyService(int32_t maxPriority)
+{
+    setMaxPriority(maxPriority);
+    return new FakeSchedulePolicyService();
 }
 }; // namespace android
 
+#ifndef FAKESERVICES
 using namespace android;
 
 int main(int argc, char **argv)
 {
-    FakeSchedulePolicyService::publishAndJoinThreadPool();
+    // fakesched [max-priority]
+    int32_t maxPriority = 0;
+    if (argc > 1) {
+        maxPriority = atoi(argv[1]);
+        if (maxPriority < kMinPriority) {
+            ALOGE("ignoring invalid max priority %s", argv[1]);
+        }
+    }
+
+    publishFakeSchedulePolicyService(maxPriority);
+    ProcessState::self()->startThreadPool();
+    IPCThreadState::self()->joinThreadPool();
     return 0;
 }
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * fakeservices hosts the fake permission, scheduling_policy and appops
+ * services in one process.  Each of them does almost no work per call, so
+ * running them as three daemons mostly costs three copies of libbinder's
+ * mappings and thread pool.
+ *
+ * Which services are built in depends on the platform; see Android.mk.
+ */
+
+#include <binder/IPCThreadState.h>
+#include <binder/ProcessState.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#undef LOG_TAG
+#define LOG_TAG "fakeservices"
+#include <utils/Log.h>
+
+#ifndef ALOGE
+#define ALOGE LOGE
+#endif
+#ifndef ALOGW
+#define ALOGW LOGW
+#endif
+
+#include "fakeservices.h"
+
+using namespace android;
+
+// All three services together see a few calls a second at most, so a
+// couple of binder threads on top of the main one is plenty.  The main
+// thread doesn't count towards libbinder's maximum, and neither does the
+// one startThreadPool() spawns, so we start the pool for N >= 1 and let the
+// driver spawn N - 1 more.
+static const int kDefaultMaxBinderThreads = 2;
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [--max-threads N] [--sched-max-priority N]\n"
+            "\n"
+            "  --max-threads N         Serve calls on at most N threads beyond the\n"
+            "                          main one (default %d).  One is started\n"
+            "                          right away; the binder driver asks for the\n"
+            "                          rest when all of them are busy.  With 0,\n"
+            "                          the main thread serves every call.  Only 0\n"
+            "                          is honoured before Android 4.2.\n"
+            "  --sched-max-priority N  Highest SCHED_FIFO priority handed out by\n"
+            "                          the scheduling_policy service.\n",
+            name, kDefaultMaxBinderThreads);
+}
+
+static bool
+parseIntArg(int argc, char **argv, int *i, int min, int *result)
+{
+    if (*i + 1 >= argc) {
+        return false;
+    }
+    char *end;
+    *result = strtol(argv[++*i], &end, 10);
+    return !*end && *result >= min;
+}
+
+int main(int argc, char **argv)
+{
+    int maxThreads = kDefaultMaxBinderThreads;
+    bool maxThreadsGiven = false;
+    int schedMaxPriority = 0;
+    for (int i = 1; i < argc; i++) {
+        bool ok;
+        if (!strcmp(argv[i], "--max-threads")) {
+            ok = parseIntArg(argc, argv, &i, 0, &maxThreads);
+            maxThreadsGiven = true;
+        } else if (!strcmp(argv[i], "--sched-max-priority")) {
+            ok = parseIntArg(argc, argv, &i, 1, &schedMaxPriority);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            ALOGE("bad argument %s", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    sp<ProcessState> proc(ProcessState::self());
+#if ANDROID_VERSION >= 17
+    if (maxThreads > 0) {
+        proc->setThreadPoolMaxThreadCount(maxThreads - 1);
+    }
+#else
+    // This libbinder can't change the driver's limit, so the pool grows to
+    // its default size whatever we're asked for.
+    if (maxThreadsGiven && maxThreads > 0) {
+        ALOGW("--max-threads %d is ignored before Android 4.2", maxThreads);
+        fprintf(stderr, "%s: --max-threads %d is ignored before Android 4.2\n",
+                argv[0], maxThreads);
+    }
+#endif
+
+    if (publishFakePermissionService() != NO_ERROR) {
+        ALOGE("failed to publish the permission service");
+    }
+#ifdef HAVE_FAKESCHED
+    if (publishFakeSchedulePolicyService(schedMaxPriority) != NO_ERROR) {
+        ALOGE("failed to publish the scheduling_policy service");
+    }
+#endif
+#ifdef HAVE_FAKEAPPOPS
+    if (publishFakeAppOpsService() != NO_ERROR) {
+        ALOGE("failed to publish the appops service");
+    }
+#endif
+
+    // Starting the thread pool spawns one pooled thread right away and lets
+    // the driver ask for more (up to maxThreads - 1) only once every existing
+    // thread is busy.  With maxThreads == 0 we skip that, and the driver's
+    // spawn requests are ignored, so the main thread is the only one.
+    //
+    // That first pooled thread can't be left for the driver to ask for: until
+    // startThreadPool() has run, libbinder drops the driver's request, and the
+    // driver doesn't ask again.  Nor can the main thread exit and leave the
+    // pool to it, because /proc/<pid>/exe and smaps stop reading once the
+    // main thread is gone, and b2g-info and procrank would lose the process.
+    // An idle pool thread costs a few pages of stack.
+    if (maxThreads > 0) {
+        proc->startThreadPool();
+    }
+    IPCThreadState::self()->joinThreadPool();
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FAKE_SERVICES_H
+#define FAKE_SERVICES_H
+
+#include <stdint.h>
+#include <binder/IPermissionController.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+class ISchedulingPolicyService;
+
+/*
+ * Register each fake service with the service manager.  None of these
+ * start the binder thread pool; that's up to the caller.
+ *
+ * fakeperm, fakesched and fakeappops each publish one of these from their
+ * own process.  fakeservices publishes all of them from a single process.
+ */
+status_t publishFakePermissionService();
+
+/*
+ * Make a permission service without publishing it, which reads its policy
+ * from |policyFile| and the processes it checks from |procDir| instead of
+ * /proc.  This is for fakeperm-bench.
+ */
+sp<IPermissionController> makeFakePermissionService(const char *policyFile,
+                                                    const char *procDir);
+
+/*
+ * |maxPriority| is the highest real-time priority the service hands out;
+ * pass 0 for the default.
+ */
+status_t publishFakeSchedulePolicyService(int32_t maxPriority);
+
+/*
+ * Make a scheduling_policy service without publishing it, for
+ * fakesched-test.  Callers need audioflinger's ISchedulingPolicyService.h.
+ */
+sp<ISchedulingPolicyService> makeFakeSchedulePolicyService(int32_t maxPriority);
+
+status_t publishFakeAppOpsService();
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fakeservicestats.h"
+
+#include <binder/IPCThreadState.h>
+#include <cutils/atomic.h>
+#include <string.h>
+
+namespace android {
+
+ServiceStats::ServiceStats(const char* const* methodNames, size_t numMethods)
+    : mMethodNames(methodNames)
+    , mNumMethods(numMethods)
+    , mMethods(new MethodStats[numMethods])
+    , mOtherCallers(0)
+    , mStartTime(systemTime(SYSTEM_TIME_MONOTONIC))
+{
+    memset((void*) mMethods, 0, numMethods * sizeof(MethodStats));
+    memset((void*) mCallers, 0, sizeof(mCallers));
+}
+
+ServiceStats::~ServiceStats()
+{
+    delete[] mMethods;
+}
+
+ServiceStats::Call::Call(ServiceStats& stats, size_t method)
+    : mStats(stats)
+    , mMethod(method)
+    , mStart(systemTime(SYSTEM_TIME_MONOTONIC))
+{
+}
+
+ServiceStats::Call::~Call()
+{
+    IPCThreadState* ipc = IPCThreadState::self();
+    mStats.record(mMethod, systemTime(SYSTEM_TIME_MONOTONIC) - mStart,
+                  ipc->getCallingPid(), ipc->getCallingUid());
+}
+
+void
+ServiceStats::record(size_t method, nsecs_t latency, pid_t pid, uid_t uid)
+{
+    if (method >= mNumMethods) {
+        return;
+    }
+
+    MethodStats& m = mMethods[method];
+    android_atomic_inc(&m.calls);
+
+    int32_t us = latency / 1000;
+    size_t bucket = 0;
+    while (bucket < kNumBuckets - 1 && (us >> (bucket + 1))) {
+        bucket++;
+    }
+    android_atomic_inc(&m.buckets[bucket]);
+
+    int32_t max;
+    while ((max = android_atomic_acquire_load(&m.maxUs)) < us &&
+           android_atomic_cmpxchg(max, us, &m.maxUs)) {
+    }
+
+    // Find or claim this caller's slot.  Under contention a call may be
+    // counted against the slot's previous caller; these are only stats.
+    int32_t now = (systemTime(SYSTEM_TIME_MONOTONIC) - mStartTime) / 1000000000;
+    size_t slot = (uint32_t) pid % kMaxCallers;
+    size_t oldest = slot;
+    for (size_t i = 0; i < kMaxProbes; i++, slot = (slot + 1) % kMaxCallers) {
+        CallerStats& c = mCallers[slot];
+        int32_t current = android_atomic_acquire_load(&c.pid);
+        if (current == 0) {
+            if (!android_atomic_cmpxchg(0, pid, &c.pid)) {
+                current = pid;
+                android_atomic_release_store(uid, &c.uid);
+            } else {
+                // Someone else claimed the slot first; it may have been
+                // another thread of the same caller.
+                current = android_atomic_acquire_load(&c.pid);
+            }
+        }
+        if (current == pid) {
+            int32_t oldUid = android_atomic_acquire_load(&c.uid);
+            if (oldUid != (int32_t) uid &&
+                !android_atomic_cmpxchg(oldUid, uid, &c.uid)) {
+                // A different process, or a different user, than the one
+                // the slot has been counting.
+                retire(c);
+            }
+            android_atomic_inc(&c.calls);
+            android_atomic_release_store(now, &c.lastSeen);
+            return;
+        }
+        if (android_atomic_acquire_load(&c.lastSeen) <
+            android_atomic_acquire_load(&mCallers[oldest].lastSeen)) {
+            oldest = slot;
+        }
+    }
+
+    // No room: take over the least recently seen slot, unless another
+    // thread has just changed its owner.
+    CallerStats& c = mCallers[oldest];
+    int32_t victim = android_atomic_acquire_load(&c.pid);
+    if (victim != 0 && !android_atomic_cmpxchg(victim, pid, &c.pid)) {
+        android_atomic_release_store(uid, &c.uid);
+        retire(c);
+        android_atomic_inc(&c.calls);
+        android_atomic_release_store(now, &c.lastSeen);
+        return;
+    }
+    android_atomic_inc(&mOtherCallers);
+}
+
+// Move a slot's calls over to mOtherCallers, so it can count a new caller.
+void
+ServiceStats::retire(CallerStats& c)
+{
+    int32_t calls;
+    do {
+        calls = android_atomic_acquire_load(&c.calls);
+    } while (android_atomic_cmpxchg(calls, 0, &c.calls));
+    android_atomic_add(calls, &mOtherCallers);
+}
+
+void
+ServiceStats::dump(String8& result) const
+{
+    double uptime = (systemTime(SYSTEM_TIME_MONOTONIC) - mStartTime) / 1e9;
+    result.appendFormat("Calls in the last %.0f s (latencies in us):\n", uptime);
+    result.appendFormat("  %-20s %10s %8s %8s %8s %8s %8s\n",
+                        "method", "calls", "calls/s", "p50<", "p90<", "p99<", "max");
+
+    for (size_t i = 0; i < mNumMethods; i++) {
+        const MethodStats& m = mMethods[i];
+        int32_t calls = android_atomic_acquire_load(&m.calls);
+
+        // Percentiles are the upper bound of the bucket they fall in.
+        int32_t pct[3] = { 0, 0, 0 };
+        static const int kPercentiles[3] = { 50, 90, 99 };
+        int64_t seen = 0;
+        size_t p = 0;
+        for (size_t b = 0; b < kNumBuckets && p < 3; b++) {
+            seen += android_atomic_acquire_load(&m.buckets[b]);
+            while (p < 3 && calls && seen * 100 >= (int64_t) calls * kPercentiles[p]) {
+                pct[p++] = 1 << (b + 1);
+            }
+        }
+
+        result.appendFormat("  %-20s %10d %8.1f %8d %8d %8d %8d\n",
+                            mMethodNames[i], calls, uptime > 0 ? calls / uptime : 0.0,
+                            pct[0], pct[1], pct[2],
+                            android_atomic_acquire_load(&m.maxUs));
+    }
+
+    // Pick out the busiest callers.
+    size_t top[kTopCallers];
+    size_t numTop = 0;
+    for (size_t i = 0; i < kMaxCallers; i++) {
+        if (!mCallers[i].pid) {
+            continue;
+        }
+        size_t j;
+        if (numTop < kTopCallers) {
+            j = numTop++;
+        } else if (mCallers[top[kTopCallers - 1]].calls < mCallers[i].calls) {
+            j = kTopCallers - 1;
+        } else {
+            continue;
+        }
+        while (j > 0 && mCallers[top[j - 1]].calls < mCallers[i].calls) {
+            top[j] = top[j - 1];
+            j--;
+        }
+        top[j] = i;
+    }
+
+    result.append("Top callers:\n");
+    for (size_t i = 0; i < numTop; i++) {
+        const CallerStats& c = mCallers[top[i]];
+        result.appendFormat("  pid %5d uid %5d: %d calls\n", c.pid, c.uid, c.calls);
+    }
+    int32_t others = android_atomic_acquire_load(&mOtherCallers);
+    if (others) {
+        result.appendFormat("  (%d calls from other or earlier callers)\n", others);
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FAKE_SERVICE_STATS_H
+#define FAKE_SERVICE_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Per-method call counters and latency histograms for the fake binder
+ * services, printed by their dump() methods.
+ *
+ * Recording a call never takes a lock: every counter is updated with an
+ * atomic increment, so binder threads don't serialize on the bookkeeping.
+ * Latencies go into power-of-two buckets of microseconds, which is plenty
+ * to tell a 20us call from a 2ms one.
+ *
+ * Usage:
+ *
+ *   static const char* const kMethodNames[] = { "checkPermission" };
+ *   ServiceStats mStats(kMethodNames, 1);
+ *
+ *   bool checkPermission(...)
+ *   {
+ *       ServiceStats::Call call(mStats, 0);
+ *       ...
+ *   }
+ */
+class ServiceStats
+{
+public:
+    ServiceStats(const char* const* methodNames, size_t numMethods);
+    ~ServiceStats();
+
+    /*
+     * Times a call to |method| from its construction to its destruction and
+     * attributes it to the binder caller.
+     */
+    class Call
+    {
+    public:
+        Call(ServiceStats& stats, size_t method);
+        ~Call();
+
+    private:
+        ServiceStats& mStats;
+        size_t mMethod;
+        nsecs_t mStart;
+    };
+
+    void record(size_t method, nsecs_t latency, pid_t pid, uid_t uid);
+
+    /*
+     * Append a human-readable summary to |result|.
+     */
+    void dump(String8& result) const;
+
+private:
+    // Bucket i counts calls that took [2^i, 2^(i+1)) us; the last bucket
+    // also takes everything slower.
+    static const size_t kNumBuckets = 24;
+
+    // Callers are tracked in a small open-addressed table keyed by pid.  A
+    // slot whose pid turns up with a new uid (the pid has been reused, or
+    // the process has changed uid) starts counting again, and once a pid's
+    // probe window is full, its least recently seen caller is evicted.
+    // Calls from reset and evicted slots are only counted in mOtherCallers.
+    static const size_t kMaxCallers = 64;
+    static const size_t kMaxProbes = 8;
+    static const size_t kTopCallers = 5;
+
+    struct MethodStats {
+        volatile int32_t calls;
+        volatile int32_t maxUs;
+        volatile int32_t buckets[kNumBuckets];
+    };
+
+    struct CallerStats {
+        volatile int32_t pid;  // 0 if the slot is free
+        volatile int32_t uid;
+        volatile int32_t calls;
+        volatile int32_t lastSeen;  // seconds since mStartTime
+    };
+
+    void retire(CallerStats& c);
+
+    const char* const* mMethodNames;
+    size_t mNumMethods;
+    MethodStats* mMethods;
+    CallerStats mCallers[kMaxCallers];
+    volatile int32_t mOtherCallers;
+    nsecs_t mStartTime;
+};
+
+}; // namespace android
+
+#endif
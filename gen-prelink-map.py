@@ -0,0 +1,300 @@
+#!/usr/bin/env python
+
+# Generates or checks a prelink map for apriori.
+#
+# apriori assigns each library the fixed load address given in the map.
+# When a library grows past the address of its neighbour, or a library
+# isn't in the map at all, prelinking fails and we pay for relocations at
+# startup.  This script measures the libraries that were actually built and
+#
+#  - with --output, packs them downwards from --start, most frequently
+#    loaded first, and writes a new map;
+#  - with --check, verifies that every library in an existing map fits in
+#    the space below the next library up, and that LIBRARY... are all in
+#    it.  Their dependencies only get a warning if they're missing: apriori
+#    isn't asked to prelink those, so they keep whatever address they were
+#    built with.
+
+from __future__ import print_function
+
+import os
+import struct
+import sys
+from optparse import OptionParser
+
+PT_LOAD = 1
+PT_DYNAMIC = 2
+DT_NULL = 0
+DT_NEEDED = 1
+DT_STRTAB = 5
+PAGE_SIZE = 0x1000
+
+class NotElfError(Exception):
+    pass
+
+class ElfInfo(object):
+    """The load size and DT_NEEDED entries of an ELF shared object."""
+    def __init__(self, path, size, needed):
+        self.path = path
+        self.size = size
+        self.needed = needed
+
+def align_up(value, alignment):
+    return (value + alignment - 1) & ~(alignment - 1)
+
+def align_down(value, alignment):
+    return value & ~(alignment - 1)
+
+def read_elf(path):
+    """Read the program headers and dynamic section of the ELF file at
+    'path' and return an ElfInfo for it"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] != b'\x7fELF':
+        raise NotElfError(path)
+    elf_class = bytearray(data[4:5])[0]
+    order = '<' if bytearray(data[5:6])[0] == 1 else '>'
+    if elf_class == 1:
+        phoff, = struct.unpack_from(order + 'I', data, 28)
+        phentsize, phnum = struct.unpack_from(order + 'HH', data, 42)
+        def phdr(off):
+            (p_type, p_offset, p_vaddr, _, p_filesz, p_memsz, _, _) = \
+                struct.unpack_from(order + '8I', data, off)
+            return p_type, p_offset, p_vaddr, p_filesz, p_memsz
+        dyn_fmt = order + 'iI'
+    elif elf_class == 2:
+        phoff, = struct.unpack_from(order + 'Q', data, 32)
+        phentsize, phnum = struct.unpack_from(order + 'HH', data, 54)
+        def phdr(off):
+            (p_type, _, p_offset, p_vaddr, _, p_filesz, p_memsz, _) = \
+                struct.unpack_from(order + 'IIQQQQQQ', data, off)
+            return p_type, p_offset, p_vaddr, p_filesz, p_memsz
+        dyn_fmt = order + 'qQ'
+    else:
+        raise NotElfError(path)
+
+    loads = []
+    dynamic = None
+    for i in range(phnum):
+        p_type, p_offset, p_vaddr, p_filesz, p_memsz = phdr(phoff + i * phentsize)
+        if p_type == PT_LOAD:
+            loads.append((p_offset, p_vaddr, p_filesz, p_memsz))
+        elif p_type == PT_DYNAMIC:
+            dynamic = (p_offset, p_filesz)
+    if not loads:
+        raise NotElfError(path)
+
+    low = align_down(min(l[1] for l in loads), PAGE_SIZE)
+    high = align_up(max(l[1] + l[3] for l in loads), PAGE_SIZE)
+
+    def file_offset(vaddr):
+        for p_offset, p_vaddr, p_filesz, _ in loads:
+            if p_vaddr <= vaddr < p_vaddr + p_filesz:
+                return vaddr - p_vaddr + p_offset
+        return None
+
+    needed = []
+    if dynamic:
+        entsize = struct.calcsize(dyn_fmt)
+        strtab = None
+        names = []
+        for off in range(dynamic[0], dynamic[0] + dynamic[1], entsize):
+            tag, val = struct.unpack_from(dyn_fmt, data, off)
+            if tag == DT_NULL:
+                break
+            if tag == DT_NEEDED:
+                names.append(val)
+            elif tag == DT_STRTAB:
+                strtab = file_offset(val)
+        if strtab is not None:
+            for name in names:
+                start = strtab + name
+                end = data.index(b'\0', start)
+                needed.append(data[start:end].decode('ascii', 'replace'))
+    return ElfInfo(path, high - low, needed)
+
+def find_library(name, lib_dirs):
+    for d in lib_dirs:
+        path = os.path.join(d, name)
+        if os.path.isfile(path):
+            return path
+    return None
+
+def collect_libraries(roots, lib_dirs):
+    """Return a dict of library name -> ElfInfo for 'roots' and everything
+    they need that can be found in 'lib_dirs', and a dict of library
+    name -> set of names of the roots that end up loading it"""
+    libs = {}
+    loaded_by = {}
+    for root in roots:
+        root_name = os.path.basename(root)
+        pending = [root]
+        seen = set()
+        while pending:
+            path = pending.pop()
+            name = os.path.basename(path)
+            if name in seen:
+                continue
+            seen.add(name)
+            if name not in libs:
+                try:
+                    libs[name] = read_elf(path)
+                except NotElfError:
+                    print("%s is not an ELF file, skipping" % path, file=sys.stderr)
+                    continue
+            loaded_by.setdefault(name, set()).add(root_name)
+            for dep in libs[name].needed:
+                dep_path = find_library(dep, lib_dirs)
+                if dep_path:
+                    pending.append(dep_path)
+                elif dep not in seen:
+                    seen.add(dep)
+                    print("%s needs %s, which isn't in any library directory" % (name, dep),
+                          file=sys.stderr)
+    return libs, loaded_by
+
+def read_counts(filename):
+    """Read 'library count' lines, e.g. from counting the libraries in
+    /proc/*/maps on a device"""
+    counts = {}
+    with open(filename) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) >= 2 and not line.startswith('#'):
+                counts[os.path.basename(fields[0])] = int(fields[1])
+    return counts
+
+def read_map(filename):
+    entries = []
+    with open(filename) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) >= 2 and not line.startswith('#'):
+                entries.append((fields[0], int(fields[1], 16)))
+    return entries
+
+def pack(libs, loaded_by, counts, start, limit_low, limit_high, alignment, slack):
+    """Assign addresses to 'libs', packing them downwards from 'start'.
+    Returns a list of (name, address, size) and a list of errors"""
+    def frequency(name):
+        if name in counts:
+            return counts[name]
+        return len(loaded_by.get(name, ()))
+    order = sorted(libs, key=lambda name: (-frequency(name), name))
+
+    entries = []
+    errors = []
+    top = None
+    for name in order:
+        size = align_up(libs[name].size * (100 + slack) // 100, alignment)
+        if top is None:
+            address = start
+            if address + size > limit_high:
+                errors.append("%s doesn't fit between 0x%08x and 0x%08x"
+                              % (name, address, limit_high))
+        else:
+            address = align_down(top - size, alignment)
+        if address < limit_low:
+            errors.append("ran out of address space at %s (0x%x bytes needed below 0x%08x)"
+                          % (name, size, top))
+            break
+        entries.append((name, address, libs[name].size))
+        top = address
+    return entries, errors
+
+def check(entries, lib_dirs, limit_high, roots, libs):
+    """Check that every library in the map 'entries' fits below the next
+    one up, and that the 'roots' are in it. Returns a list of errors, and a
+    list of warnings about the other 'libs' that the map doesn't cover"""
+    errors = []
+    warnings = []
+    by_address = sorted(entries, key=lambda e: e[1])
+    mapped = set()
+    for i, (name, address) in enumerate(by_address):
+        mapped.add(name)
+        path = find_library(name, lib_dirs)
+        if not path:
+            continue
+        try:
+            size = read_elf(path).size
+        except NotElfError:
+            errors.append("%s is not an ELF file" % path)
+            continue
+        if i + 1 < len(by_address):
+            next_name, limit = by_address[i + 1]
+        else:
+            next_name, limit = "the end of the prelink area", limit_high
+        if address + size > limit:
+            errors.append("%s at 0x%08x needs 0x%x bytes, but %s is at 0x%08x (0x%x short)"
+                          % (name, address, size, next_name, limit,
+                             address + size - limit))
+    for name in sorted(roots):
+        if name not in mapped:
+            errors.append("%s is not in the map" % name)
+    for name in sorted(set(libs) - set(roots)):
+        if name not in mapped:
+            warnings.append("%s, a dependency, is not in the map" % name)
+    return errors, warnings
+
+def main():
+    parser = OptionParser(usage="%prog [options] (--output FILE | --check MAP) [LIBRARY...]")
+    parser.add_option("-L", dest="lib_dirs", action="append", default=[],
+                      help="directory to look for needed libraries in; may be repeated")
+    parser.add_option("-o", "--output", dest="output",
+                      help="write a new map for LIBRARY... and their dependencies")
+    parser.add_option("--check", dest="check",
+                      help="check that the libraries in MAP fit their slots and "
+                           "that LIBRARY... are in it, and warn about any of "
+                           "their dependencies that aren't")
+    parser.add_option("--counts", dest="counts",
+                      help="file of 'library count' lines giving load frequencies; "
+                           "otherwise the number of LIBRARY... loading each library is used")
+    parser.add_option("--start", dest="start", default="0x9e000000",
+                      help="address of the first (most frequently loaded) library [%default]")
+    parser.add_option("--limit-low", dest="limit_low", default="0x90000000",
+                      help="lowest address a library may be given [%default]")
+    parser.add_option("--limit-high", dest="limit_high", default="0xa0000000",
+                      help="end of the prelink area [%default]")
+    parser.add_option("--align", dest="align", default="0x1000",
+                      help="alignment of library addresses [%default]")
+    parser.add_option("--slack", dest="slack", type="int", default=10,
+                      help="percentage of room left for each library to grow [%default]")
+    (options, args) = parser.parse_args()
+    if bool(options.output) == bool(options.check):
+        parser.error("specify one of --output or --check")
+    if options.output and not args:
+        parser.error("specify the libraries to generate a map for")
+
+    limit_high = int(options.limit_high, 16)
+    lib_dirs = list(options.lib_dirs)
+    for arg in args:
+        if os.path.dirname(arg) not in lib_dirs:
+            lib_dirs.append(os.path.dirname(arg))
+    libs, loaded_by = collect_libraries(args, lib_dirs)
+
+    if options.check:
+        roots = [name for name in map(os.path.basename, args) if name in libs]
+        errors, warnings = check(read_map(options.check), lib_dirs, limit_high,
+                                 roots, libs.keys())
+    else:
+        warnings = []
+        alignment = int(options.align, 16)
+        if alignment & (alignment - 1):
+            parser.error("--align must be a power of two")
+        counts = read_counts(options.counts) if options.counts else {}
+        entries, errors = pack(libs, loaded_by, counts,
+                               int(options.start, 16), int(options.limit_low, 16),
+                               limit_high, alignment, options.slack)
+        if not errors:
+            with open(options.output, 'w') as f:
+                for name, address, size in entries:
+                    f.write("%s 0x%08x\n" % (name, address))
+
+    for warning in warnings:
+        print("prelink map: warning: %s" % warning, file=sys.stderr)
+    for error in errors:
+        print("prelink map: %s" % error, file=sys.stderr)
+    return 1 if errors else 0
+
+if __name__=="__main__":
+    sys.exit(main())
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * gonkunicode-bench times libutils' and libgonkunicode's char16_t string
+ * functions on the kind of strings that cross binder: permission and
+ * interface names, and a long string for comparison.  Each pair of strings
+ * is equal, so a compare has to look at every unit.
+ *
+ * It then times UTF-8 <-> UTF-16 conversion of about 4KB of ASCII, Latin,
+ * CJK and emoji text, measuring and then converting as String8 and String16
+ * do, and against libgonkunicode's single-pass bounded conversions.
+ *
+ *   gonkunicode-bench [<iterations>]
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "GonkUnicode.h"
+
+static const char *const kStrings[] = {
+    "android.permission.CAMERA",
+    "android.os.IServiceManager",
+    "android.permission.WRITE_EXTERNAL_STORAGE",
+    NULL  // a 4096 unit string, filled in by main()
+};
+
+static const size_t kLongLength = 4096;
+
+// Each is repeated to make about kLongLength bytes of UTF-8.
+static const struct {
+    const char *name;
+    const char *text;
+} kTexts[] = {
+    { "ASCII", "The quick brown fox jumps over the lazy dog. " },
+    { "Latin", "Größere Maßstäbe für Überprüfungen, déjà vu, naïve café. " },
+    { "CJK", "设置通讯录日历相机。電話の設定を変更する。" },
+    { "emoji", "\xf0\x9f\x98\x80\xf0\x9f\x8e\x89\xf0\x9f\x91\x8d"
+               "\xf0\x9f\x9a\x80\xf0\x9f\x8c\x8d " },
+};
+
+static long long
+nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// The compiler mustn't drop calls whose results we don't use.
+static volatile long sSink;
+
+#define TIME(expr, iterations) ({                       \
+    long long start = nowNs();                          \
+    for (int i = 0; i < (iterations); i++) {            \
+        sSink += (expr);                                \
+    }                                                   \
+    (double) (nowNs() - start) / (iterations);          \
+})
+
+static void
+report(const char *name, double theirs, double ours)
+{
+    printf("  %-14s %9.1f ns %9.1f ns  %5.2fx\n", name, theirs, ours, theirs / ours);
+}
+
+// Like report(), but as throughput over |bytes| bytes of UTF-8.
+static void
+reportRate(const char *name, size_t bytes, double theirs, double ours)
+{
+    printf("  %-22s %7.0f MB/s %7.0f MB/s  %5.2fx\n", name,
+           bytes * 1000 / theirs, bytes * 1000 / ours, theirs / ours);
+}
+
+// Measure, then convert, as String16(const char*) does.
+static ssize_t
+toUtf16(const uint8_t *src, size_t len, char16_t *dst)
+{
+    ssize_t n = utf8_to_utf16_length(src, len);
+    utf8_to_utf16(src, len, dst);
+    return n;
+}
+
+static ssize_t
+gonkToUtf16(const uint8_t *src, size_t len, char16_t *dst)
+{
+    ssize_t n = gonk::utf8_to_utf16_length(src, len);
+    gonk::utf8_to_utf16(src, len, dst);
+    return n;
+}
+
+// Measure, then convert, as String8(const String16&) does.
+static ssize_t
+toUtf8(const char16_t *src, size_t len, char *dst)
+{
+    ssize_t n = utf16_to_utf8_length(src, len);
+    utf16_to_utf8(src, len, dst);
+    return n;
+}
+
+static ssize_t
+gonkToUtf8(const char16_t *src, size_t len, char *dst)
+{
+    ssize_t n = gonk::utf16_to_utf8_length(src, len);
+    gonk::utf16_to_utf8(src, len, dst);
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [<iterations>]\n", argv[0]);
+        return 1;
+    }
+
+    char *longString = (char *) malloc(kLongLength + 1);
+    for (size_t i = 0; i < kLongLength; i++) {
+        longString[i] = 'a' + i % 26;
+    }
+    longString[kLongLength] = 0;
+
+    for (size_t s = 0; s < sizeof(kStrings) / sizeof(kStrings[0]); s++) {
+        const char *str = kStrings[s] ? kStrings[s] : longString;
+        size_t len = strlen(str);
+        char16_t *a = (char16_t *) malloc((len + 1) * sizeof(char16_t));
+        char16_t *b = (char16_t *) malloc((len + 1) * sizeof(char16_t));
+        utf8_to_utf16((const uint8_t *) str, len, a);
+        utf8_to_utf16((const uint8_t *) str, len, b);
+        // strzcmp16_h_n's second string is in network byte order, as it
+        // comes out of a Parcel.
+        char16_t *bn = (char16_t *) malloc((len + 1) * sizeof(char16_t));
+        for (size_t i = 0; i <= len; i++) {
+            bn[i] = htons(b[i]);
+        }
+
+        // Fewer iterations for the long string, so every row takes about
+        // as long.
+        int n = kStrings[s] ? iterations : iterations / 100;
+        if (kStrings[s]) {
+            printf("\"%s\" (%u units)\n", str, (unsigned) len);
+        } else {
+            printf("%u units\n", (unsigned) len);
+        }
+        printf("  %-14s %12s %12s\n", "", "libutils", "gonk");
+        report("strlen16", TIME(strlen16(a), n), TIME(gonk::strlen16(a), n));
+        report("strnlen16", TIME(strnlen16(a, len + 1), n),
+               TIME(gonk::strnlen16(a, len + 1), n));
+        report("strcmp16", TIME(strcmp16(a, b), n), TIME(gonk::strcmp16(a, b), n));
+        report("strncmp16", TIME(strncmp16(a, b, len + 1), n),
+               TIME(gonk::strncmp16(a, b, len + 1), n));
+        report("strzcmp16", TIME(strzcmp16(a, len, b, len), n),
+               TIME(gonk::strzcmp16(a, len, b, len), n));
+        report("strzcmp16_h_n", TIME(strzcmp16_h_n(a, len, bn, len), n),
+               TIME(gonk::strzcmp16_h_n(a, len, bn, len), n));
+
+        free(a);
+        free(b);
+        free(bn);
+    }
+    free(longString);
+
+    for (size_t t = 0; t < sizeof(kTexts) / sizeof(kTexts[0]); t++) {
+        size_t pieceLen = strlen(kTexts[t].text);
+        size_t len = kLongLength / pieceLen * pieceLen;
+        uint8_t *utf8 = (uint8_t *) malloc(len + 1);
+        for (size_t i = 0; i < len; i += pieceLen) {
+            memcpy(utf8 + i, kTexts[t].text, pieceLen);
+        }
+        utf8[len] = 0;
+        size_t units = utf8_to_utf16_length(utf8, len);
+        char16_t *utf16 = (char16_t *) malloc((units + 1) * sizeof(char16_t));
+        utf8_to_utf16(utf8, len, utf16);
+        char *out8 = (char *) malloc(len + 1);
+        char16_t *out16 = (char16_t *) malloc((units + 1) * sizeof(char16_t));
+        size_t errorPos;
+
+        int n = iterations / 100;
+        printf("%s text, %u bytes, %u units\n", kTexts[t].name,
+               (unsigned) len, (unsigned) units);
+        printf("  %-22s %12s %12s\n", "", "libutils", "gonk");
+        reportRate("utf8_to_utf16", len, TIME(toUtf16(utf8, len, out16), n),
+                   TIME(gonkToUtf16(utf8, len, out16), n));
+        reportRate("utf8_to_utf16_bounded", len, TIME(toUtf16(utf8, len, out16), n),
+                   TIME(gonk::utf8_to_utf16_bounded(utf8, len, out16, units + 1,
+                                                    &errorPos), n));
+        reportRate("utf16_to_utf8", len, TIME(toUtf8(utf16, units, out8), n),
+                   TIME(gonkToUtf8(utf16, units, out8), n));
+        reportRate("utf16_to_utf8_bounded", len, TIME(toUtf8(utf16, units, out8), n),
+                   TIME(gonk::utf16_to_utf8_bounded(utf16, units, out8, len + 1,
+                                                    &errorPos), n));
+
+        free(utf8);
+        free(utf16);
+        free(out8);
+        free(out16);
+    }
+    return 0;
+}
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2013 Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * gonkunicode-test runs libgonkunicode and libutils on the same random
+ * strings and checks that they return the same results.  char16_t strings
+ * end right before an unmapped page, so a vector load which reads past the
+ * end of a string crashes the test.  utf8_index, which libutils has no
+ * counterpart for, is checked against a byte-by-byte walk of the string.
+ *
+ *   gonkunicode-test [<iterations>]
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "GonkUnicode.h"
+#include "Utf8Index.h"
+
+static const size_t kMaxLength = 200;
+
+static int sFailures = 0;
+
+static void
+check(bool ok, const char *what, unsigned iteration)
+{
+    if (!ok && sFailures++ < 20) {
+        printf("FAIL: %s, iteration %u\n", what, iteration);
+    }
+}
+
+// xorshift, so runs are repeatable everywhere.
+static uint32_t
+random32()
+{
+    static uint32_t x = 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// Returns |count| char16_t units which end right before an unmapped page.
+static char16_t *
+guarded16(size_t count)
+{
+    static char *sPages;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (!sPages) {
+        sPages = (char *) mmap(NULL, 2 * pageSize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        mprotect(sPages + pageSize, pageSize, PROT_NONE);
+    }
+    return (char16_t *) (sPages + pageSize) - count;
+}
+
+// Fills |s| with |len| units, mostly ASCII, some from the rest of the BMP,
+// and some lone surrogates, but never a high surrogate last (libutils reads
+// past the end for that).
+static void
+randomUtf16(char16_t *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        uint32_t r = random32();
+        switch (r % 8) {
+        case 0: s[i] = 0x80 + (r >> 8) % 0xD780; break;
+        case 1: s[i] = 0xD800 + (r >> 8) % 0x800; break;
+        case 2: s[i] = 0xE000 + (r >> 8) % 0x2000; break;
+        default: s[i] = 1 + (r >> 8) % 0x7F; break;
+        }
+    }
+    if (len && (s[len - 1] & 0xFC00) == 0xD800) {
+        s[len - 1] = 'x';
+    }
+    // Surrogate pairs.
+    for (size_t i = 0; i + 1 < len; i += 7) {
+        if (random32() % 4 == 0) {
+            s[i] = 0xD800 + random32() % 0x400;
+            s[i + 1] = 0xDC00 + random32() % 0x400;
+        }
+    }
+}
+
+// Fills |s| with about |len| bytes of UTF-8: runs of ASCII, 2-4 byte
+// sequences, and now and then a byte which doesn't belong.  There are no
+// NULs.  Returns the length.
+static size_t
+randomUtf8(uint8_t *s, size_t len)
+{
+    static const char *const kPieces[] = {
+        "\xc3\xa9", "\xe4\xb8\xad", "\xf0\x9f\x98\x80", "\x80", "\xed\xa0\x80",
+        "\xc0\xaf", "\xf4\x90\x80\x80", "\xff"
+    };
+    size_t n = 0;
+    while (n < len) {
+        uint32_t r = random32();
+        if (r % 3) {
+            size_t run = 1 + (r >> 8) % 40;
+            for (size_t i = 0; i < run && n < len; i++, n++) {
+                s[n] = 'a' + n % 26;
+            }
+            continue;
+        }
+        const char *piece = kPieces[(r >> 8) % (random32() % 8 ? 3 : 8)];
+        size_t pieceLen = strlen(piece);
+        if (n + pieceLen > len) {
+            break;
+        }
+        memcpy(s + n, piece, pieceLen);
+        n += pieceLen;
+    }
+    // Sometimes cut a sequence short.
+    if (n > 2 && random32() % 5 == 0) {
+        n -= random32() % 3;
+    }
+    s[n] = 0;
+    return n;
+}
+
+static void
+testString16(unsigned it)
+{
+    size_t la = random32() % 70;
+    size_t lb = random32() % 3 ? la : random32() % 70;
+    char16_t *a = guarded16(la + 1);
+    char16_t b[kMaxLength + 1];
+    bool ascii = random32() % 2;
+    for (size_t i = 0; i < la; i++) {
+        a[i] = 1 + random32() % (ascii ? 4 : 0xFFFF);
+    }
+    a[la] = 0;
+    for (size_t i = 0; i < lb; i++) {
+        b[i] = (i < la && random32() % 50) ? a[i] : 1 + random32() % (ascii ? 4 : 0xFFFF);
+    }
+    b[lb] = 0;
+    size_t n = random32() % 80;
+
+    check(gonk::strlen16(a) == strlen16(a), "strlen16", it);
+    check(gonk::strnlen16(a, n) == strnlen16(a, n), "strnlen16", it);
+    check(gonk::strcmp16(a, b) == strcmp16(a, b), "strcmp16", it);
+    check(gonk::strcmp16(b, a) == strcmp16(b, a), "strcmp16", it);
+    check(gonk::strncmp16(a, b, n) == strncmp16(a, b, n), "strncmp16", it);
+    check(gonk::strzcmp16(a, la, b, lb) == strzcmp16(a, la, b, lb), "strzcmp16", it);
+
+    for (size_t i = 0; i <= lb; i++) {
+        b[i] = htons(b[i]);
+    }
+    check(gonk::strzcmp16_h_n(a, la, b, lb) == strzcmp16_h_n(a, la, b, lb),
+          "strzcmp16_h_n", it);
+}
+
+static void
+testUtf16ToUtf8(unsigned it)
+{
+    size_t len = random32() % kMaxLength;
+    char16_t *src = guarded16(len);
+    randomUtf16(src, len);
+
+    ssize_t expected = utf16_to_utf8_length(src, len);
+    check(gonk::utf16_to_utf8_length(src, len) == expected, "utf16_to_utf8_length", it);
+    if (expected < 0) {
+        return;
+    }
+
+    // With lone surrogates, libutils doesn't write as many bytes as it
+    // measured, so compare whole buffers.
+    char ours[3 * kMaxLength + 1], theirs[3 * kMaxLength + 1];
+    memset(ours, 0, sizeof(ours));
+    memset(theirs, 0, sizeof(theirs));
+    gonk::utf16_to_utf8(src, len, ours);
+    utf16_to_utf8(src, len, theirs);
+    check(!memcmp(ours, theirs, sizeof(ours)), "utf16_to_utf8", it);
+
+    // The bounded conversion must agree wherever the input is well-formed.
+    size_t errorPos;
+    ssize_t bounded = gonk::utf16_to_utf8_bounded(src, len, ours, sizeof(ours), &errorPos);
+    if (bounded >= 0) {
+        check(bounded == expected && !memcmp(ours, theirs, expected),
+              "utf16_to_utf8_bounded", it);
+    } else {
+        check(bounded == gonk::kUnicodeInvalidInput &&
+              (src[errorPos] & 0xF800) == 0xD800,
+              "utf16_to_utf8_bounded error", it);
+    }
+}
+
+static void
+testUtf8(unsigned it)
+{
+    uint8_t src[kMaxLength + 1];
+    size_t len = randomUtf8(src, random32() % kMaxLength);
+
+    ssize_t expected = utf8_to_utf16_length(src, len);
+    check(gonk::utf8_to_utf16_length(src, len) == expected, "utf8_to_utf16_length", it);
+    if (expected < 0) {
+        return;
+    }
+
+    // libutils measures and converts ill-formed input differently, so
+    // compare whole buffers.
+    char16_t ours[kMaxLength + 1], theirs[kMaxLength + 1];
+    memset(ours, 0, sizeof(ours));
+    memset(theirs, 0, sizeof(theirs));
+    gonk::utf8_to_utf16(src, len, ours);
+    utf8_to_utf16(src, len, theirs);
+    check(!memcmp(ours, theirs, sizeof(ours)), "utf8_to_utf16", it);
+
+    const char *s = (const char *) src;
+    check(gonk::utf8_length(s) == utf8_length(s), "utf8_length", it);
+    size_t utf32Len = utf8_to_utf32_length(s, len);
+    check(gonk::utf8_to_utf32_length(s, len) == utf32Len, "utf8_to_utf32_length", it);
+
+    char32_t ours32[kMaxLength + 1], theirs32[kMaxLength + 1];
+    memset(ours32, 0, sizeof(ours32));
+    memset(theirs32, 0, sizeof(theirs32));
+    gonk::utf8_to_utf32(s, len, ours32);
+    utf8_to_utf32(s, len, theirs32);
+    check(!memcmp(ours32, theirs32, sizeof(ours32)), "utf8_to_utf32", it);
+
+    size_t index = len ? random32() % len : 0;
+    size_t oursNext = 0, theirsNext = 0;
+    check(gonk::utf32_from_utf8_at(s, len, index, &oursNext) ==
+          utf32_from_utf8_at(s, len, index, &theirsNext) && oursNext == theirsNext,
+          "utf32_from_utf8_at", it);
+
+    if (utf32_to_utf8_length(theirs32, utf32Len) >= 0) {
+        check(gonk::utf32_to_utf8_length(theirs32, utf32Len) ==
+              utf32_to_utf8_length(theirs32, utf32Len), "utf32_to_utf8_length", it);
+        char ours8[4 * kMaxLength + 1], theirs8[4 * kMaxLength + 1];
+        gonk::utf32_to_utf8(theirs32, utf32Len, ours8);
+        utf32_to_utf8(theirs32, utf32Len, theirs8);
+        check(!strcmp(ours8, theirs8), "utf32_to_utf8", it);
+    }
+
+    // libutils accepts some ill-formed UTF-8; the strict functions only
+    // have to agree with it on what they accept.
+    size_t errorPos;
+    ssize_t validated = gonk::utf8_validate(src, len, &errorPos);
+    ssize_t bounded = gonk::utf8_to_utf16_bounded(src, len, ours, kMaxLength, &errorPos);
+    check(validated == bounded, "utf8_validate", it);
+    if (bounded >= 0) {
+        check(bounded == expected &&
+              !memcmp(ours, theirs, expected * sizeof(char16_t)),
+              "utf8_to_utf16_bounded", it);
+    }
+}
+
+static void
+testUtf8Index(unsigned it)
+{
+    uint8_t src[kMaxLength + 1];
+    size_t len = randomUtf8(src, random32() % kMaxLength);
+    size_t errorPos;
+    if (gonk::utf8_validate(src, len, &errorPos) < 0) {
+        len = errorPos;
+    }
+    const char *s = (const char *) src;
+
+    // The byte offset of every code point, and the end of the string.
+    size_t offsets[kMaxLength + 1];
+    size_t length = 0;
+    for (size_t i = 0; i < len; i++) {
+        if ((src[i] & 0xC0) != 0x80) {
+            offsets[length++] = i;
+        }
+    }
+    offsets[length] = len;
+
+    utf8_index index;
+    utf8_index_init(&index, s, len, 1 + random32() % 20);
+    check(utf8_index_length(&index) == (ssize_t) length, "utf8_index_length", it);
+    bool ok = true;
+    for (size_t cp = 0; cp <= length; cp++) {
+        ok = ok && utf8_index_offset(&index, cp) == (ssize_t) offsets[cp];
+    }
+    check(ok && utf8_index_offset(&index, length + 1) == -1, "utf8_index_offset", it);
+
+    // Walk the string, with a seek now and then.
+    utf8_cursor cursor;
+    utf8_cursor_init(&cursor, &index);
+    ok = true;
+    for (size_t cp = 0; cp < length; cp++) {
+        if (random32() % 8 == 0) {
+            cp = random32() % length;
+            ok = ok && utf8_cursor_seek(&cursor, cp) == 0;
+        }
+        size_t next;
+        int32_t expected = gonk::utf32_from_utf8_at(s, len, offsets[cp], &next);
+        ok = ok && utf8_cursor_next(&cursor) == expected && cursor.offset == offsets[cp + 1];
+    }
+    ok = ok && utf8_cursor_next(&cursor) == -1 && utf8_cursor_seek(&cursor, length + 1) == -1;
+    check(ok, "utf8_cursor", it);
+    utf8_index_release(&index);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    for (unsigned i = 0; i < iterations; i++) {
+        testString16(i);
+        testUtf16ToUtf8(i);
+        testUtf8(i);
+        testUtf8Index(i);
+    }
+    printf("%d failure(s)\n", sFailures);
+    return sFailures ? 1 : 0;
+}
@@ -35,6 +35,16 @@
  *     # Send SIGRTMIN + 2 to process 123.  (We don't parse any of the
  *     # friendly signal names other than "SIGRT".)
  *     $ killer SIGRT2 123
+ *
+ *     # Send SIGRTMIN + 0 to every B2G process (main and children).
+ *     $ killer --all-b2g SIGRT0
+ *
+ *     # Send SIGRTMIN + 1 to every B2G child process.
+ *     $ killer --children SIGRT1
+ *
+ *     # Send SIGRTMIN + 0 to every B2G process and wait (for at most 30
+ *     # seconds) until each of them has written a file into /data/local/tmp.
+ *     $ killer --wait /data/local/tmp --timeout 30 --all-b2g SIGRT0
  */
 
 #include <stdio.h>
@@ -43,6 +53,11 @@
 #include <signal.h>
 #include <malloc.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
 
 using namespace std;
 
@@ -55,6 +70,13 @@ static const char *sAllowedExes[] = {
   "/system/b2g/plugin-container"
 };
 
+// Index into sAllowedExes of the main B2G executable.  Every other entry is
+// a child process executable.
+static const int  sMainExeIndex = 0;
+
+// How long --wait waits for dump files when no --timeout is given.
+static const int  sDefaultWaitTimeoutSecs = 60;
+
 #define ARRAY_LENGTH(x) (sizeof(x)/sizeof(x[0]))
 
 void usage(int argc, char** argv)
@@ -62,10 +84,20 @@ void usage(int argc, char** argv)
   assert(argc >= 1);
   fprintf(stderr, "Usage: %s SIGNUM PID [PID ...]\n", argv[0]);
   fprintf(stderr, "Usage: %s SIGRT<N> PID [PID...]\n", argv[0]);
+  fprintf(stderr, "Usage: %s --all-b2g SIGRT<N>\n", argv[0]);
+  fprintf(stderr, "Usage: %s --children SIGRT<N>\n", argv[0]);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Any of these may be preceded by --wait DIR [--timeout SECS].\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "For example,\n\n");
   fprintf(stderr, "  %s SIGRT2 123\n\n", argv[0]);
   fprintf(stderr, "will send signal SIGRTMIN + 2 to process 123.\n\n");
+  fprintf(stderr, "--all-b2g sends the signal to every B2G process and\n");
+  fprintf(stderr, "--children sends it only to the B2G child processes.\n\n");
+  fprintf(stderr, "--wait DIR makes us exit only once every signalled process\n");
+  fprintf(stderr, "has finished writing a file with its pid in the name into\n");
+  fprintf(stderr, "DIR, or once SECS seconds (default %d) have passed.\n\n",
+          sDefaultWaitTimeoutSecs);
   fprintf(stderr, "(We don't parse parse any friendly signal names other than ");
   fprintf(stderr, "\"SIGRT\" at the moment.)\n");
   fprintf(stderr, "\n");
@@ -73,6 +105,201 @@ void usage(int argc, char** argv)
   fprintf(stderr, "the /system/b2g/b2g and /system/b2g/plugin-container programs.\n");
 }
 
+/*
+ * Look up the executable of process |pid| in sAllowedExes.  Returns the index
+ * of the matching entry, or -1 if the process doesn't exist or isn't running
+ * one of the allowed executables.
+ */
+static int allowedExeIndex(int pid, char* exe, size_t exeSize)
+{
+  // We could use MAX_PATH_LEN, but this is 4K, and we know our strings
+  // can't possibly be that long, so we save some memory.
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+  int linklen = readlink(path, exe, exeSize - 1);
+  if (linklen < 0) {
+    exe[0] = '\0';
+    return -1;
+  }
+  exe[linklen] = '\0';
+  for (int i = 0; i < ARRAY_LENGTH(sAllowedExes); i++) {
+    if (strcmp(exe, sAllowedExes[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static bool sendSignal(int pid, int signum)
+{
+  if (kill(pid, signum)) {
+    fprintf(stderr, "Failed to send signal %d to process %d", signum, pid);
+    perror("");
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Walk /proc once and signal every process running one of the allowed
+ * executables, skipping the main B2G process if |childrenOnly|.  Processes
+ * are signalled as soon as they're found, so there's no window between
+ * discovering a pid and signalling it other than the readlink itself.
+ *
+ * The pids we signalled are stored in a malloc'ed array in |*pids|.
+ */
+static int signalAllB2G(int signum, bool childrenOnly, int** pids, int* numPids)
+{
+  *pids = NULL;
+  *numPids = 0;
+
+  DIR* proc = opendir("/proc");
+  if (!proc) {
+    perror("Error opening /proc");
+    return 1;
+  }
+
+  int capacity = 0;
+  struct dirent* de;
+  while ((de = readdir(proc))) {
+    char* endptr = NULL;
+    int pid = strtol(de->d_name, &endptr, /* base */ 10);
+    if (*endptr || pid <= 0) {
+      continue;
+    }
+
+    char exe[64];
+    int index = allowedExeIndex(pid, exe, sizeof(exe));
+    if (index < 0 || (childrenOnly && index == sMainExeIndex)) {
+      continue;
+    }
+
+    if (!sendSignal(pid, signum)) {
+      continue;
+    }
+
+    if (*numPids == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      *pids = (int*) realloc(*pids, capacity * sizeof(int));
+      if (!*pids) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        exit(1);
+      }
+    }
+    (*pids)[(*numPids)++] = pid;
+  }
+  closedir(proc);
+
+  if (*numPids == 0) {
+    fprintf(stderr, "Error: No B2G processes found.\n");
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Does |name| contain |pid| as a whole number, i.e. not as part of a longer
+ * run of digits?  Gecko names its dumps e.g. "memory-report-<id>-<pid>.json.gz"
+ * and "cc-edges.<pid>-<n>.log", so this is enough to recognize them.
+ */
+static bool nameHasPid(const char* name, int pid)
+{
+  char pidstr[16];
+  int pidlen = snprintf(pidstr, sizeof(pidstr), "%d", pid);
+  for (const char* p = strstr(name, pidstr); p; p = strstr(p + 1, pidstr)) {
+    bool digitBefore = p > name && p[-1] >= '0' && p[-1] <= '9';
+    bool digitAfter = p[pidlen] >= '0' && p[pidlen] <= '9';
+    if (!digitBefore && !digitAfter) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static long long nowMs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Block until every pid in |pids| has a finished file in the directory
+ * watched by |inotifyFd|, or until |timeoutSecs| have elapsed.
+ *
+ * A file counts once it has been closed after writing or renamed into the
+ * directory.  Gecko writes its dumps under a "tmp-" prefix and renames them
+ * when they're complete, so we ignore files with that prefix.
+ */
+static int waitForDumps(int inotifyFd, const int* pids, int numPids,
+                        int timeoutSecs)
+{
+  bool* done = new bool[numPids];
+  int numDone = 0;
+  for (int i = 0; i < numPids; i++) {
+    done[i] = false;
+  }
+
+  long long deadline = nowMs() + (long long) timeoutSecs * 1000;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  while (numDone < numPids) {
+    long long remaining = deadline - nowMs();
+    if (remaining <= 0) {
+      break;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = inotifyFd;
+    pfd.events = POLLIN;
+    int rv = poll(&pfd, 1, (int) remaining);
+    if (rv < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rv < 0) {
+      perror("Error waiting for dump files");
+      break;
+    }
+    if (rv == 0) {
+      break;
+    }
+
+    ssize_t len = read(inotifyFd, buf, sizeof(buf));
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      perror("Error reading inotify events");
+      break;
+    }
+
+    // Handle every event in this batch before polling again.
+    for (char* p = buf; p < buf + len; ) {
+      struct inotify_event* event = (struct inotify_event*) p;
+      p += sizeof(struct inotify_event) + event->len;
+
+      if (!event->len || !strncmp(event->name, "tmp-", strlen("tmp-"))) {
+        continue;
+      }
+      for (int i = 0; i < numPids; i++) {
+        if (!done[i] && nameHasPid(event->name, pids[i])) {
+          done[i] = true;
+          numDone++;
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < numPids; i++) {
+    if (!done[i]) {
+      fprintf(stderr, "Timed out waiting for a dump from process %d.\n", pids[i]);
+    }
+  }
+  delete[] done;
+
+  return numDone == numPids ? 0 : 2;
+}
+
 int main(int argc, char** argv)
 {
   if (argc < 3) {
@@ -81,11 +308,60 @@ int main(int argc, char** argv)
     exit(1);
   }
 
+  /*
+   * Parse the options.  --all-b2g and --children replace the pid list, so
+   * they must come last before the signal and nothing may follow it.
+   */
+  bool broadcast = false;
+  bool childrenOnly = false;
+  const char* waitDir = NULL;
+  int timeoutSecs = sDefaultWaitTimeoutSecs;
+  int argi = 1;
+  while (argi < argc - 1 && !broadcast) {
+    if (!strcmp(argv[argi], "--all-b2g")) {
+      broadcast = true;
+    } else if (!strcmp(argv[argi], "--children")) {
+      broadcast = true;
+      childrenOnly = true;
+    } else if (!strcmp(argv[argi], "--wait")) {
+      waitDir = argv[++argi];
+    } else if (!strcmp(argv[argi], "--timeout")) {
+      char* endptr = NULL;
+      timeoutSecs = strtol(argv[++argi], &endptr, /* base */ 10);
+      if (*endptr || timeoutSecs <= 0) {
+        fprintf(stderr, "Error: Invalid timeout %s\n", argv[argi]);
+        usage(argc, argv);
+        exit(1);
+      }
+    } else {
+      break;
+    }
+    argi++;
+  }
+
+  if (argi >= argc) {
+    fprintf(stderr, "Error: Not enough arguments.\n");
+    usage(argc, argv);
+    exit(1);
+  }
+
+  if (broadcast && argc != argi + 1) {
+    fprintf(stderr, "Error: %s takes a signal and no pids.\n", argv[argi - 1]);
+    usage(argc, argv);
+    exit(1);
+  }
+
+  if (!broadcast && argc < argi + 2) {
+    fprintf(stderr, "Error: Not enough arguments.\n");
+    usage(argc, argv);
+    exit(1);
+  }
+
   /*
    * Parse the signal number/name.  It must either be a non-negative integger
    * or be of the form "SIGRTn" for some non-negative integer n.
    */
-  const char* sigstr = argv[1];
+  const char* sigstr = argv[argi++];
   int signum = -1;
   if (!strncasecmp(sigstr, "SIGRT", strlen("SIGRT"))) {
     char* endptr = NULL;
@@ -98,7 +374,7 @@ int main(int argc, char** argv)
     }
   } else {
     char* endptr = NULL;
-    signum = strtol(argv[1], &endptr, /* base */ 10);
+    signum = strtol(sigstr, &endptr, /* base */ 10);
     if (*endptr) {
       // An error occurred.
       signum = -1;
@@ -122,6 +398,39 @@ int main(int argc, char** argv)
     exit(1);
   }
 
+  /*
+   * Start watching the dump directory before we send any signals, so we
+   * can't miss a file written by a process that responds quickly.  Since we
+   * run as setuid root, check that our real user may read the directory;
+   * otherwise we'd let anyone discover the names of files in it.
+   */
+  int inotifyFd = -1;
+  if (waitDir) {
+    if (access(waitDir, R_OK | X_OK)) {
+      fprintf(stderr, "Error: Can't read directory %s: ", waitDir);
+      perror("");
+      exit(1);
+    }
+    inotifyFd = inotify_init();
+    if (inotifyFd < 0 ||
+        inotify_add_watch(inotifyFd, waitDir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      fprintf(stderr, "Error: Can't watch directory %s: ", waitDir);
+      perror("");
+      exit(1);
+    }
+  }
+
+  if (broadcast) {
+    int* pids = NULL;
+    int numPids = 0;
+    int rv = signalAllB2G(signum, childrenOnly, &pids, &numPids);
+    if (rv == 0 && inotifyFd >= 0) {
+      rv = waitForDumps(inotifyFd, pids, numPids, timeoutSecs);
+    }
+    free(pids);
+    return rv;
+  }
+
   /*
    * For some reason <vector> isn't in our include path.  Rather than figure
    * this out, we can just use malloc.
@@ -129,7 +438,7 @@ int main(int argc, char** argv)
 
   int* pids = new int[argc];
   int numPids = 0;
-  for (int i = 2; i < argc; i++) {
+  for (int i = argi; i < argc; i++) {
     char* endptr = NULL;
     int pid = strtol(argv[i], &endptr, /* base */ 10);
     if (*endptr || pid < 0) {
@@ -137,29 +446,13 @@ int main(int argc, char** argv)
       usage(argc, argv);
       exit(1);
     }
-    // We could use MAX_PATH_LEN, but this is 4K, and we know our strings
-    // can't possibly be that long, so we save some memory.
-    char path[64];
-    snprintf(path, sizeof(path), "/proc/%d/exe", pid);
     char exe[64];
-    int linklen = readlink(path, exe, sizeof(exe));
-    if (linklen < 0) {
-      fprintf(stderr, "Error: No such process %s", argv[i]);
-      exit(1);
-    }
-    if (linklen > (sizeof(exe) - 1)) {
-      linklen = sizeof(exe) - 1;
-    }
-    exe[linklen] = '\0';
-    bool foundAllowedExe = false;
-    for (int i = 0; i < ARRAY_LENGTH(sAllowedExes); i++) {
-      if (strcmp(exe, sAllowedExes[i]) == 0) {
-        foundAllowedExe = true;
-        break;
+    if (allowedExeIndex(pid, exe, sizeof(exe)) < 0) {
+      if (!exe[0]) {
+        fprintf(stderr, "Error: No such process %s", argv[i]);
+      } else {
+        fprintf(stderr, "Error: Process %s isn't allowed.\n", exe);
       }
-    }
-    if (!foundAllowedExe) {
-      fprintf(stderr, "Error: Process %s isn't allowed.\n", exe);
       exit(1);
     }
 
@@ -167,11 +460,15 @@ int main(int argc, char** argv)
     numPids++;
   }
 
+  int numSignalled = 0;
   for (int i = 0; i < numPids; i++) {
-    if (kill(pids[i], signum)) {
-      fprintf(stderr, "Failed to send signal %d to process %d", signum, pids[i]);
-      perror("");
+    if (sendSignal(pids[i], signum)) {
+      pids[numSignalled++] = pids[i];
     }
   }
+
+  if (inotifyFd >= 0) {
+    return waitForDumps(inotifyFd, pids, numSignalled, timeoutSecs);
+  }
   return 0;
 }